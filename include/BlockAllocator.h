@@ -0,0 +1,192 @@
+#if !defined(_BLOCK_ALLOCATOR_H_)
+#define _BLOCK_ALLOCATOR_H_
+
+#include "Common.h"
+#include "GlobalAddress.h"
+#include "DSM.h"
+#include "Timer.h"
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <iterator>
+#include <algorithm>
+
+
+/*
+  Size-class slab allocator for the out-of-line DataBlocks, shared by the threads of a compute node.
+  A thread carves the blocks of a size class from its own slab and caches the freed ones; a full cache is
+  drained into the shared pool by batches, and an empty one is refilled from it before a new slab is taken.
+  A block superseded in a leaf may still be read by the lock-free searches (of any compute node) holding its
+  DataPointer, so it is retired into the current epoch of the thread and reused only after a grace period of epochs;
+  the readers outlasting the grace period detect the reuse by the stamp of the block (see DataBlock). A thread drains
+  its expired epochs into the shared pools every define::kBlockBatchNum retires and whenever its cache runs out.
+  The per-thread state is kept per allocator and flushed into it when the thread exits.
+*/
+class BlockAllocator {
+
+public:
+  BlockAllocator(DSM *dsm) : dsm(dsm), id(next_id.fetch_add(1)) {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    registry[id] = this;
+  }
+
+  ~BlockAllocator() {  // NOTE: no concurrent access; the states of the live threads are freed when they exit
+    std::lock_guard<std::mutex> guard(registry_lock);
+    registry.erase(id);
+  }
+
+  GlobalAddress alloc(size_t size) {
+    int c = get_size_class(size);
+    auto& state = get_thread_state();
+    auto& cache = state.caches[c];
+    if (cache.empty()) {  // refill from the shared pool
+      drain_retired(state);
+      std::lock_guard<std::mutex> guard(pool_locks[c]);
+      auto& pool = pools[c];
+      auto n = std::min(pool.size(), (size_t)define::kBlockBatchNum);
+      cache.insert(cache.end(), pool.end() - n, pool.end());
+      pool.resize(pool.size() - n);
+    }
+    if (!cache.empty()) {
+      auto addr = cache.back();
+      cache.pop_back();
+      return addr;
+    }
+    // carve from the slab
+    auto& slab = state.slabs[c];
+    auto block_size = get_class_size(c);
+    if (slab.first == GlobalAddress::Null() || slab.first.offset + block_size > slab.second) {
+      slab.first = dsm->alloc(define::kBlockSlabSize, PACKED_ADDR_ALIGN_BIT);
+      slab.second = slab.first.offset + define::kBlockSlabSize;
+    }
+    auto addr = slab.first;
+    slab.first.offset += block_size;
+    return addr;
+  }
+
+  void free(const GlobalAddress& addr, size_t size) {  // the block is unreachable
+    int c = get_size_class(size);
+    auto& cache = get_thread_state().caches[c];
+    cache.emplace_back(addr);
+    if (cache.size() >= define::kBlockBatchNum * 2) {  // drain into the shared pool
+      std::lock_guard<std::mutex> guard(pool_locks[c]);
+      pools[c].insert(pools[c].end(), cache.end() - define::kBlockBatchNum, cache.end());
+      cache.resize(cache.size() - define::kBlockBatchNum);
+    }
+  }
+
+  void retire(const GlobalAddress& addr, size_t size) {  // the block is unlinked, but may be held by in-flight readers
+    auto& state = get_thread_state();
+    auto epoch = get_epoch();
+    if (state.retired.empty() || state.retired.back().first != epoch) state.retired.emplace_back(epoch, std::vector<std::pair<GlobalAddress, size_t> >());
+    state.retired.back().second.emplace_back(addr, size);
+    if (++ state.retired_cnt >= define::kBlockBatchNum) drain_retired(state);
+  }
+
+private:
+  static constexpr int kClassNum = (define::bufferBlockSize - 1) / (1 << PACKED_ADDR_ALIGN_BIT) + 1;
+
+  // DataPointers address the blocks at the granularity of packed addresses
+  static int get_size_class(size_t size) {
+    assert(size > 0 && size <= define::bufferBlockSize);
+    return (size - 1) >> PACKED_ADDR_ALIGN_BIT;
+  }
+  static size_t get_class_size(int c) { return (size_t)(c + 1) << PACKED_ADDR_ALIGN_BIT; }
+  static uint64_t get_epoch() { return Timer::get_time_ns() / define::kBlockEpochLen; }
+
+  using RetiredBlocks = std::deque<std::pair<uint64_t, std::vector<std::pair<GlobalAddress, size_t> > > >;  // [epoch, blocks] in epoch order
+
+  struct ThreadState {
+    std::vector<GlobalAddress> caches[kClassNum];
+    std::pair<GlobalAddress, uint64_t> slabs[kClassNum];  // [next block, slab end offset]
+    RetiredBlocks retired;
+    uint32_t retired_cnt = 0;  // since the last drain
+  };
+
+  struct ThreadStates {  // of a thread, per allocator id
+    std::vector<std::pair<uint64_t, ThreadState*> > states;
+
+    ~ThreadStates() {  // the thread exits
+      std::lock_guard<std::mutex> guard(registry_lock);
+      for (auto& [id, state] : states) {
+        auto it = registry.find(id);
+        if (it != registry.end()) it->second->flush(state);
+        delete state;
+      }
+    }
+  };
+
+  ThreadState& get_thread_state() {
+    auto& states = thread_states.states;
+    for (auto& [state_id, state] : states) if (state_id == id) return *state;
+    states.emplace_back(id, new ThreadState());
+    return *states.back().second;
+  }
+
+  void drain_retired(ThreadState& state) {  // move the blocks retired before the grace period into the shared pools
+    state.retired_cnt = 0;
+    auto epoch = get_epoch();
+    std::vector<std::pair<GlobalAddress, size_t> > expired;
+    take_expired(state.retired, epoch, expired);
+    if (has_orphans.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> guard(orphan_lock);
+      take_expired(orphan_retired, epoch, expired);
+      has_orphans.store(!orphan_retired.empty(), std::memory_order_relaxed);
+    }
+    if (expired.empty()) return;
+    std::sort(expired.begin(), expired.end(), [](const std::pair<GlobalAddress, size_t>& a, const std::pair<GlobalAddress, size_t>& b){
+      return get_size_class(a.second) < get_size_class(b.second);
+    });
+    for (auto it = expired.begin(); it != expired.end(); ) {  // one lock per size class
+      int c = get_size_class(it->second);
+      std::lock_guard<std::mutex> guard(pool_locks[c]);
+      for (; it != expired.end() && get_size_class(it->second) == c; ++ it) pools[c].emplace_back(it->first);
+    }
+  }
+
+  static void take_expired(RetiredBlocks& retired, uint64_t epoch, std::vector<std::pair<GlobalAddress, size_t> >& expired) {
+    while (!retired.empty() && retired.front().first + define::kBlockGraceEpochNum < epoch) {
+      auto& blocks = retired.front().second;
+      expired.insert(expired.end(), blocks.begin(), blocks.end());
+      retired.pop_front();
+    }
+  }
+
+  void flush(ThreadState* state) {  // hand the state of an exiting thread over to the shared pools
+    for (int c = 0; c < kClassNum; ++ c) {
+      auto& cache = state->caches[c];
+      auto& slab = state->slabs[c];
+      auto block_size = get_class_size(c);
+      std::lock_guard<std::mutex> guard(pool_locks[c]);
+      pools[c].insert(pools[c].end(), cache.begin(), cache.end());
+      if (slab.first == GlobalAddress::Null()) continue;
+      for (; slab.first.offset + block_size <= slab.second; slab.first.offset += block_size) pools[c].emplace_back(slab.first);
+    }
+    if (state->retired.empty()) return;
+    // the retired blocks still wait for their grace period, which is checked by the drains of the other threads
+    std::lock_guard<std::mutex> guard(orphan_lock);
+    RetiredBlocks merged;
+    std::merge(orphan_retired.begin(), orphan_retired.end(), state->retired.begin(), state->retired.end(), std::back_inserter(merged),
+               [](const RetiredBlocks::value_type& a, const RetiredBlocks::value_type& b){ return a.first < b.first; });
+    orphan_retired.swap(merged);
+    has_orphans.store(true, std::memory_order_relaxed);
+  }
+
+  DSM *dsm;
+  const uint64_t id;  // never reused, so that a thread state outliving its allocator is not taken for a later one
+  std::vector<GlobalAddress> pools[kClassNum];
+  std::mutex pool_locks[kClassNum];
+  RetiredBlocks orphan_retired;  // retired by the exited threads
+  std::mutex orphan_lock;
+  std::atomic<bool> has_orphans{false};
+
+  static inline std::atomic<uint64_t> next_id{0};
+  static inline std::map<uint64_t, BlockAllocator*> registry;  // live allocators
+  static inline std::mutex registry_lock;
+  static inline thread_local ThreadStates thread_states;
+};
+
+#endif // _BLOCK_ALLOCATOR_H_
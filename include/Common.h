@@ -8,6 +8,7 @@
 
 #include <atomic>
 #include <queue>
+#include <string>
 #include <bitset>
 #include <limits>
 
@@ -39,6 +40,12 @@
 #define MESSAGE_SIZE 96 // byte
 #define RAW_RECV_CQ_COUNT 4096 // 128
 #define MAX_TREE_HEIGHT 20
+#ifndef KEY_LEN
+#define KEY_LEN 8  // [CONFIG] set by CMake
+#endif
+#ifndef INLINE_VAL_LEN
+#define INLINE_VAL_LEN 8  // [CONFIG] set by CMake
+#endif
 
 // Auxiliary function
 #define STRUCT_OFFSET(type, field)  ((char *)&((type *)(0))->field - (char *)((type *)(0)))
@@ -78,19 +85,26 @@ using CoroQueue = std::queue<uint16_t>;
 
 namespace define {
 // KV size
-constexpr uint32_t keyLen = 8;
+constexpr uint32_t keyLen = KEY_LEN;  // inline key bytes, i.e., the order-preserving prefix of a string key (see str2key)
 constexpr uint32_t simulatedValLen = 8;
 #ifndef ENABLE_VAR_LEN_KV
 constexpr uint32_t inlineValLen = simulatedValLen;
 #else
-constexpr uint32_t inlineValLen = 8;
+constexpr uint32_t inlineValLen = INLINE_VAL_LEN;  // the room in LeafEntry for a DataPointer or the value of a tree opened with inline_value
+static_assert(inlineValLen >= sizeof(uint64_t) && inlineValLen <= 65);
 constexpr uint32_t indirectValLen = simulatedValLen;
-constexpr uint32_t dataBlockLen = sizeof(uint64_t) * 2 + 0 + simulatedValLen;
+constexpr uint32_t maxKeyLen = 128;  // the bytes of a longer key beyond its inline prefix follow the value in its DataRecord
+constexpr uint32_t dataBlockLen = sizeof(uint64_t) + keyLen + sizeof(uint32_t) * 2 + sizeof(uint32_t) * 2 + simulatedValLen;  // a block header and its first record, excluding the out-of-line key bytes
+constexpr uint32_t dataBlockMaxLen = 1024;  // [CONFIG] the records of the keys sharing an inline key are chained to the next DataBlock beyond it
+constexpr uint32_t dataBlockLenBit = 11;  // of a DataPointer, whose spare bits hold the version stamped on its block
+static_assert(dataBlockMaxLen >= dataBlockLen + maxKeyLen && dataBlockMaxLen < (1u << dataBlockLenBit));
 #endif
+constexpr uint32_t inlineValMaxLen = inlineValLen - 1;  // value bytes kept inline after their length, see LeafEntry::set_value_bytes
 }
 
 using Key = std::array<uint8_t, define::keyLen>;
 using Value = uint64_t;
+using ValueBytes = std::string;  // the bytes of a value kept inline, see LeafEntry::set_value_bytes
 
 namespace define {   // namespace define
 
@@ -109,6 +123,11 @@ constexpr uint64_t rdmaBufferSize     = 4;         // GB  [CONFIG] 4
 constexpr int kIndexCacheSize  = 100;  // MB including kHotspotBufSize 
 constexpr int kHotspotBufSize  = 30;
 
+// Learned Cache Index
+constexpr uint32_t kCacheModelSlotNum = 1 << 17;  // [TUNE] slots of the learned index of a tree, charged to the cache size
+constexpr int kCacheModelProbeNum     = 2;        // [TUNE] neighbouring slots checked on each side of the predicted one
+constexpr uint16_t kCacheModelTreeNum = 16;       // trees with smaller ids have a learned index
+
 // KV
 constexpr uint64_t kKeyMin = 1;
 constexpr uint64_t kLoadedKeyNum = 60000000;  // [CONFIG] 60000000
@@ -121,8 +140,11 @@ constexpr Value kValueMin = 1;
 constexpr Value kValueMax = std::numeric_limits<Value>::max();
 
 // Tree
+constexpr uint32_t kMaxTreeNum = 1 << 16;  // all the uint16_t tree ids
 constexpr uint64_t kRootPointerStoreOffest = kChunkSize / 2;
 static_assert(kRootPointerStoreOffest % sizeof(uint64_t) == 0);
+constexpr uint64_t kRetiredLeafStoreOffest = kRootPointerStoreOffest + sizeof(uint64_t) * kMaxTreeNum;  // after the root pointers of all tree ids
+static_assert(kRetiredLeafStoreOffest + sizeof(uint64_t) * kMaxTreeNum <= kChunkSize);
 
 // Packed GlobalAddress
 constexpr uint32_t mnIdBit         = 8;
@@ -138,13 +160,13 @@ constexpr uint32_t cachelineSize   = 64;
 constexpr uint32_t blockSize       = cachelineSize - versionSize;
 
 // Leaf Node
-constexpr uint32_t leafSpanSize    = 64;  // 64
+constexpr uint32_t leafSpanSize    = 64;  // 64; fixed per build, while the neighborhood size can be narrowed per tree (see Tree::neighbor_size)
 #ifdef SIBLING_BASED_VALIDATION
-constexpr uint32_t scatterMetadataSize = versionSize + sizeof(uint8_t) + sizeof(uint64_t);
+constexpr uint32_t scatterMetadataSize = versionSize + sizeof(uint8_t) * 3 + sizeof(uint64_t);
 #else
-constexpr uint32_t scatterMetadataSize = versionSize + sizeof(uint8_t) + sizeof(uint64_t) + keyLen * 2;
+constexpr uint32_t scatterMetadataSize = versionSize + sizeof(uint8_t) * 3 + sizeof(uint64_t) + keyLen * 2;
 #endif
-constexpr uint32_t leafMetadataSize    = versionSize + sizeof(uint8_t) * 2 + sizeof(uint64_t) + keyLen * 2;
+constexpr uint32_t leafMetadataSize    = versionSize + sizeof(uint8_t) * 4 + sizeof(uint64_t) + keyLen * 2;
 #ifdef HOPSCOTCH_LEAF_NODE
 constexpr uint32_t leafEntrySize = versionSize + sizeof(uint16_t) + keyLen + inlineValLen;
 #else
@@ -158,6 +180,9 @@ constexpr uint32_t internalEntrySize    = versionSize + keyLen + sizeof(uint64_t
 
 // Hopscotch Hashing
 constexpr uint32_t neighborSize  = 8;
+constexpr uint32_t minNeighborSize = 4;         // [TUNE] a leaf neighborhood grows from / shrinks to this size
+constexpr uint32_t leafBucketSize = neighborSize / 2;  // bucket-based leaf hash schemes: a neighborhood spans two buckets
+constexpr uint32_t leafBucketNum  = leafSpanSize / leafBucketSize;
 constexpr uint32_t entryGroupNum = leafSpanSize / neighborSize + ((leafSpanSize % neighborSize) ? 1 : 0);
 constexpr uint32_t groupSize     = leafEntrySize * neighborSize;
 constexpr uint32_t overflowNum   = entryGroupNum * neighborSize - leafSpanSize;
@@ -201,7 +226,7 @@ constexpr int64_t  kPerCoroRdmaBuf    = kPerThreadRdmaBuf / MAX_CORO_NUM;
 constexpr uint32_t bufferEntrySize    = ADD_CACHELINE_VERSION_SIZE(scatterMetadataSize + std::max(leafEntrySize, internalEntrySize), versionSize);
 constexpr uint32_t bufferMetadataSize = ADD_CACHELINE_VERSION_SIZE(std::max(leafMetadataSize, internalMetadataSize), versionSize);
 #ifdef ENABLE_VAR_LEN_KV
-constexpr uint32_t bufferBlockSize    = dataBlockLen;
+constexpr uint32_t bufferBlockSize    = dataBlockMaxLen;
 #else
 constexpr uint32_t bufferBlockSize    = 0;
 #endif
@@ -215,6 +240,35 @@ constexpr uint64_t kOnChipLockNum   = kLockChipMemSize * 8;  // 1bit-lock
 // Greedy
 constexpr uint64_t greedySizePerIO       = transLeafSize / 2;  // [TUNE]
 constexpr uint32_t maxLeafEntryPerIO     = greedySizePerIO / leafEntrySize;
+
+// Range Query Cost Model
+constexpr uint64_t rangeIOCost           = cachelineSize * 4;                 // [TUNE] read bytes that an extra RDMA IO is equivalent to
+constexpr uint32_t rangeMaxEnumKeyNum    = leafSpanSize / neighborSize * 2;  // [TUNE] wider ranges read entire leaves without enumerating keys
+constexpr int rangePipelineLeafNum        = 8;  // [TUNE] leaves read by one wave of a pipelined range query
+constexpr uint64_t rangeWindowSize       = allocationLeafSize * rangePipelineLeafNum * 2;  // range buffer bytes for the leaves of a range query, whatever its length (and as many for its level-1 nodes and DataBlocks)
+constexpr int rangeDiscoverNodeNum        = 2;  // [TUNE] uncached level-1 nodes fetched at a time once a range query runs out of leaves
+
+// Leaf Merge
+constexpr uint32_t leafMergeThreshold    = leafSpanSize / 4;      // [TUNE] leaves with fewer live entries are merged into the left sibling
+constexpr uint32_t leafMergeCapacity     = leafSpanSize * 3 / 4;  // [TUNE] max live entries in a merged leaf, to avoid splitting it again soon
+constexpr uint64_t kNodeReclaimDelay     = 100 * 1000 * 1000;    // ns, a merged leaf is reused only after it is unreachable for long enough
+constexpr uint32_t kMaxLeafIncarnation   = (1 << 8) - 1;         // a leaf address is no longer reused after this incarnation
+
+// Leaf Rehash
+constexpr uint32_t leafRehashCapacity    = leafSpanSize * 3 / 4;  // [TUNE] a leaf failing to hop with fewer live entries is rehashed in place instead of split
+
+// DataBlock Allocation
+constexpr uint64_t kBlockSlabSize        = 1 * MB;  // remote memory carved into the DataBlocks of one size class at a time
+constexpr uint32_t kBlockBatchNum        = 64;      // freed DataBlocks moved between a thread cache and the shared pool at a time
+constexpr uint64_t kBlockEpochLen        = 10 * 1000 * 1000;  // ns
+constexpr uint64_t kBlockGraceEpochNum   = kNodeReclaimDelay / kBlockEpochLen;  // epochs a retired DataBlock waits before reuse
+
+// Scan
+constexpr int scanPrefetchLeafNum        = 4;  // [TUNE] leaves fetched by one doorbell batch in Tree::Scanner
+
+// Bulk Load
+constexpr double bulkLoadFillFactor      = 0.75;  // [TUNE] fraction of each node filled by Tree::bulk_load, leaving room for later inserts
+constexpr int bulkLoadBatchNum           = 64;    // [TUNE] nodes written by one doorbell batch in Tree::bulk_load
 }
 
 
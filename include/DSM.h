@@ -54,6 +54,8 @@ public:
   void read_batch_sync(RdmaOpRegion *rs, int k, CoroPull* sink = nullptr);
   void read_batch_sync_without_sink(RdmaOpRegion *rs, int k, CoroPull* sink, CoroQueue* waiting_queue);
   void read_batches_sync(const std::vector<RdmaOpRegion>& rs, CoroPull* sink = nullptr);
+  int read_batches_async(const std::vector<RdmaOpRegion>& rs, CoroPull* sink = nullptr);  // return the number of signaled batches
+  void wait_batches(int cnt, CoroPull* sink = nullptr);  // wait for the batches posted by read_batches_async
 
   void write_batch(RdmaOpRegion *rs, int k, bool signal = true,
                    CoroPull* sink = nullptr);
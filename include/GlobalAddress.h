@@ -4,20 +4,22 @@
 #include "Common.h"
 
 #include <iostream>
+#include <tuple>
 
 /* Global Address */
 class GlobalAddress {
 public:
   union {
   struct {
-  uint64_t nodeID : 16;
-  uint64_t offset : 48;
+  uint64_t nodeID      : 16;
+  uint64_t incarnation : 8;   // bumped when a reclaimed leaf is reused, so that its stale pointers can be told apart; never wraps
+  uint64_t offset      : 40;
   };
   uint64_t val;
   };
 
   GlobalAddress() : val(0) {}
-  GlobalAddress(uint64_t nodeID, uint64_t offset) : nodeID(nodeID), offset(offset) {}
+  GlobalAddress(uint64_t nodeID, uint64_t offset, uint64_t incarnation = 0) : nodeID(nodeID), incarnation(incarnation), offset(offset) {}
   GlobalAddress(uint64_t val) : val(val) {}
   GlobalAddress(const GlobalAddress& gaddr) : val(gaddr.val) {}
 
@@ -33,11 +35,11 @@ public:
   };
 
   GlobalAddress operator+(int b) const {
-    return GlobalAddress(nodeID, offset + b);
+    return GlobalAddress(nodeID, offset + b, incarnation);
   }
 
   GlobalAddress operator-(int b) const {
-    return GlobalAddress(nodeID, offset - b);
+    return GlobalAddress(nodeID, offset - b, incarnation);
   }
 
   static GlobalAddress Widest() {
@@ -46,14 +48,15 @@ public:
 } __attribute__((packed));
 
 static_assert(sizeof(GlobalAddress) == sizeof(uint64_t));
+static_assert(define::dsmSize * define::GB <= (1ULL << 40));
 
 
 inline bool operator==(const GlobalAddress &lhs, const GlobalAddress &rhs) {
-  return (lhs.nodeID == rhs.nodeID) && (lhs.offset == rhs.offset);
+  return (lhs.nodeID == rhs.nodeID) && (lhs.offset == rhs.offset) && (lhs.incarnation == rhs.incarnation);
 }
 
 inline bool operator<(const GlobalAddress &lhs, const GlobalAddress &rhs) {
-  return std::make_pair(lhs.nodeID, lhs.offset) < std::make_pair(rhs.nodeID, rhs.offset);
+  return std::make_tuple(lhs.nodeID, lhs.offset, lhs.incarnation) < std::make_tuple(rhs.nodeID, rhs.offset, rhs.incarnation);
 }
 
 inline bool operator!=(const GlobalAddress &lhs, const GlobalAddress &rhs) {
@@ -7,10 +7,11 @@
 #include "city.h"
 
 
-inline uint64_t get_hashed_local_lock_index(const Key& k) {
+inline uint64_t get_hashed_local_lock_index(const Key& k, uint16_t tree_id = 0) {
   // return CityHash64((char *)&k, sizeof(k)) % define::kLocalLockNum;
   uint64_t res = 0, cnt = 0;
   for (auto a : k) if (cnt ++ < 8) res = (res << 8) + a;
+  res += tree_id * 0x9E3779B97F4A7C15ULL;  // spread the same keys of different trees
   return res % define::kLocalLockNum;
 }
 
@@ -60,12 +60,6 @@ public:
     return metadata.fence_keys == FenceKeys::Widest();
   }
 
-  int64_t consumed_cache_size() const {
-    int cnt = 0;
-    for (const auto& e : records) if (e.key != define::kkeyNull) ++ cnt;
-    return sizeof(uint64_t) + sizeof(InternalMetadata) + cnt * sizeof(InternalEntry);
-  }
-
   static const bool IS_LEAF = false;
 } __attribute__((packed));
 
@@ -76,4 +70,92 @@ inline bool operator==(const InternalNode &lhs, const InternalNode &rhs) {
 }
 
 
+
+/* Cached Internal Node: [level, entry_num, leftmost/sibling_leftmost ptr, fence keys, ptrs, keys, (neighbor sizes)]
+   Only the pointers and the keys of the valid entries are cached, followed by the neighborhood hints of the child leaves. */
+class CachedInternalNode {
+public:
+  uint8_t level;
+  uint8_t entry_num;
+  GlobalAddress leftmost_ptr;
+  GlobalAddress sibling_leftmost_ptr;
+  FenceKeys fence_keys;
+
+public:
+  static CachedInternalNode *compress(const InternalNode *node);  // the node must be kv-sorted; release it with free()
+  void decompress(InternalNode *node) const;
+
+  GlobalAddress ptr(int i) const {
+    GlobalAddress p;
+    memcpy(&p, payload() + i * sizeof(GlobalAddress), sizeof(GlobalAddress));
+    return p;
+  }
+  Key key(int i) const {
+    Key k;
+    memcpy(k.data(), key_data(i), define::keyLen);
+    return k;
+  }
+  int upper_bound(const Key& k) const {  // number of the separators <= k
+    int l = 0, r = entry_num;
+    while (l < r) {
+      int m = (l + r) / 2;
+      if (memcmp(key_data(m), k.data(), define::keyLen) <= 0) l = m + 1;
+      else r = m;
+    }
+    return l;
+  }
+
+#ifdef HOPSCOTCH_LEAF_NODE
+  uint8_t *neighbor_size(int child_idx) const {  // the neighborhood size of a child leaf learned by the searches (0 if unknown); child 0 is the leftmost one
+    return (uint8_t *)key_data(entry_num) + child_idx;
+  }
+#endif
+  size_t size() const { return payload_size(entry_num); }
+  int64_t consumed_cache_size() const { return sizeof(uint64_t) + size(); }
+
+private:
+  const char *payload() const { return (const char *)this + sizeof(CachedInternalNode); }
+  const uint8_t *key_data(int i) const { return (const uint8_t *)payload() + entry_num * sizeof(GlobalAddress) + i * define::keyLen; }
+  static size_t payload_size(int entry_num) {
+#ifdef HOPSCOTCH_LEAF_NODE
+    return sizeof(CachedInternalNode) + entry_num * (sizeof(GlobalAddress) + define::keyLen) + (entry_num + 1);
+#else
+    return sizeof(CachedInternalNode) + entry_num * (sizeof(GlobalAddress) + define::keyLen);
+#endif
+  }
+} __attribute__((packed));
+
+inline CachedInternalNode *CachedInternalNode::compress(const InternalNode *node) {
+  const auto& records = node->records;
+  int entry_num = 0;
+  while (entry_num < (int)define::internalSpanSize && records[entry_num].key != define::kkeyNull) ++ entry_num;
+
+  auto cached = (CachedInternalNode *)malloc(payload_size(entry_num));
+  cached->level = node->metadata.level;
+  cached->entry_num = entry_num;
+  cached->leftmost_ptr = node->metadata.leftmost_ptr;
+  cached->sibling_leftmost_ptr = node->metadata.sibling_leftmost_ptr;
+  cached->fence_keys = node->metadata.fence_keys;
+  auto ptrs = (char *)cached + sizeof(CachedInternalNode);
+  auto keys = ptrs + entry_num * sizeof(GlobalAddress);
+  for (int i = 0; i < entry_num; ++ i) {
+    memcpy(ptrs + i * sizeof(GlobalAddress), &records[i].ptr, sizeof(GlobalAddress));
+    memcpy(keys + i * define::keyLen, records[i].key.data(), define::keyLen);
+  }
+#ifdef HOPSCOTCH_LEAF_NODE
+  memset(keys + entry_num * define::keyLen, 0, entry_num + 1);
+#endif
+  return cached;
+}
+
+inline void CachedInternalNode::decompress(InternalNode *node) const {
+  new (node) InternalNode;
+  node->metadata.level = level;
+  node->metadata.leftmost_ptr = leftmost_ptr;
+  node->metadata.sibling_leftmost_ptr = sibling_leftmost_ptr;
+  node->metadata.fence_keys = fence_keys;
+  for (int i = 0; i < entry_num; ++ i) node->records[i].update(key(i), ptr(i));
+}
+
+
 #endif // _INTERNAL_NODE_H_
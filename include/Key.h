@@ -3,6 +3,9 @@
 
 #include "Common.h"
 
+#include <string>
+#include <algorithm>
+
 
 inline uint8_t get_partial(const Key& key, int depth) {
   return depth == 0 ? 0 : key.at(depth - 1);
@@ -130,10 +133,11 @@ inline Key int2key(uint64_t key) {
   return res;
 }
 
+/* The inline key of a string key: its first define::keyLen bytes, zero-padded, which keeps the key order. The internal nodes, the fence keys
+   and the caches route by inline keys only, since the longer keys sharing one inline key colocate in its leaf entry (see DataBlock) */
 inline Key str2key(const std::string &key) {
-  // assert(key.size() <= define::keyLen);
   Key res{};
-  std::copy(key.begin(), key.size() <= define::keyLen ? key.end() : key.begin() + define::keyLen, res.begin());
+  std::copy(key.begin(), key.begin() + std::min(key.size(), (size_t)define::keyLen), res.begin());
   return res;
 }
 
@@ -0,0 +1,216 @@
+#if !defined(_LEAF_HASH_SCHEME_H_)
+#define _LEAF_HASH_SCHEME_H_
+
+#include "Common.h"
+#include "LeafNode.h"
+#include "Hash.h"
+
+#include <city.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef HOPSCOTCH_LEAF_NODE
+/*
+  In-leaf placement schemes of the hashed leaf nodes, selected by LEAF_HASH_SCHEME.
+  Each scheme maps a key to one home entry and keeps the key within [home, home + neighbor size), with its offset set in
+  the hop bitmap of the home; so the reads, the hop-bitmap validation, the segment writes and the metadata replicas are
+  shared by the schemes, which only differ in the homes, the choice of the slot and the split key.
+*/
+template <class SCHEME>
+class LeafHashSchemeBase {
+protected:
+  static LeafEntry& get_entry(LeafEntry* records, int logical_idx) {
+    return records[(logical_idx + define::leafSpanSize) % define::leafSpanSize];
+  }
+
+  /* Hopping: fill the nearest empty slot among the first search_num ones, and hop it back into the neighborhood */
+  static int hop_insert(LeafEntry* records, int hash_idx, const Key& k, Value v, int neighbor_size, int search_num, std::vector<int>* hopped_idxes) {
+    // find an empty slot
+    int j = -1;
+    for (int i = hash_idx; i < hash_idx + search_num; ++ i) {
+      if (get_entry(records, i).key == define::kkeyNull) {
+        j = i;
+        break;
+      }
+    }
+    // hop
+    if (j < 0) return -1;  // no empty slot
+next_hop:
+    if (hopped_idxes) hopped_idxes->emplace_back(j % define::leafSpanSize);
+    if (j < hash_idx + neighbor_size) {
+      get_entry(records, j).update(k, v);
+      get_entry(records, hash_idx).set_hop_bit(j - hash_idx);
+      return j % define::leafSpanSize;
+    }
+    for (int offset = neighbor_size - 1; offset > 0; -- offset) {
+      int h = j - offset;
+      // speed up using hopscotch bitmap
+      int h_hash_idx = -1;
+      for (int z = neighbor_size - 1; z >= 0; -- z) {
+        int h_home = (h - z + define::leafSpanSize) % define::leafSpanSize;
+        // corner case
+        if (h - h_home < 0) h_home -= define::leafSpanSize;
+        else if (h - h_home >= neighbor_size) h_home += define::leafSpanSize;
+        assert(h_home <= h);
+        if (h_home + neighbor_size > j && (get_entry(records, h_home).hop_bitmap & (1ULL << (define::neighborSize - z - 1)))) {
+          h_hash_idx = h_home;
+          break;
+        }
+      }
+      if (h_hash_idx < 0) continue;
+      // hop h => j is ok
+      get_entry(records, j).update(get_entry(records, h));
+      get_entry(records, h_hash_idx).unset_hop_bit(h - h_hash_idx);
+      get_entry(records, h_hash_idx).set_hop_bit(j - h_hash_idx);
+      j = h;
+      goto next_hop;
+    }
+    return -1;  // hopping fails
+  }
+
+  /* The keys whose slots, if emptied, let k hop into its neighborhood */
+  static std::vector<Key> hop_critical_keys(LeafEntry* records, int hash_idx, int neighbor_size) {
+    std::vector<Key> critical_keys;
+    for (int empty_idx = hash_idx; empty_idx < hash_idx + (int)define::leafSpanSize; ++ empty_idx) {
+      if (get_entry(records, empty_idx).key == define::kkeyNull) break;
+      // try hopping assuming that get_entry(empty_idx) is empty
+      int j = empty_idx;
+next_hop:
+      if (j < hash_idx + neighbor_size) {
+        critical_keys.emplace_back(get_entry(records, empty_idx).key);
+        continue;
+      }
+      for (int offset = neighbor_size - 1; offset > 0; -- offset) {
+        int h = j - offset;
+        int h_hash_idx = SCHEME::get_home_index(get_entry(records, h).key);
+        // corner case
+        if (h - h_hash_idx < 0) h_hash_idx -= define::leafSpanSize;
+        else if (h - h_hash_idx >= neighbor_size) h_hash_idx += define::leafSpanSize;
+        // hop h => j is ok
+        if (h_hash_idx + neighbor_size > j) {
+          j = h;
+          goto next_hop;
+        }
+      }
+    }
+    return critical_keys;
+  }
+
+  /* Bucketing: no entry moves; fill the first empty slot by the preferred order of the neighborhood offsets */
+  static int fill_insert(LeafEntry* records, int hash_idx, const Key& k, Value v, int neighbor_size, int search_num, std::vector<int>* hopped_idxes,
+                         const std::vector<int>& offsets) {
+    for (int offset : offsets) if (offset < std::min(neighbor_size, search_num)) {
+      auto& e = get_entry(records, hash_idx + offset);
+      if (e.key != define::kkeyNull) continue;
+      e.update(k, v);
+      get_entry(records, hash_idx).set_hop_bit(offset);
+      int idx = (hash_idx + offset) % define::leafSpanSize;
+      if (hopped_idxes) hopped_idxes->emplace_back(idx);
+      return idx;
+    }
+    return -1;  // the neighborhood is full
+  }
+
+  /* The keys in the neighborhood, any of which leaves a slot for k once moved */
+  static std::vector<Key> fill_critical_keys(LeafEntry* records, int hash_idx, int neighbor_size) {
+    std::vector<Key> critical_keys;
+    for (int offset = 0; offset < neighbor_size; ++ offset) {
+      const auto& e = get_entry(records, hash_idx + offset);
+      if (e.key != define::kkeyNull) critical_keys.emplace_back(e.key);
+    }
+    return critical_keys;
+  }
+
+  /* Split by the median of the critical keys and k, so that k can be inserted after node split */
+  static Key get_median_key(std::vector<Key>& critical_keys, const Key& k) {
+    assert(!critical_keys.empty());
+    critical_keys.emplace_back(k);
+    std::sort(critical_keys.begin(), critical_keys.end());
+    return critical_keys.at(critical_keys.size() / 2);
+  }
+};
+
+
+/* Hopscotch hashing: the home is any entry, and the entries hop towards their homes to make room */
+class HopscotchHashScheme : public LeafHashSchemeBase<HopscotchHashScheme> {
+public:
+  static constexpr const char* kName = "hopscotch";
+
+  static int get_home_index(const Key& k) { return get_hashed_leaf_entry_index(k); }
+
+  static int insert(LeafEntry* records, const Key& k, Value v, int neighbor_size, int search_num = define::leafSpanSize, std::vector<int>* hopped_idxes = nullptr) {
+    return hop_insert(records, get_home_index(k), k, v, neighbor_size, search_num, hopped_idxes);
+  }
+
+  static Key get_split_key(LeafEntry* records, const Key& k, int neighbor_size) {
+    auto critical_keys = hop_critical_keys(records, get_home_index(k), neighbor_size);
+    return get_median_key(critical_keys, k);
+  }
+};
+
+
+/* FaRM-style chained buckets: the home is a bucket, chained to the next one, and the entries hop between the buckets */
+class FaRMHashScheme : public LeafHashSchemeBase<FaRMHashScheme> {
+public:
+  static constexpr const char* kName = "farm";
+
+  static int get_home_index(const Key& k) { return get_hashed_leaf_entry_index(k) / define::leafBucketSize * define::leafBucketSize; }
+
+  static int insert(LeafEntry* records, const Key& k, Value v, int neighbor_size, int search_num = define::leafSpanSize, std::vector<int>* hopped_idxes = nullptr) {
+    return hop_insert(records, get_home_index(k), k, v, neighbor_size, search_num, hopped_idxes);
+  }
+
+  static Key get_split_key(LeafEntry* records, const Key& k, int neighbor_size) {
+    auto critical_keys = hop_critical_keys(records, get_home_index(k), neighbor_size);
+    return get_median_key(critical_keys, k);
+  }
+};
+
+
+/* RACE-style overflow colocation: the buckets are grouped as [main, overflow, main], and a key fills its main bucket
+   before the overflow bucket shared with the other main one; the neighborhood of a right main bucket starts from its overflow bucket */
+class RaceHashScheme : public LeafHashSchemeBase<RaceHashScheme> {
+public:
+  static constexpr const char* kName = "race";
+
+  static int get_home_index(const Key& k) {
+    int bucket = get_main_bucket(k);
+    return (bucket % 3 == 2 ? bucket - 1 : bucket) * define::leafBucketSize;
+  }
+
+  static int insert(LeafEntry* records, const Key& k, Value v, int neighbor_size, int search_num = define::leafSpanSize, std::vector<int>* hopped_idxes = nullptr) {
+    int main_offset = (get_main_bucket(k) % 3 == 2 ? define::leafBucketSize : 0);
+    std::vector<int> offsets;
+    for (int i = 0; i < (int)define::leafBucketSize; ++ i) offsets.emplace_back(main_offset + i);
+    for (int i = 0; i < (int)define::leafBucketSize; ++ i) offsets.emplace_back(define::leafBucketSize - main_offset + i);
+    return fill_insert(records, get_home_index(k), k, v, neighbor_size, search_num, hopped_idxes, offsets);
+  }
+
+  static Key get_split_key(LeafEntry* records, const Key& k, int neighbor_size) {
+    auto critical_keys = fill_critical_keys(records, get_home_index(k), neighbor_size);
+    return get_median_key(critical_keys, k);
+  }
+
+private:
+  // a trailing main bucket without a group overflows into the first bucket
+  static constexpr int kMainBucketNum = define::leafBucketNum - (define::leafBucketNum + 1) / 3;
+
+  static int get_main_bucket(const Key& k) {
+    int i = CityHash64((char *)&k, sizeof(k)) % kMainBucketNum;
+    return i / 2 * 3 + (i % 2 ? 2 : 0);
+  }
+};
+
+
+static_assert(define::neighborSize % 2 == 0 && define::leafSpanSize % define::leafBucketSize == 0);
+
+#if defined(LEAF_HASH_SCHEME_FARM)
+using LeafHashScheme = FaRMHashScheme;
+#elif defined(LEAF_HASH_SCHEME_RACE)
+using LeafHashScheme = RaceHashScheme;
+#else
+using LeafHashScheme = HopscotchHashScheme;
+#endif
+#endif
+
+#endif // _LEAF_HASH_SCHEME_H_
@@ -11,12 +11,17 @@ public:
   // metadata
   uint8_t level;  // always 0
   uint8_t valid;
+  uint8_t neighbor_size;  // hopscotch neighborhood size of the leaf, no more than the one of the tree
+  uint8_t incarnation;    // the incarnation of the leaf address, see reclaim_leaf
   GlobalAddress sibling_ptr;
   FenceKeys fence_keys;
 
 public:
-  LeafMetadata() : h_version(), level(0), valid(1), sibling_ptr(), fence_keys() {}
-  LeafMetadata(PackedVersion h_version, uint8_t level, uint8_t valid, GlobalAddress sibling_ptr, FenceKeys fence_keys) : h_version(h_version), level(level), valid(valid), sibling_ptr(sibling_ptr), fence_keys(fence_keys) {}
+  LeafMetadata() : h_version(), level(0), valid(1), neighbor_size(define::neighborSize), incarnation(0), sibling_ptr(), fence_keys() {}
+  LeafMetadata(PackedVersion h_version, uint8_t level, uint8_t valid, uint8_t neighbor_size, uint8_t incarnation, GlobalAddress sibling_ptr, FenceKeys fence_keys) : h_version(h_version), level(level), valid(valid), neighbor_size(neighbor_size), incarnation(incarnation), sibling_ptr(sibling_ptr), fence_keys(fence_keys) {}
+
+  // a pointer to a former incarnation of a reused leaf is stale
+  bool is_valid(const GlobalAddress& leaf_addr) const { return valid && incarnation == leaf_addr.incarnation; }
 } __attribute__((packed));
 
 static_assert(sizeof(LeafMetadata) == define::leafMetadataSize);
@@ -53,6 +58,24 @@ public:
 #endif
 
   void update(const Key& k, const Value& v) { key = k, value = v; }
+  void update(const LeafEntry& e) { key = e.key, memcpy(_padding, e._padding, define::inlineValLen); }  // move a kv with its whole value field
+  // value bytes are kept as [0x80 | length, bytes, zero padding], so that the value is never kValueNull
+  void set_value_bytes(const ValueBytes& bytes) {
+    assert(bytes.size() <= define::inlineValMaxLen);
+    memset(_padding, 0, define::inlineValLen);
+    _padding[0] = 0x80 | bytes.size();
+    memcpy(_padding + 1, bytes.data(), bytes.size());
+  }
+  static Value get_leading_value(const ValueBytes& bytes) {  // the Value field of the encoded bytes
+    LeafEntry e;
+    e.set_value_bytes(bytes);
+    return e.value;
+  }
+  ValueBytes get_value_bytes() const {
+    if (value == define::kValueNull) return ValueBytes();  // e.g., a removed max key
+    assert((_padding[0] & 0x80) && (_padding[0] & 0x7f) <= define::inlineValMaxLen);
+    return ValueBytes((const char *)_padding + 1, _padding[0] & 0x7f);
+  }
 #ifdef HOPSCOTCH_LEAF_NODE
   void set_hop_bit(int idx) {
     assert(idx >= 0 && idx < (int)define::neighborSize && !(hop_bitmap & (1ULL << (define::neighborSize - idx - 1))));
@@ -106,31 +129,35 @@ class ScatteredMetadata {
 public:
   PackedVersion h_version;
   uint8_t valid;
+  uint8_t neighbor_size;
+  uint8_t incarnation;
   GlobalAddress sibling_ptr;
 
-  ScatteredMetadata(const LeafMetadata& metadata): h_version(metadata.h_version), valid(1), sibling_ptr(metadata.sibling_ptr) {}
+  ScatteredMetadata(const LeafMetadata& metadata): h_version(metadata.h_version), valid(metadata.valid), neighbor_size(metadata.neighbor_size), incarnation(metadata.incarnation), sibling_ptr(metadata.sibling_ptr) {}
 } __attribute__((packed));
 
 static_assert(sizeof(ScatteredMetadata) == define::scatterMetadataSize);
 
 inline bool operator==(const ScatteredMetadata &lhs, const ScatteredMetadata &rhs) {
-  return (lhs.sibling_ptr == rhs.sibling_ptr);
+  return (lhs.sibling_ptr == rhs.sibling_ptr) && (lhs.neighbor_size == rhs.neighbor_size) && (lhs.incarnation == rhs.incarnation);
 }
 #else
 class ScatteredMetadata {
 public:
   PackedVersion h_version;
   uint8_t valid;
+  uint8_t neighbor_size;
+  uint8_t incarnation;
   GlobalAddress sibling_ptr;
   FenceKeys fence_keys;
 
-  ScatteredMetadata(const LeafMetadata& metadata): h_version(metadata.h_version), valid(1), sibling_ptr(metadata.sibling_ptr), fence_keys(metadata.fence_keys) {}
+  ScatteredMetadata(const LeafMetadata& metadata): h_version(metadata.h_version), valid(metadata.valid), neighbor_size(metadata.neighbor_size), incarnation(metadata.incarnation), sibling_ptr(metadata.sibling_ptr), fence_keys(metadata.fence_keys) {}
 } __attribute__((packed));
 
 static_assert(sizeof(ScatteredMetadata) == define::scatterMetadataSize);
 
 inline bool operator==(const ScatteredMetadata &lhs, const ScatteredMetadata &rhs) {
-  return (lhs.sibling_ptr == rhs.sibling_ptr) && (lhs.fence_keys == rhs.fence_keys);
+  return (lhs.sibling_ptr == rhs.sibling_ptr) && (lhs.neighbor_size == rhs.neighbor_size) && (lhs.incarnation == rhs.incarnation) && (lhs.fence_keys == rhs.fence_keys);
 }
 #endif
 
@@ -5,11 +5,11 @@
 #include "GlobalAddress.h"
 
 #include <vector>
-#include <list>
+#include <map>
 
 // for fine-grained shared memory alloc
 // not thread safe
-// now it is a simple log-structure alloctor
+// now it is a simple log-structure alloctor, with a pool of freed blocks indexed by size
 class LocalAllocator {
 
 public:
@@ -18,11 +18,22 @@ public:
     cur = GlobalAddress::Null();
   }
 
-  using FreeList = std::list<std::pair<GlobalAddress, size_t> >;
+  using FreeList = std::multimap<size_t, GlobalAddress>;  // [size, addr]
   GlobalAddress malloc(size_t size, bool &need_chunck, uint8_t align_bit = CACHELINE_ALIGN_BIT) {
     GlobalAddress res;
 
-    // search from prefetch memory first
+    // reuse a freed block of the same size first
+    auto range = free_list.equal_range(size);
+    for (auto iter = range.first; iter != range.second; ++ iter) {
+      if (iter->second.offset == ROUND_UP(iter->second.offset, align_bit)) {
+        res = iter->second;
+        free_list.erase(iter);
+        need_chunck = false;
+        return res;
+      }
+    }
+
+    // search from prefetch memory then
     if (align_bit) {
       cur.offset = ROUND_UP(cur.offset, align_bit);
     }
@@ -34,15 +45,13 @@ public:
       cur.offset += size;
     }
 
-    // search from the free_list then
+    // search from the free_list at last
     if (need_chunck) {
-      for (auto iter = free_list.begin(); iter != free_list.end(); ++ iter) {
-        if (iter->second >= size) {
-          res = iter->first;
-          free_list.erase(iter);
-          need_chunck = false;
-          break;
-        }
+      auto iter = free_list.lower_bound(size);
+      if (iter != free_list.end()) {
+        res = iter->second;
+        free_list.erase(iter);
+        need_chunck = false;
       }
     }
 
@@ -54,7 +63,7 @@ public:
   }
 
   void free(const GlobalAddress &addr, size_t size) {
-    free_list.push_back(std::make_pair(addr, size));
+    free_list.emplace(size, addr);
   }
 
 private:
@@ -10,6 +10,8 @@
 
 #include <queue>
 #include <set>
+#include <vector>
+#include <functional>
 #include <atomic>
 #include <mutex>
 
@@ -22,6 +24,22 @@ enum HandoverType {
 };
 
 
+using TaggedKey = std::pair<uint16_t, Key>;  // (tree_id, key), since the trees of a catalog share one lock table
+
+
+// a pending read-modify-write, combined by the first rmw on the same key
+struct RMWRequest {
+  TaggedKey k;
+  const std::function<Value (Value)>& func;
+  Value old_v;
+  RMWRequest *next;
+  std::atomic<bool> done;
+  std::atomic<bool> combiner;
+
+  RMWRequest(const Key& k, const std::function<Value (Value)>& func, uint16_t tree_id = 0) : k(tree_id, k), func(func), old_v(define::kValueNull), next(nullptr), done(false), combiner(false) {}
+};
+
+
 struct LocalLockNode {
   // read waiting queue
   std::atomic<uint8_t> read_current;
@@ -42,8 +60,8 @@ struct LocalLockNode {
   std::mutex w_lock;
 
   // hash conflict
-  std::atomic<Key*> unique_read_key;
-  std::atomic<Key*> unique_write_key;
+  std::atomic<TaggedKey*> unique_read_key;
+  std::atomic<TaggedKey*> unique_write_key;
   GlobalAddress unique_addr;
 
   // read delegation
@@ -57,12 +75,18 @@ struct LocalLockNode {
   std::mutex wc_lock;
   Value wc_buffer;
 
+  // rmw combining (protected by wc_lock)
+  RMWRequest *rmw_combiner;
+  RMWRequest *rmw_head;
+  RMWRequest *rmw_tail;
+
   // lock handover
   int handover_cnt;
 
   LocalLockNode() : read_current(0), read_ticket(0), read_handover(0), write_current(0), write_ticket(0), write_handover(0),
                     window_start(0), read_window(0), write_window(0),
-                    unique_read_key(0), unique_write_key(0), unique_addr(0), handover_cnt(0) {}
+                    unique_read_key(0), unique_write_key(0), unique_addr(0),
+                    rmw_combiner(nullptr), rmw_head(nullptr), rmw_tail(nullptr), handover_cnt(0) {}
 };
 
 
@@ -71,13 +95,18 @@ public:
   LocalLockTable() {}
 
   // read-delegation
-  std::pair<bool, bool> acquire_local_read_lock(const Key& k, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr);
-  void release_local_read_lock(const Key& k, std::pair<bool, bool> acquire_ret, bool& res, Value& ret_value);
+  std::pair<bool, bool> acquire_local_read_lock(const Key& k, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr, uint16_t tree_id = 0);
+  void release_local_read_lock(const Key& k, std::pair<bool, bool> acquire_ret, bool& res, Value& ret_value, uint16_t tree_id = 0);
 
   // write-combining
-  std::pair<bool, bool> acquire_local_write_lock(const Key& k, const Value& v, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr);
-  bool get_combining_value(const Key& k, Value& v);
-  void release_local_write_lock(const Key& k, std::pair<bool, bool> acquire_ret);
+  std::pair<bool, bool> acquire_local_write_lock(const Key& k, const Value& v, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr, uint16_t tree_id = 0);
+  bool get_combining_value(const Key& k, Value& v, uint16_t tree_id = 0);
+  void release_local_write_lock(const Key& k, std::pair<bool, bool> acquire_ret, uint16_t tree_id = 0);
+
+  // rmw-combining
+  std::pair<bool, bool> acquire_local_rmw_lock(const Key& k, RMWRequest* req, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr, uint16_t tree_id = 0);
+  void get_combining_rmws(const Key& k, std::vector<RMWRequest*>& reqs, uint16_t tree_id = 0);
+  void release_local_rmw_lock(const Key& k, std::pair<bool, bool> acquire_ret, uint16_t tree_id = 0);
 
   /* ---- baseline ---- */
   // lock-handover
@@ -87,8 +116,8 @@ public:
   void release_local_lock(const GlobalAddress& addr, RemoteFunc unlock_func, RemoteFunc write_without_unlock, RemoteFunc write_and_unlock);
 
   // cas-handover
-  bool acquire_local_lock(const Key& k, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr);
-  void release_local_lock(const Key& k, bool& res, InternalEntry& ret_p);
+  bool acquire_local_lock(const Key& k, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr, uint16_t tree_id = 0);
+  void release_local_lock(const Key& k, bool& res, InternalEntry& ret_p, uint16_t tree_id = 0);
 
   // write_testing
   bool acquire_local_write_lock(const GlobalAddress& addr, const Value& v, CoroQueue *waiting_queue = nullptr, CoroPull* sink = nullptr);
@@ -105,15 +134,15 @@ private:
 
 
 // read-delegation
-inline std::pair<bool, bool> LocalLockTable::acquire_local_read_lock(const Key& k, CoroQueue *waiting_queue, CoroPull* sink) {
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+inline std::pair<bool, bool> LocalLockTable::acquire_local_read_lock(const Key& k, CoroQueue *waiting_queue, CoroPull* sink, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
 
-  Key* unique_key = nullptr;
-  Key* new_key = new Key(k);
+  TaggedKey* unique_key = nullptr;
+  TaggedKey* new_key = new TaggedKey(tree_id, k);
   bool res = node.unique_read_key.compare_exchange_strong(unique_key, new_key);
   if (!res) {
     delete new_key;
-    if (*unique_key != k) {  // conflict keys
+    if (*unique_key != TaggedKey(tree_id, k)) {  // conflict keys
       return std::make_pair(false, true);
     }
   }
@@ -129,7 +158,7 @@ inline std::pair<bool, bool> LocalLockTable::acquire_local_read_lock(const Key&
     current = node.read_current.load(std::memory_order_relaxed);
   }
   unique_key = node.unique_read_key.load();
-  if (!unique_key || *unique_key != k) {  // conflict keys
+  if (!unique_key || *unique_key != TaggedKey(tree_id, k)) {  // conflict keys
     if (node.read_window) {
       -- node.read_window;
       if (!node.read_window && !node.write_window) {
@@ -147,10 +176,10 @@ inline std::pair<bool, bool> LocalLockTable::acquire_local_read_lock(const Key&
 }
 
 // read-delegation
-inline void LocalLockTable::release_local_read_lock(const Key& k, std::pair<bool, bool> acquire_ret, bool& res, Value& ret_value) {
+inline void LocalLockTable::release_local_read_lock(const Key& k, std::pair<bool, bool> acquire_ret, bool& res, Value& ret_value, uint16_t tree_id) {
   if (acquire_ret.second) return;
 
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
 
   if (!node.read_handover) {  // winner
     node.res = res;
@@ -195,15 +224,15 @@ inline void LocalLockTable::release_local_read_lock(const Key& k, std::pair<bool
 }
 
 // write-combining
-inline std::pair<bool, bool> LocalLockTable::acquire_local_write_lock(const Key& k, const Value& v, CoroQueue *waiting_queue, CoroPull* sink) {
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+inline std::pair<bool, bool> LocalLockTable::acquire_local_write_lock(const Key& k, const Value& v, CoroQueue *waiting_queue, CoroPull* sink, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
 
-  Key* unique_key = nullptr;
-  Key* new_key = new Key(k);
+  TaggedKey* unique_key = nullptr;
+  TaggedKey* new_key = new TaggedKey(tree_id, k);
   bool res = node.unique_write_key.compare_exchange_strong(unique_key, new_key);
   if (!res) {
     delete new_key;
-    if (*unique_key != k) {  // conflict keys
+    if (*unique_key != TaggedKey(tree_id, k)) {  // conflict keys
       return std::make_pair(false, true);
     }
   }
@@ -223,7 +252,7 @@ inline std::pair<bool, bool> LocalLockTable::acquire_local_write_lock(const Key&
     current = node.write_current.load(std::memory_order_relaxed);
   }
   unique_key = node.unique_write_key.load();
-  if (!unique_key || *unique_key != k) {  // conflict keys
+  if (!unique_key || *unique_key != TaggedKey(tree_id, k)) {  // conflict keys
     if (node.write_window) {
       -- node.write_window;
       if (!node.read_window && !node.write_window) {
@@ -241,11 +270,11 @@ inline std::pair<bool, bool> LocalLockTable::acquire_local_write_lock(const Key&
 }
 
 // write-combining
-inline bool LocalLockTable::get_combining_value(const Key& k, Value& v) {
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+inline bool LocalLockTable::get_combining_value(const Key& k, Value& v, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
   bool res = false;
-  Key* unique_key = node.unique_write_key.load();
-  if (unique_key && *unique_key == k) {  // wc
+  TaggedKey* unique_key = node.unique_write_key.load();
+  if (unique_key && *unique_key == TaggedKey(tree_id, k)) {  // wc
     node.wc_lock.lock();
     res = node.wc_buffer != v;
     v = node.wc_buffer;
@@ -255,10 +284,10 @@ inline bool LocalLockTable::get_combining_value(const Key& k, Value& v) {
 }
 
 // write-combining
-inline void LocalLockTable::release_local_write_lock(const Key& k, std::pair<bool, bool> acquire_ret) {
+inline void LocalLockTable::release_local_write_lock(const Key& k, std::pair<bool, bool> acquire_ret, uint16_t tree_id) {
   if (acquire_ret.second) return;
 
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
 
   uint8_t ticket = node.write_ticket.load(std::memory_order_relaxed);
   uint8_t current = node.write_current.load(std::memory_order_relaxed);
@@ -293,6 +322,56 @@ inline void LocalLockTable::release_local_write_lock(const Key& k, std::pair<boo
   return;
 }
 
+// rmw-combining
+inline std::pair<bool, bool> LocalLockTable::acquire_local_rmw_lock(const Key& k, RMWRequest* req, CoroQueue *waiting_queue, CoroPull* sink, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
+
+  node.wc_lock.lock();
+  if (node.rmw_combiner && node.rmw_combiner->k != TaggedKey(tree_id, k)) {  // conflict keys
+    node.wc_lock.unlock();
+    return std::make_pair(false, true);
+  }
+  if (!node.rmw_combiner) {  // winner
+    node.rmw_combiner = req;
+    req->combiner = true;
+  }
+  // enqueue
+  if (node.rmw_tail) node.rmw_tail->next = req;
+  else node.rmw_head = req;
+  node.rmw_tail = req;
+  node.wc_lock.unlock();
+
+  while (!req->done && !req->combiner) {  // wait to be combined or to become the combiner
+    if (sink != nullptr) {
+      waiting_queue->push(sink->get());
+      (*sink)();
+    }
+  }
+  return std::make_pair(req->done.load(), false);
+}
+
+// rmw-combining
+inline void LocalLockTable::get_combining_rmws(const Key& k, std::vector<RMWRequest*>& reqs, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
+
+  node.wc_lock.lock();
+  for (auto req = node.rmw_head; req; req = req->next) reqs.emplace_back(req);
+  node.rmw_head = node.rmw_tail = nullptr;
+  node.wc_lock.unlock();
+}
+
+// rmw-combining
+inline void LocalLockTable::release_local_rmw_lock(const Key& k, std::pair<bool, bool> acquire_ret, uint16_t tree_id) {
+  if (acquire_ret.first || acquire_ret.second) return;
+
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
+
+  node.wc_lock.lock();
+  node.rmw_combiner = node.rmw_head;  // hand over to the first pending rmw
+  if (node.rmw_combiner) node.rmw_combiner->combiner = true;
+  node.wc_lock.unlock();
+}
+
 // lock-handover
 inline bool LocalLockTable::acquire_local_lock(const GlobalAddress& addr, CoroQueue *waiting_queue, CoroPull* sink) {
   auto &node = local_locks[get_hashed_local_lock_index(addr)];
@@ -381,8 +460,8 @@ inline void LocalLockTable::release_local_lock(const GlobalAddress& addr, Remote
 }
 
 // cas-handover
-inline bool LocalLockTable::acquire_local_lock(const Key& k, CoroQueue *waiting_queue, CoroPull* sink) {
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+inline bool LocalLockTable::acquire_local_lock(const Key& k, CoroQueue *waiting_queue, CoroPull* sink, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
 
   uint8_t ticket = node.write_ticket.fetch_add(1);
   uint8_t current = node.write_current.load(std::memory_order_relaxed);
@@ -397,22 +476,22 @@ inline bool LocalLockTable::acquire_local_lock(const Key& k, CoroQueue *waiting_
 
   if (!node.write_handover) {  // winner
     auto old_key = node.unique_write_key.load(std::memory_order_relaxed);
-    node.unique_write_key = new Key(k);
+    node.unique_write_key = new TaggedKey(tree_id, k);
     if(old_key) delete old_key;
   }
   // if (*node.unique_write_key == k) {
   //   node.handover_cnt ++;
   // }
   auto unique_key = node.unique_write_key.load(std::memory_order_relaxed);
-  return node.write_handover && (unique_key && *unique_key == k);  // only if updating at the same k can this update handover
+  return node.write_handover && (unique_key && *unique_key == TaggedKey(tree_id, k));  // only if updating at the same k can this update handover
 }
 
 // cas-handover
-inline void LocalLockTable::release_local_lock(const Key& k, bool& res, InternalEntry& ret_p) {
-  auto &node = local_locks[get_hashed_local_lock_index(k)];
+inline void LocalLockTable::release_local_lock(const Key& k, bool& res, InternalEntry& ret_p, uint16_t tree_id) {
+  auto &node = local_locks[get_hashed_local_lock_index(k, tree_id)];
 
   auto unique_key = node.unique_write_key.load(std::memory_order_relaxed);
-  if (unique_key && *unique_key == k) {
+  if (unique_key && *unique_key == TaggedKey(tree_id, k)) {
     if (!node.write_handover) {  // winner
       node.res = res;
       node.ret_p = ret_p;
@@ -113,32 +113,108 @@ static_assert(sizeof(VALOCK) == sizeof(uint64_t));
 #ifdef ENABLE_VAR_LEN_KV
 class DataPointer {
 public:
-  uint64_t    data_len : 64 - define::packedGaddrBit;
+  // The version wraps every 2^kVersionBit (16) updates of an inline key. A stale reader is thus fooled only if it stalls past
+  // the grace period of the retired blocks and its block is meanwhile reused for the same inline key by a multiple of 16 updates.
+  static constexpr uint32_t kVersionBit = 64 - define::packedGaddrBit - define::dataBlockLenBit - 1;
+  static_assert(kVersionBit >= 4);
+
+  uint64_t    data_len : define::dataBlockLenBit;
+  uint64_t    version  : kVersionBit;  // stamped on the block, see DataBlock::is_stamped
+  uint64_t    chained  : 1;  // the block is followed by more blocks of the same inline key
   PackedGAddr ptr;
 
-  DataPointer(const uint64_t data_len, const GlobalAddress& ptr) : data_len(data_len), ptr(ptr) {}
+  DataPointer(const uint64_t data_len, const GlobalAddress& ptr, uint32_t version, bool chained = false) : data_len(data_len), version(version), chained(chained), ptr(ptr) {}
 
-  operator uint64_t() const { return ((uint64_t)ptr << 16) | data_len; }
+  operator uint64_t() const { return ((uint64_t)ptr << 16) | ((uint64_t)chained << 15) | ((uint64_t)version << define::dataBlockLenBit) | data_len; }
   operator std::pair<uint64_t, GlobalAddress>() const { return std::make_pair(data_len, (GlobalAddress)ptr); }
 } __attribute__((packed));
 
 static_assert(sizeof(DataPointer) == 8);
 
 
-class DataBlock {  // For brievity, we assume the whole key can be stored inline, and only changing the value size for evaluation
+/* Data Record: [key_len, value_len, value, rest_of_key]; the value can be read without the rest of the key */
+class DataRecord {
 public:
-  uint64_t rest_of_key_len = 0;
-  uint64_t value_len;
-  // Key rest_of_key;
+  uint32_t key_len;  // of the whole key, whose first define::keyLen bytes are the inline key
+  uint32_t value_len;
   union {
   Value value;
   uint8_t _padding[define::indirectValLen];
   };
 
-  DataBlock(const Value value) : rest_of_key_len(0), value_len(define::indirectValLen), value(value) {}
+  // NOTE: the rest of the key is placed right after the object; a null full_key stands for the inline key itself
+  DataRecord(const std::string* full_key, const Value value)
+      : key_len(full_key ? full_key->size() : define::keyLen), value_len(define::indirectValLen), value(value) {
+    assert(key_len <= define::maxKeyLen);
+    if (full_key) memcpy(rest_of_key(), full_key->data() + key_len - rest_of_key_len(), rest_of_key_len());
+  }
+
+  uint32_t rest_of_key_len() const { return key_len > define::keyLen ? key_len - define::keyLen : 0; }
+  uint8_t* rest_of_key() { return (uint8_t *)this + sizeof(DataRecord); }
+  const uint8_t* rest_of_key() const { return (const uint8_t *)this + sizeof(DataRecord); }
+  uint64_t size() const { return sizeof(DataRecord) + rest_of_key_len(); }
+
+  std::string get_key(const Key& k) const {  // k is the inline key
+    std::string full_key((const char *)k.data(), std::min(key_len, define::keyLen));
+    return full_key.append((const char *)rest_of_key(), rest_of_key_len());
+  }
+  bool is_key_of(const std::string* full_key) const {  // the inline part is compared by the leaf
+    if (!full_key) return key_len == define::keyLen;
+    return key_len == full_key->size() && !memcmp(rest_of_key(), full_key->data() + key_len - rest_of_key_len(), rest_of_key_len());
+  }
+} __attribute__((packed));
+
+
+/*
+  Data Block: [next, key, record_num, version, [record] * record_num]
+  The string keys sharing an inline key (see str2key) colocate their records in key order, in a chain of blocks once
+  define::dataBlockMaxLen bytes are filled; a block is written out-of-place as a whole, so the readers need no lock.
+  A superseded block is reused after a grace period, so a lock-free reader that is still holding its DataPointer checks
+  the stamp of the block (i.e., the inline key and the version of the DataPointer) and reads the leaf again on a mismatch.
+*/
+class DataBlock {
+public:
+  uint64_t next = define::kValueNull;  // the DataPointer of the next block in the chain
+  Key key;  // the inline key of the records
+  uint32_t record_num = 0;
+  uint32_t version;  // of the DataPointers to the block
+
+  DataBlock(const Key& key, uint32_t version) : key(key), version(version) {}
+
+  bool is_stamped(const Key& k, Value data_ptr) const { return key == k && version == ((const DataPointer *)&data_ptr)->version; }
+  static uint32_t next_version(Value old_data_ptr) {  // of a block superseding the one of old_data_ptr
+    if (old_data_ptr == define::kValueNull) return 0;
+    return (((const DataPointer *)&old_data_ptr)->version + 1) & ((1u << DataPointer::kVersionBit) - 1);
+  }
+
+  DataRecord* first_record() { return (DataRecord *)((char *)this + sizeof(DataBlock)); }
+  const DataRecord* first_record() const { return (const DataRecord *)((const char *)this + sizeof(DataBlock)); }
+  static const DataRecord* next_record(const DataRecord* r) { return (const DataRecord *)((const char *)r + r->size()); }
+
+  uint64_t size() const {
+    auto r = first_record();
+    for (uint32_t i = 0; i < record_num; ++ i) r = next_record(r);
+    return (const char *)r - (const char *)this;
+  }
+  static uint64_t record_size(const std::string* full_key) {
+    return sizeof(DataRecord) + (full_key && full_key->size() > define::keyLen ? full_key->size() - define::keyLen : 0);
+  }
+  // NOTE: the buffer should hold define::bufferBlockSize bytes
+  bool append(const std::string* full_key, const Value value) {  // return false if the block is full
+    auto len = size();
+    if (record_num && len + record_size(full_key) > define::dataBlockMaxLen) return false;
+    new ((char *)this + len) DataRecord(full_key, value);
+    ++ record_num;
+    return true;
+  }
+  const DataRecord* find(const std::string* full_key) const {
+    auto r = first_record();
+    for (uint32_t i = 0; i < record_num; ++ i, r = next_record(r)) if (r->is_key_of(full_key)) return r;
+    return nullptr;
+  }
 } __attribute__((packed));
 
-static_assert(sizeof(DataBlock) == define::dataBlockLen);
+static_assert(sizeof(DataBlock) + sizeof(DataRecord) == define::dataBlockLen);
 #endif
 
 
@@ -29,9 +29,9 @@ inline void MetadataManager::decode_node_metadata(char *input_buffer, char *outp
   // copy lock and leaf metadata
   const auto& first_group = scatter_leaf->record_groups[0];
 #ifdef SIBLING_BASED_VALIDATION
-  leaf->metadata = LeafMetadata(first_group.metadata.h_version, 0U, first_group.metadata.valid, first_group.metadata.sibling_ptr, FenceKeys{});
+  leaf->metadata = LeafMetadata(first_group.metadata.h_version, 0U, first_group.metadata.valid, first_group.metadata.neighbor_size, first_group.metadata.incarnation, first_group.metadata.sibling_ptr, FenceKeys{});
 #else
-  leaf->metadata = LeafMetadata(first_group.metadata.h_version, 0U, first_group.metadata.valid, first_group.metadata.sibling_ptr, first_group.metadata.fence_keys);
+  leaf->metadata = LeafMetadata(first_group.metadata.h_version, 0U, first_group.metadata.valid, first_group.metadata.neighbor_size, first_group.metadata.incarnation, first_group.metadata.sibling_ptr, first_group.metadata.fence_keys);
 #endif
   int i = 0;
   for (const auto& group : scatter_leaf->record_groups) {
@@ -75,9 +75,9 @@ inline bool MetadataManager::decode_segment_metadata(char *input_buffer, char *o
     memcpy(output_buffer + j, input_buffer + i, std::min((size_t)define::groupSize, segment_len - j));
   }
 #ifdef SIBLING_BASED_VALIDATION
-  metadata = LeafMetadata(scattered_metadata->h_version, 0U, scattered_metadata->valid, scattered_metadata->sibling_ptr, FenceKeys{});
+  metadata = LeafMetadata(scattered_metadata->h_version, 0U, scattered_metadata->valid, scattered_metadata->neighbor_size, scattered_metadata->incarnation, scattered_metadata->sibling_ptr, FenceKeys{});
 #else
-  metadata = LeafMetadata(scattered_metadata->h_version, 0U, scattered_metadata->valid, scattered_metadata->sibling_ptr, scattered_metadata->fence_keys);
+  metadata = LeafMetadata(scattered_metadata->h_version, 0U, scattered_metadata->valid, scattered_metadata->neighbor_size, scattered_metadata->incarnation, scattered_metadata->sibling_ptr, scattered_metadata->fence_keys);
 #endif
   return true;
 }
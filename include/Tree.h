@@ -6,6 +6,7 @@
 #include "DSM.h"
 #include "Common.h"
 #include "LocalLockTable.h"
+#include "BlockAllocator.h"
 #include "MetadataManager.h"
 #include "LeafVersionManager.h"
 #include "VersionManager.h"
@@ -14,10 +15,13 @@
 #include <city.h>
 #include <functional>
 #include <map>
+#include <vector>
 #include <algorithm>
 #include <queue>
 #include <set>
 #include <iostream>
+#include <limits>
+#include <mutex>
 
 
 /* Workloads */
@@ -25,7 +29,8 @@ enum RequestType : int {
   INSERT = 0,
   UPDATE,
   SEARCH,
-  SCAN
+  SCAN,
+  DELETE
 };
 
 struct Request {
@@ -33,6 +38,7 @@ struct Request {
   Key k;
   Value v;
   int range_size;
+  std::string str_k;  // the string key (k is its inline key), empty for int keys
 };
 
 class RequstGen {
@@ -42,6 +48,25 @@ public:
 };
 
 
+/* Scan Aggregation */
+class Aggregator {
+public:
+  uint64_t count  = 0;
+  Value sum       = 0;
+  Value min_value = std::numeric_limits<Value>::max();
+  Value max_value = std::numeric_limits<Value>::min();
+
+  Aggregator() = default;
+  virtual ~Aggregator() = default;
+  virtual void add(const Key &k, Value v) {  // called once per record, in leaf order
+    ++ count;
+    sum += v;
+    min_value = std::min(min_value, v);
+    max_value = std::max(max_value, v);
+  }
+};
+
+
 /* Tree */
 using GenFunc = std::function<RequstGen *(DSM*, Request*, int, int, int)>;
 #define MAX_FLAG_NUM 4
@@ -67,24 +92,117 @@ public:
 static_assert(sizeof(RootEntry) == 8);
 
 
+/* Head of the retired leaves of a tree, shared by all compute nodes; the links are kept in the emptied leaves */
+class RetiredLeafHead {
+public:
+  union {
+  struct {
+  uint64_t tag    : 16;  // bumped by every push and pop, against ABA
+  uint64_t nodeID : define::mnIdBit;
+  uint64_t offset : 40;  // the leaves are not aligned for PackedGAddr
+  };
+  uint64_t val;
+  };
+
+  RetiredLeafHead(uint64_t val) : val(val) {}
+  RetiredLeafHead(const uint16_t tag, const GlobalAddress& ptr) : tag(tag), nodeID(ptr.nodeID), offset(ptr.offset) {}
+
+  GlobalAddress ptr() const { return GlobalAddress(nodeID, offset); }
+  operator uint64_t() const { return val; }
+} __attribute__((packed));
+
+static_assert(sizeof(RetiredLeafHead) == 8);
+
+
 class Tree {
 public:
-  Tree(DSM *dsm, uint16_t tree_id = 0, bool init_root = true);
+  // neighbor_size (<= define::neighborSize) bounds the hopping distance in the leaves, and must be the same on all compute nodes for a tree;
+  // it is the only per-tree layout knob, i.e., the leaf span (define::leafSpanSize) and the internal span are fixed per build
+  // inline_value: with ENABLE_VAR_LEN_KV, keep the values (a Value, or up to define::inlineValMaxLen value bytes) in the leaves instead of DataBlocks
+  Tree(DSM *dsm, uint16_t tree_id = 0, bool init_root = true, int neighbor_size = define::neighborSize, bool inline_value = false);
+  Tree(DSM *dsm, uint16_t tree_id, TreeCache *tree_cache, IdxCache *idx_cache, LocalLockTable *local_lock_table, BlockAllocator *block_allocator,
+       int neighbor_size = define::neighborSize, bool inline_value = false);  // shares the caches and the lock table, see TreeCatalog
 
   using WorkFunc = std::function<void (Tree *, const Request&, CoroPull *)>;
   void run_coroutine(GenFunc gen_func, WorkFunc work_func, int coro_cnt, Request* req = nullptr, int req_num = 0);
 
   void insert(const Key &k, Value v, CoroPull* sink = nullptr);   // NOTE: insert can also do update things if key exists
-  void update(const Key &k, Value v, CoroPull* sink = nullptr);   // assert(false) if key is not found
+  void update(const Key &k, Value v, CoroPull* sink = nullptr);   // do nothing if key is not found
+  using RMWFunc = std::function<Value (Value)>;
+  Value rmw(const Key &k, const RMWFunc& func, CoroPull* sink = nullptr);  // return the old value, or kValueNull if key is not found; a kValueNull result of func is not written
+  Value fetch_add(const Key &k, Value delta, CoroPull* sink = nullptr);    // return the old value; a sum of kValueNull is not written
+  bool compare_and_swap(const Key &k, Value expected, Value desired, CoroPull* sink = nullptr);  // return false if the value != expected or desired is kValueNull
+  void multi_insert(const std::vector<Key> &keys, const std::vector<Value> &values, CoroPull* sink = nullptr);
+  void multi_update(const std::vector<Key> &keys, const std::vector<Value> &values, CoroPull* sink = nullptr);
   bool search(const Key &k, Value &v, CoroPull* sink = nullptr);  // return false if key is not found
-  bool range_query(const Key &from, const Key &to, std::map<Key, Value> &ret);
+  void multi_search(const std::vector<Key> &keys, std::vector<Value> &values, CoroPull* sink = nullptr);  // kValueNull for the keys not found
+  void remove(const Key &k, CoroPull* sink = nullptr);            // no-op if key is not found
+#ifdef ENABLE_VAR_LEN_KV
+  // string keys: a key is indexed by its inline key (see str2key), and the keys sharing one colocate their records in its DataBlocks;
+  // the Key API above addresses an inline key as a whole, i.e., its writes replace all the records and its reads return the first one
+  void insert(const std::string &k, Value v, CoroPull* sink = nullptr);
+  void update(const std::string &k, Value v, CoroPull* sink = nullptr);
+  bool search(const std::string &k, Value &v, CoroPull* sink = nullptr);
+  void remove(const std::string &k, CoroPull* sink = nullptr);
+  // value bytes (up to define::inlineValMaxLen) of a tree opened with inline_value, read in the same round trip as the key;
+  // the Value API addresses the raw value field, so a tree keeps either kind of values
+  void insert(const Key &k, const ValueBytes &v, CoroPull* sink = nullptr);
+  void update(const Key &k, const ValueBytes &v, CoroPull* sink = nullptr);
+  bool search(const Key &k, ValueBytes &v, CoroPull* sink = nullptr);
+  bool range_query(const Key &from, const Key &to, std::vector<std::pair<Key, ValueBytes> > &ret, CoroPull* sink = nullptr);  // append to ret, in leaf order
+#endif
+  bool range_query(const Key &from, const Key &to, std::map<Key, Value> &ret, CoroPull* sink = nullptr);
+  using RangeFunc = std::function<void (const Key&, Value)>;
+  using RangeBytesFunc = std::function<void (const Key&, const ValueBytes&)>;
+  bool range_query(const Key &from, const Key &to, const RangeFunc& func, CoroPull* sink = nullptr);  // func is called once per record, in leaf order
+  bool range_query(const Key &from, const Key &to, std::vector<std::pair<Key, Value> > &ret, bool sorted = false, CoroPull* sink = nullptr);  // append to ret
+  void scan_aggregate(const Key &from, const Key &to, Aggregator &agg, CoroPull* sink = nullptr);
+  using ScanPredicate = std::function<bool (const Key&, Value)>;
+  void scan_filter(const Key &from, const Key &to, const ScanPredicate& pred, uint64_t limit,
+                   std::vector<std::pair<Key, Value> > &ret, CoroPull* sink = nullptr);  // append the first `limit` matched records in key order
+  void reverse_range_query(const Key &from, const Key &to, uint64_t limit,
+                           std::vector<std::pair<Key, Value> > &ret, CoroPull* sink = nullptr);  // append the last `limit` records in descending key order
+  using KVIter = std::vector<std::pair<Key, Value> >::const_iterator;
+  bool bulk_load(KVIter begin, KVIter end, double fill_factor = define::bulkLoadFillFactor, CoroPull* sink = nullptr);  // sorted unique kvs; return false if the tree is not empty
+
+  // count-based forward scan following leaf sibling pointers; the leaves after the current ones are read asynchronously,
+  // so the coroutine must not issue other RDMA operations between next() calls until the scanner is re-seeked or destroyed
+  class Scanner {
+  public:
+    Scanner(Tree *tree, CoroPull* sink = nullptr, int prefetch_num = define::scanPrefetchLeafNum);
+    ~Scanner();
+
+    void seek(const Key &k, uint64_t limit = std::numeric_limits<uint64_t>::max());  // position at the first key >= k
+    bool next(Key &k, Value &v);  // return false if no more records or the limit is reached
+
+  private:
+    void post_prefetch();
+    void wait_prefetch();
+    void fetch_leaves();
+    void resolve_values();
+
+    Tree *tree;
+    CoroPull *sink;
+    int prefetch_num;
+    uint64_t limit;
+    uint64_t returned_cnt;
+    Key fetch_from;               // keys below have been fetched
+    GlobalAddress next_leaf_addr; // Null if the rightmost leaf is fetched
+    std::vector<GlobalAddress> prefetch_addrs;  // leaves read into the range buffer, starting from next_leaf_addr
+    int prefetch_posted_cnt;      // batches in flight
+    std::vector<std::pair<Key, Value> > records;  // sorted kvs of the fetched leaves
+    int cur;
+    int resolved_cnt;             // records whose values are read from DataBlocks
+  };
 
   void statistics();
   void clear_debug_info();
 
 private:
   // common
+  static bool is_indirect_value(bool inline_value);
   void before_operation(CoroPull* sink);
+  void init_root_leaf();
   GlobalAddress get_root_ptr_ptr();
   RootEntry get_root_ptr(CoroPull* sink);
 
@@ -98,41 +216,106 @@ private:
   void unlock_node(const GlobalAddress &node_addr, uint64_t* lock_buffer, bool is_leaf, CoroPull* sink, bool async = false);
 
   // search
-  bool leaf_node_search(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value &v, bool from_cache, CoroPull* sink);
+  bool search(const Key &k, const std::string* full_key, Value &v, CoroPull* sink, ValueBytes* val_bytes = nullptr);  // full_key is only checked with ENABLE_VAR_LEN_KV
+  GlobalAddress locate_leaf(const Key &k, CoroPull* sink, const GlobalAddress& invalid_leaf = GlobalAddress::Null());
+  bool leaf_node_search(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value &v, const TreeCacheEntry *cache_entry, CoroPull* sink,
+                        ValueBytes* val_bytes = nullptr);
   bool internal_node_search(GlobalAddress& node_addr, GlobalAddress& sibling_addr, const Key &k, uint16_t& level, bool from_cache, CoroPull* sink);
 
   // insert
-  bool leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v, bool from_cache, CoroPull* sink);
+  void insert(const Key &k, const std::string* full_key, Value v, CoroPull* sink, const ValueBytes* val_bytes = nullptr);  // v is ignored if val_bytes
+  bool leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v, bool from_cache, CoroPull* sink,
+                        const std::string* full_key = nullptr, const ValueBytes* val_bytes = nullptr);
   bool internal_node_insert(const GlobalAddress& node_addr, const Key &k, const GlobalAddress &v, bool from_cache, uint8_t level, CoroPull* sink);
 
   // update
-  bool leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v, bool from_cache, CoroPull* sink);
+  void update(const Key &k, const std::string* full_key, Value v, CoroPull* sink, const ValueBytes* val_bytes = nullptr);  // v is ignored if val_bytes
+  void update_traverse(const Key &k, Value v, const RMWFunc& func, CoroPull* sink, const std::string* full_key = nullptr, const ValueBytes* val_bytes = nullptr);
+  bool range_scan(const Key &from, const Key &to, const RangeFunc& func, const Key &cutoff, bool reverse, CoroPull* sink,
+                  const RangeBytesFunc* bytes_func = nullptr);  // func may move cutoff to skip the rest of [from, to); bytes_func replaces func if set
+  bool leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v, bool from_cache, CoroPull* sink,
+                        const RMWFunc& func = nullptr, const std::string* full_key = nullptr, const ValueBytes* val_bytes = nullptr);
+
+  // multi-write
+  void multi_write(const std::vector<Key> &keys, const std::vector<Value> &values, bool is_insert, CoroPull* sink);
+#ifdef HOPSCOTCH_LEAF_NODE
+  bool leaf_node_multi_write(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const std::vector<Key> &keys, const std::vector<Value> &values,
+                             const std::vector<int>& key_ids, bool is_insert, std::vector<int>& fallback_ids, CoroPull* sink);
+#endif
+
+  // remove
+  void remove(const Key &k, const std::string* full_key, CoroPull* sink);
+  bool leaf_node_remove(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, bool from_cache, CoroPull* sink,
+                        const std::string* full_key = nullptr);
+  bool leaf_entry_remove_and_unlock(LeafNode* leaf, const Key& k, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                    const std::string* full_key = nullptr);
+
+  // merge
+  void leaf_node_merge(const GlobalAddress& node_addr, const Key& k, CoroPull* sink);
+  void reclaim_leaf_and_unlock(LeafNode* leaf, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink);
+  GlobalAddress alloc_leaf(CoroPull* sink);
+  GlobalAddress get_retired_leaf_head_ptr();
+  int count_live_entries(const GlobalAddress& node_addr, CoroPull* sink);
 
   // hopscotch
 #ifdef HOPSCOTCH_LEAF_NODE
-  bool hopscotch_insert_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, int entry_num=define::leafSpanSize);
-  void hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink);
-  void hopscotch_search(const GlobalAddress& node_addr, int hash_idx, char *raw_leaf_buffer, char *leaf_buffer, CoroPull* sink, int entry_num=define::neighborSize, bool for_write=false);
+  // val_bytes (if any) fill the value field of the inserted k
+  bool hopscotch_insert_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, int entry_num, int leaf_neighbor_size,
+                                   const ValueBytes* val_bytes = nullptr);
+  void hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, const ValueBytes* val_bytes = nullptr);
+  void hopscotch_search(const GlobalAddress& node_addr, int hash_idx, char *raw_leaf_buffer, char *leaf_buffer, CoroPull* sink, int entry_num, bool for_write=false);
+  static int cover_scattered_metadata(int l_idx, int entry_num);
+
+  int hopscotch_insert_locally(LeafEntry* records, const Key& k, Value v, int leaf_neighbor_size = 0);  // return -1 if fails; 0 means the neighborhood size of the tree
+  bool hopscotch_rehash_locally(LeafEntry* records);  // repack the entries near their home buckets; records are garbage if fails
+  bool hopscotch_rehash_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                   const ValueBytes* val_bytes = nullptr);  // return false(remain locked) if need split
+  bool hopscotch_widen_locally(const LeafNode* leaf, LeafNode* widened, const Key& k, Value v,
+                               const ValueBytes* val_bytes = nullptr);  // insert k into a copy of the leaf with the least wider neighborhood
+  bool hopscotch_widen_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                  const ValueBytes* val_bytes = nullptr);  // return false(remain locked) if need split
+  // per-leaf neighborhood size
+  int get_leaf_neighbor_size(const LeafNode* leaf) const;
+  void fit_leaf_neighbor_size(LeafNode* leaf) const;  // shrink to the farthest hop of the leaf
+  int get_neighbor_hint(const TreeCacheEntry *cache_entry, const Key& k, const GlobalAddress& leaf_addr) const;
+  void set_neighbor_hint(const TreeCacheEntry *cache_entry, const Key& k, const GlobalAddress& leaf_addr, int leaf_neighbor_size);
+#endif
 
-  Key hopscotch_get_split_key(LeafEntry* records, const Key& k);
-  int hopscotch_insert_locally(LeafEntry* records, const Key& k, Value v);
+  // out-of-line data
+#ifdef ENABLE_VAR_LEN_KV
+  using DataRecords = std::vector<std::pair<std::string, Value> >;  // [full key, value] of the keys sharing an inline key, in key order
+  Value write_data_block(const DataBlock* data_block, CoroPull* sink, bool chained = false);  // return the DataPointer value
+  Value write_data_chain(const Key& k, uint32_t version, const DataRecords& records, CoroPull* sink);  // return kValueNull if there is no record
+  void read_data_chain(Value v, const Key& k, DataRecords* records, std::vector<Value>& blocks, CoroPull* sink);  // records are skipped if null
+  Value write_data_records(const Key& k, const std::string* full_key, Value v, Value old_v, std::vector<Value>& old_blocks, CoroPull* sink);
+  bool search_data_chain(Value v, const Key& k, const std::string* full_key, Value& ret, CoroPull* sink);  // return false if a block is reused
+  void retire_data_block(Value v);  // the DataBlock is superseded
+  void retire_data_chain(Value v, CoroPull* sink);  // all the blocks of the inline key are superseded
 #endif
 
   // speculative read
 #ifdef SPECULATIVE_READ
-  bool speculative_read(const GlobalAddress& leaf_addr, std::pair<int, int> range, char *raw_leaf_buffer, char *leaf_buffer, const Key &k, Value &v, int& speculative_idx, CoroPull* sink, bool for_write=false);
+  bool speculative_read(const GlobalAddress& leaf_addr, std::pair<int, int> range, char *raw_leaf_buffer, char *leaf_buffer, const Key &k, Value &v, int& speculative_idx, CoroPull* sink, bool for_write=false,
+                        ValueBytes* val_bytes = nullptr);
 #endif
 
   // lower-level function
   void leaf_entry_read(const GlobalAddress& leaf_addr, const int idx, char *raw_leaf_buffer, char *leaf_buffer, CoroPull* sink, bool for_write=false);
+  bool leaf_node_decode(char *raw_leaf_buffer, LeafNode *leaf, CoroPull* sink);
+  void internal_nodes_fetch(const Key &from, const Key &to, std::vector<InternalNode> &nodes, CoroPull* sink, int max_node_num=0, bool reverse=false);
   template <class NODE, class ENTRY, class VAL>
   void entry_write_and_unlock(NODE* node, const int idx, const Key& k, VAL v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, bool async=false);
+  void leaf_write_and_unlock(LeafNode* leaf, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink);  // also refresh the in-lock metadata
   template <class NODE, class ENTRY, int TRANS_SIZE>
   void node_write_and_unlock(NODE* node, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, bool async=false);
   void segment_write_and_unlock(LeafNode* leaf, int l_idx, int r_idx, const std::vector<int>& hopped_idxes, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink);
+#ifdef HOPSCOTCH_LEAF_NODE
+  void segments_write_and_unlock(LeafNode* leaf, const std::vector<int>& dirty_idxes, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink);
+#endif
 
   template <class NODE, class ENTRY, class VAL, int SPAN_SIZE, int ALLOC_SIZE, int TRANS_SIZE>
-  void node_split_and_unlock(NODE* node, const Key& k, VAL v, const GlobalAddress& node_addr, uint64_t* lock_buffer, uint8_t level, CoroPull* sink);
+  void node_split_and_unlock(NODE* node, const Key& k, VAL v, const GlobalAddress& node_addr, uint64_t* lock_buffer, uint8_t level, CoroPull* sink,
+                             const ValueBytes* val_bytes = nullptr);  // val_bytes only for leaves
   void insert_internal(const Key &k, const GlobalAddress& ptr, const RootEntry& root_entry, uint8_t target_level, CoroPull* sink);
 
   void coro_worker(CoroPull &sink, RequstGen *gen, WorkFunc work_func);
@@ -142,8 +325,13 @@ private:
   TreeCache *tree_cache;
 #ifdef SPECULATIVE_READ
   IdxCache *idx_cache;
+#endif
+#ifdef ENABLE_VAR_LEN_KV
+  BlockAllocator *block_allocator;
 #endif
   uint64_t tree_id;
+  const int neighbor_size;
+  const bool indirect_value;  // values are stored in DataBlocks
   std::atomic<uint16_t> rough_height;
   GlobalAddress root_ptr_ptr;  // the address which stores root pointer;
 
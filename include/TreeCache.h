@@ -2,6 +2,7 @@
 #define _TREE_CACHE_H_
 
 #include "TreeCacheEntry.h"
+#include "TreeCacheModel.h"
 #include "HugePageAlloc.h"
 #include "Timer.h"
 #include "third_party/inlineskiplist.h"
@@ -10,7 +11,9 @@
 #include <tbb/concurrent_queue.h>
 #include <queue>
 #include <atomic>
+#include <mutex>
 #include <vector>
+#include <random>
 
 
 using TreeCacheSkipList = InlineSkipList<TreeCacheEntryComparator>;
@@ -19,30 +22,45 @@ class TreeCache {
 
 public:
   TreeCache(int cache_size, DSM* dsm);
+  ~TreeCache();
 
-  bool add_to_cache(InternalNode *page);
-  const TreeCacheEntry *search_from_cache(const Key &k, GlobalAddress& addr, GlobalAddress& sibling_addr, uint16_t& level);
-  const TreeCacheEntry *search_ptr_from_cache(const Key &k, GlobalAddress& addr, const uint16_t& level);
-  void search_range_from_cache(const Key &from, const Key &to, std::vector<InternalNode> &result);
+  bool add_to_cache(InternalNode *page, uint16_t tree_id = 0);
+  const TreeCacheEntry *search_from_cache(const Key &k, GlobalAddress& addr, GlobalAddress& sibling_addr, uint16_t& level, uint16_t tree_id = 0);
+  const TreeCacheEntry *search_ptr_from_cache(const Key &k, GlobalAddress& addr, const uint16_t& level, uint16_t tree_id = 0);
+  void search_range_from_cache(const Key &from, const Key &to, std::vector<InternalNode> &result, uint16_t tree_id = 0);
+  void search_leaves_from_cache(const Key &k, int leaf_num, std::vector<GlobalAddress> &leaf_addrs, uint16_t tree_id = 0);
   bool invalidate(const TreeCacheEntry *entry);
+#ifdef HOPSCOTCH_LEAF_NODE
+  uint8_t *search_neighbor_size(const TreeCacheEntry *entry, const Key &k, const GlobalAddress& leaf_addr);  // nullptr if the entry no longer points to the leaf
+#endif
   void statistics();
 
 private:
-  void evict_one();
+  bool evict_one();  // return false if nothing is cached
   void evict();
 
-  bool add_entry(const Key &from, const Key &to, InternalNode *ptr);
-  const TreeCacheEntry *find_entry(const Key &k);
-  const TreeCacheEntry *find_entry(const Key &from, const Key &to);
-  const TreeCacheEntry *seek_entry(const Key &k);  // try to return an non-nullptr cache_entry
-  const TreeCacheEntry *seek_entry(const Key &from, const Key &to);
+  bool add_entry(const Key &from, const Key &to, CachedInternalNode *ptr, uint16_t tree_id);
+  const TreeCacheEntry *find_entry(const Key &k, uint16_t tree_id);
+  const TreeCacheEntry *find_entry(const Key &from, const Key &to, uint16_t tree_id);
+  const TreeCacheEntry *seek_entry(const Key &k, uint16_t tree_id);  // try to return an non-nullptr cache_entry
+  const TreeCacheEntry *seek_entry(const Key &from, const Key &to, uint16_t tree_id);
+  const TreeCacheEntry *locate_entry(const Key &k, uint16_t tree_id);  // the lowest cached node surrounding k
   const TreeCacheEntry *get_a_random_entry(uint64_t &freq);
-  void safely_delete(InternalNode* cached_node);
+  void safely_delete(CachedInternalNode* cached_node);
+
+#ifdef CACHE_LEARNED_INDEX
+  // learned index over the level-1 nodes
+  void model_add(const TreeCacheEntry *entry);
+  void model_remove(const TreeCacheEntry *entry);
+  const TreeCacheEntry *model_find_entry(const Key &k, uint16_t tree_id);
+#endif
 
 private:
   uint64_t cache_size; // MB;
   std::atomic<int64_t> free_size;
   std::atomic<int64_t> skiplist_node_cnt;
+  std::atomic<uint16_t> max_tree_id;
+  std::atomic<int64_t> *tree_entry_cnt;  // cached nodes of each tree, which weight the eviction sampling
   DSM *dsm;
 
   // SkipList
@@ -51,21 +69,47 @@ private:
   Allocator alloc;
 
   // GC
-  tbb::concurrent_queue<InternalNode*> cached_node_gc;
+  tbb::concurrent_queue<CachedInternalNode*> cached_node_gc;
   static const int safely_free_epoch = 20 * MAX_APP_THREAD * MAX_CORO_NUM;
+
+#ifdef CACHE_LEARNED_INDEX
+  std::atomic<TreeCacheModel *> models[define::kCacheModelTreeNum];
+  std::mutex model_lock;  // serializes the refits
+  std::queue<std::pair<uint64_t, TreeCacheModel *> > retired_models;  // freed after kNodeReclaimDelay, when no lookup can still hold them
+#endif
 };
 
 inline TreeCache::TreeCache(int cache_size, DSM* dsm) : cache_size(cache_size), dsm(dsm) {
   skiplist = new TreeCacheSkipList(cmp, &alloc, 21);  // 21 [TUNE]
   free_size.store(define::MB * cache_size);
   skiplist_node_cnt.store(0);
+  max_tree_id.store(0);
+  tree_entry_cnt = new std::atomic<int64_t>[define::kMaxTreeNum]();
+#ifdef CACHE_LEARNED_INDEX
+  for (auto& m : models) m.store(nullptr);
+#endif
+}
+
+// NOTE: no concurrent access; the skiplist nodes are not freed (see add_entry)
+inline TreeCache::~TreeCache() {
+  TreeCacheSkipList::Iterator iter(skiplist);
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) free(((const TreeCacheEntry *)iter.key())->ptr);
+  CachedInternalNode* next;
+  while (cached_node_gc.try_pop(next)) free(next);
+#ifdef CACHE_LEARNED_INDEX
+  for (auto& m : models) delete m.load();
+  for (; !retired_models.empty(); retired_models.pop()) delete retired_models.front().second;
+#endif
+  delete[] tree_entry_cnt;
+  delete skiplist;
 }
 
 // [from, to）
-inline bool TreeCache::add_entry(const Key &from, const Key &to, InternalNode *ptr) {
+inline bool TreeCache::add_entry(const Key &from, const Key &to, CachedInternalNode *ptr, uint16_t tree_id) {
   // TODO: memory leak
   auto buf = skiplist->AllocateKey(sizeof(TreeCacheEntry));
   auto &e = *(TreeCacheEntry *)buf;
+  e.tree_id = tree_id;
   e.from = from;
   e.to = to - 1; // !IMPORTANT;
   e.cache_entry_freq = 0;
@@ -75,30 +119,33 @@ inline bool TreeCache::add_entry(const Key &from, const Key &to, InternalNode *p
   return res;
 }
 
-inline const TreeCacheEntry *TreeCache::find_entry(const Key &from, const Key &to) {
+inline const TreeCacheEntry *TreeCache::find_entry(const Key &from, const Key &to, uint16_t tree_id) {
   TreeCacheSkipList::Iterator iter(skiplist);
 
   TreeCacheEntry e;
+  e.tree_id = tree_id;
   e.from = from;
   e.to = to - 1;
   iter.Seek((char *)&e);
   if (iter.Valid()) {
     auto val = (const TreeCacheEntry *)iter.key();
-    return val;
+    return val->tree_id == tree_id ? val : nullptr;
   }
   else return nullptr;
 }
 
-inline const TreeCacheEntry *TreeCache::seek_entry(const Key &from, const Key &to) {
+inline const TreeCacheEntry *TreeCache::seek_entry(const Key &from, const Key &to, uint16_t tree_id) {
   TreeCacheSkipList::Iterator iter(skiplist);
 
   TreeCacheEntry e;
+  e.tree_id = tree_id;
   e.from = from;
   e.to = to - 1;
   iter.Seek((char *)&e);
 seek_next:
   if (iter.Valid()) {
     auto val = (const TreeCacheEntry *)iter.key();
+    if (val->tree_id != tree_id) return nullptr;
     if (val && val->ptr) return val;
     iter.Next();
     goto seek_next;
@@ -106,36 +153,57 @@ seek_next:
   else return nullptr;
 }
 
-inline const TreeCacheEntry *TreeCache::find_entry(const Key &k) {
-  return find_entry(k, k + 1);
+inline const TreeCacheEntry *TreeCache::find_entry(const Key &k, uint16_t tree_id) {
+  return find_entry(k, k + 1, tree_id);
+}
+
+inline const TreeCacheEntry *TreeCache::seek_entry(const Key &k, uint16_t tree_id) {
+  return seek_entry(k, k + 1, tree_id);
 }
 
-inline const TreeCacheEntry *TreeCache::seek_entry(const Key &k) {
-  return seek_entry(k, k + 1);
+inline const TreeCacheEntry *TreeCache::locate_entry(const Key &k, uint16_t tree_id) {
+#ifdef CACHE_LEARNED_INDEX
+  auto entry = model_find_entry(k, tree_id);
+  if (entry) return entry;
+#endif
+#ifdef CACHE_MORE_INTERNAL_NODE
+  return seek_entry(k, tree_id);  // seek the lowest cached internal node surrounding k
+#else
+  return find_entry(k, tree_id);
+#endif
 }
 
-inline bool TreeCache::add_to_cache(InternalNode *page) {
-  auto new_page = (InternalNode *)malloc(sizeof(InternalNode));
-  memcpy(new_page, page, sizeof(InternalNode));
+inline bool TreeCache::add_to_cache(InternalNode *page, uint16_t tree_id) {
+  auto new_page = CachedInternalNode::compress(page);
 
   auto lowest = page->metadata.fence_keys.lowest;
   auto highest = page->metadata.fence_keys.highest;
-  if (this->add_entry(lowest, highest, new_page)) {
+  auto cur_max_tree_id = max_tree_id.load();
+  while (cur_max_tree_id < tree_id && !max_tree_id.compare_exchange_weak(cur_max_tree_id, tree_id));
+  if (this->add_entry(lowest, highest, new_page, tree_id)) {
     skiplist_node_cnt.fetch_add(1);
+    tree_entry_cnt[tree_id].fetch_add(1);
     auto v = free_size.fetch_add(-new_page->consumed_cache_size());
+#ifdef CACHE_LEARNED_INDEX
+    if (new_page->level == 1) model_add(this->find_entry(lowest, highest, tree_id));
+#endif
     if (v < 0) {
       evict();
     }
     return true;
   }
   else { // conflicted
-    auto e = this->find_entry(lowest, highest);
+    auto e = this->find_entry(lowest, highest, tree_id);
     if (e && e->from == lowest && e->to == highest - 1) {
       auto ptr = e->ptr;
       auto ret_val = __sync_val_compare_and_swap(&(e->ptr), ptr, new_page);
       if (ret_val == ptr) {  // cas success
         if (ret_val == nullptr) {
+          tree_entry_cnt[tree_id].fetch_add(1);
           auto v = free_size.fetch_add(-new_page->consumed_cache_size());
+#ifdef CACHE_LEARNED_INDEX
+          if (new_page->level == 1) model_add(e);
+#endif
           if (v < 0) {
             evict();
           }
@@ -150,39 +218,18 @@ inline bool TreeCache::add_to_cache(InternalNode *page) {
   }
 }
 
-inline const TreeCacheEntry *TreeCache::search_from_cache(const Key &k, GlobalAddress& addr, GlobalAddress& sibling_addr, uint16_t& level) {
-#ifdef CACHE_MORE_INTERNAL_NODE
-  auto entry = seek_entry(k);  // seek the lowest cached internal node surrounding k
-#else
-  auto entry = find_entry(k);
-#endif
-  InternalNode *node = entry ? entry->ptr : nullptr;
+inline const TreeCacheEntry *TreeCache::search_from_cache(const Key &k, GlobalAddress& addr, GlobalAddress& sibling_addr, uint16_t& level, uint16_t tree_id) {
+  auto entry = locate_entry(k, tree_id);
+  CachedInternalNode *node = entry ? entry->ptr : nullptr;
 
   if (node && entry->from <= k && entry->to >= k) {
     __sync_fetch_and_add(&(entry->cache_entry_freq), 1);
 
-    auto& records = node->records;
     // the cached internal nodes are kv-sorted
-    if (k < records[0].key) {
-      addr = node->metadata.leftmost_ptr;
-      sibling_addr = records[0].ptr;  // cached nodes are kv-ordered
-    }
-    else {
-      bool find = false;
-      for (int i = 1; i < (int)define::internalSpanSize; ++ i) {
-        if (k < records[i].key || records[i].key == define::kkeyNull) {
-          find = true;
-          addr = records[i - 1].ptr;
-          sibling_addr = (records[i].key == define::kkeyNull ? node->metadata.sibling_leftmost_ptr : records[i].ptr);
-          break;
-        }
-      }
-      if (!find) {
-        addr = records[define::internalSpanSize - 1].ptr;
-        sibling_addr = node->metadata.sibling_leftmost_ptr;
-      }
-    }
-    level = node->metadata.level;
+    int i = node->upper_bound(k);
+    addr = (i == 0 ? node->leftmost_ptr : node->ptr(i - 1));
+    sibling_addr = (i == node->entry_num ? node->sibling_leftmost_ptr : node->ptr(i));
+    level = node->level;
 
     compiler_barrier();
     if (entry->ptr) { // check if it is freed/invalidated
@@ -192,42 +239,30 @@ inline const TreeCacheEntry *TreeCache::search_from_cache(const Key &k, GlobalAd
   return nullptr;
 }
 
-inline const TreeCacheEntry *TreeCache::search_ptr_from_cache(const Key &k, GlobalAddress& addr, const uint16_t& level) {  // get the addr of the internal node with a target level, surrounding k
+inline const TreeCacheEntry *TreeCache::search_ptr_from_cache(const Key &k, GlobalAddress& addr, const uint16_t& level, uint16_t tree_id) {  // get the addr of the internal node with a target level, surrounding k
 #ifndef CACHE_MORE_INTERNAL_NODE
   return nullptr;
 #endif
   TreeCacheSkipList::Iterator iter(skiplist);
 
   TreeCacheEntry e;
+  e.tree_id = tree_id;
   e.from = k;
   e.to = k;
   iter.Seek((char *)&e);
 
   while (iter.Valid()) {
     auto entry = (const TreeCacheEntry *)iter.key();
-    if (entry->from > k || entry->to < k) {
+    if (entry->tree_id != tree_id || entry->from > k || entry->to < k) {
       return nullptr;
     }
-    InternalNode *node = entry->ptr;
+    CachedInternalNode *node = entry->ptr;
     if (node) {
-      if (node->metadata.level == level + 1) {  // is the parent node
+      if (node->level == level + 1) {  // is the parent node
         __sync_fetch_and_add(&(entry->cache_entry_freq), 1);
 
-        auto& records = node->records;
-        if (k < records[0].key) {
-          addr = node->metadata.leftmost_ptr;
-        }
-        else {
-          bool find = false;
-          for (int i = 1; i < (int)define::internalSpanSize; ++ i) {
-            if (k < records[i].key || records[i].key == define::kkeyNull) {
-              find = true;
-              addr = records[i - 1].ptr;
-              break;
-            }
-          }
-          if (!find) addr = records[define::internalSpanSize - 1].ptr;
-        }
+        int i = node->upper_bound(k);
+        addr = (i == 0 ? node->leftmost_ptr : node->ptr(i - 1));
         return (const TreeCacheEntry *)iter.key();
       }
     }
@@ -236,22 +271,65 @@ inline const TreeCacheEntry *TreeCache::search_ptr_from_cache(const Key &k, Glob
   return nullptr;
 }
 
-inline void TreeCache::search_range_from_cache(const Key &from, const Key &to, std::vector<InternalNode> &result) {
+#ifdef HOPSCOTCH_LEAF_NODE
+inline uint8_t *TreeCache::search_neighbor_size(const TreeCacheEntry *entry, const Key &k, const GlobalAddress& leaf_addr) {
+  CachedInternalNode *node = entry ? entry->ptr : nullptr;
+  if (!node || node->level != 1 || entry->from > k || entry->to < k) {
+    return nullptr;
+  }
+  int i = node->upper_bound(k);
+  return (i == 0 ? node->leftmost_ptr : node->ptr(i - 1)) == leaf_addr ? node->neighbor_size(i) : nullptr;
+}
+#endif
+
+inline void TreeCache::search_leaves_from_cache(const Key &k, int leaf_num, std::vector<GlobalAddress> &leaf_addrs, uint16_t tree_id) {  // get the addrs of consecutive leaves from the one surrounding k
+  leaf_addrs.clear();
+  auto key = k;
+  while ((int)leaf_addrs.size() < leaf_num) {
+    auto entry = locate_entry(key, tree_id);
+    CachedInternalNode *node = entry ? entry->ptr : nullptr;
+    if (!node || entry->from > key || entry->to < key || node->level != 1) {
+      return;
+    }
+    __sync_fetch_and_add(&(entry->cache_entry_freq), 1);
+
+    // the cached internal nodes are kv-sorted
+    for (int i = node->upper_bound(key); i <= node->entry_num && (int)leaf_addrs.size() < leaf_num; ++ i) {
+      leaf_addrs.emplace_back(i == 0 ? node->leftmost_ptr : node->ptr(i - 1));
+    }
+    auto highest = node->fence_keys.highest;
+
+    compiler_barrier();
+    if (!entry->ptr || highest <= key) {  // freed/invalidated || the rightmost node
+      return;
+    }
+    key = highest;
+  }
+}
+
+inline void TreeCache::search_range_from_cache(const Key &from, const Key &to, std::vector<InternalNode> &result, uint16_t tree_id) {
   TreeCacheSkipList::Iterator iter(skiplist);
 
   result.clear();
   TreeCacheEntry e;
+  e.tree_id = tree_id;
   e.from = from;
   e.to = from;
   iter.Seek((char *)&e);
 
   while (iter.Valid()) {
     auto entry = (const TreeCacheEntry *)iter.key();
+    if (entry->tree_id != tree_id) {
+      return;
+    }
     if (entry->ptr) {
       if (entry->from > to) {
         return;
       }
-      if (entry->ptr->metadata.level == 1) result.push_back(*(entry->ptr));  // filter: level == 1
+      if (entry->ptr->level == 1) {  // filter: level == 1
+        result.emplace_back();
+        entry->ptr->decompress(&result.back());
+      }
     }
     iter.Next();
   }
@@ -264,64 +342,140 @@ inline bool TreeCache::invalidate(const TreeCacheEntry *entry) {
     return false;
   }
   if (__sync_bool_compare_and_swap(&(entry->ptr), ptr, 0)) {
+    tree_entry_cnt[entry->tree_id].fetch_add(-1);
     free_size.fetch_add(ptr->consumed_cache_size());
+#ifdef CACHE_LEARNED_INDEX
+    if (ptr->level == 1) model_remove(entry);
+#endif
     safely_delete(ptr);
     return true;
   }
   return false;
 }
 
+/*
+  Sample a tree weighted by its cached nodes, so that the entries of all the trees are evicted alike, and then an entry of it
+  from a random key; return nullptr if nothing is cached.
+*/
 inline const TreeCacheEntry *TreeCache::get_a_random_entry(uint64_t &freq) {
-retry:
+  thread_local std::mt19937_64 gen(std::random_device{}());
+  while (true) {
+    int tree_num = (int)max_tree_id.load() + 1;
+    int64_t total_cnt = 0;
+    for (int i = 0; i < tree_num; ++ i) total_cnt += std::max<int64_t>(tree_entry_cnt[i].load(), 0);
+    if (total_cnt == 0) return nullptr;
+    int64_t r = gen() % total_cnt;
+    int tree_id = 0;
+    for (; tree_id < tree_num - 1; ++ tree_id) {
+      r -= std::max<int64_t>(tree_entry_cnt[tree_id].load(), 0);
+      if (r < 0) break;
+    }
 #ifdef CACHE_MORE_INTERNAL_NODE
-  auto e = this->seek_entry(dsm->getRandomKey());
+    auto e = this->seek_entry(dsm->getRandomKey(), tree_id);
+    if (!e) e = this->seek_entry(define::kkeyNull, tree_id);  // wrap around to the first entry of the tree
 #else
-  auto e = this->fine_entry(dsm->getRandomKey());
+    auto e = this->find_entry(dsm->getRandomKey(), tree_id);
+    if (!e || !e->ptr) e = this->seek_entry(define::kkeyNull, tree_id);
 #endif
-
-  if (!e) {
-    goto retry;
+    if (!e) continue;  // the tree is emptied concurrently, re-sample
+    auto ptr = e->ptr;
+    if (!ptr) continue;
+    freq = e->cache_entry_freq;
+    if (e->ptr != ptr) continue;
+    return e;
   }
-  auto ptr = e->ptr;
-  if (!ptr) {
-    goto retry;
-  }
-
-  freq = e->cache_entry_freq;
-  if (e->ptr != ptr) {
-    goto retry;
-  }
-  return e;
 }
 
-inline void TreeCache::evict_one() {
+inline bool TreeCache::evict_one() {
   uint64_t freq1, freq2;
   auto e1 = get_a_random_entry(freq1);
   auto e2 = get_a_random_entry(freq2);
+  if (!e1 || !e2) return false;
 
   if (freq1 < freq2) {
     invalidate(e1);
   } else {
     invalidate(e2);
   }
+  return true;
 }
 
 inline void TreeCache::evict() {
   do {
-    evict_one();
+    if (!evict_one()) break;
   } while (free_size.load() < 0);
 }
 
-inline void TreeCache::safely_delete(InternalNode* cached_node) {
+inline void TreeCache::safely_delete(CachedInternalNode* cached_node) {
   cached_node_gc.push(cached_node);
   while (cached_node_gc.unsafe_size() > safely_free_epoch) {
-    InternalNode* next;
+    CachedInternalNode* next;
     if (cached_node_gc.try_pop(next)) {
-      delete next;
+      free(next);
     }
   }
 }
 
+#ifdef CACHE_LEARNED_INDEX
+inline void TreeCache::model_add(const TreeCacheEntry *entry) {
+  if (!entry || entry->tree_id >= define::kCacheModelTreeNum) return;
+  auto& model = models[entry->tree_id];
+  auto m = model.load(std::memory_order_acquire);
+  if (m && m->is_covered(entry->from)) {
+    m->add(entry);
+    return;
+  }
+  // refit the model to the extended key range, and rebuild it from the cached level-1 nodes
+  std::lock_guard<std::mutex> guard(model_lock);
+  m = model.load(std::memory_order_acquire);
+  if (m && m->is_covered(entry->from)) {
+    m->add(entry);
+    return;
+  }
+  auto min_key = TreeCacheModel::model_key(entry->from), max_key = min_key;
+  if (m) min_key = std::min(min_key, m->min_key), max_key = std::max(max_key, m->max_key);
+  auto new_m = new TreeCacheModel(min_key, max_key);
+  TreeCacheSkipList::Iterator iter(skiplist);
+  TreeCacheEntry e;
+  e.tree_id = entry->tree_id;
+  e.from.fill(0xff);
+  e.to = define::kkeyNull;
+  for (iter.Seek((char *)&e); iter.Valid(); iter.Next()) {
+    auto cached = (const TreeCacheEntry *)iter.key();
+    if (cached->tree_id != entry->tree_id) break;
+    auto node = cached->ptr;
+    if (node && node->level == 1 && new_m->is_covered(cached->from)) new_m->add(cached);
+  }
+  new_m->add(entry);
+  model.store(new_m, std::memory_order_release);
+  free_size.fetch_add(-(int64_t)(sizeof(const TreeCacheEntry *) * define::kCacheModelSlotNum));
+  // the lookups may still hold a retired model for a while
+  auto now = Timer::get_time_ns();
+  if (m) retired_models.push(std::make_pair(now, m));
+  while (!retired_models.empty() && retired_models.front().first + define::kNodeReclaimDelay <= now) {
+    delete retired_models.front().second;
+    retired_models.pop();
+    free_size.fetch_add(sizeof(const TreeCacheEntry *) * define::kCacheModelSlotNum);
+  }
+}
+
+inline void TreeCache::model_remove(const TreeCacheEntry *entry) {
+  if (entry->tree_id >= define::kCacheModelTreeNum) return;
+  auto m = models[entry->tree_id].load(std::memory_order_acquire);
+  if (m && m->is_covered(entry->from)) m->remove(entry);
+}
+
+inline const TreeCacheEntry *TreeCache::model_find_entry(const Key &k, uint16_t tree_id) {
+  if (tree_id >= define::kCacheModelTreeNum) return nullptr;
+  auto m = models[tree_id].load(std::memory_order_acquire);
+  if (!m) return nullptr;
+  auto entry = m->lookup(k);
+  if (!entry || entry->tree_id != tree_id) return nullptr;
+  auto node = entry->ptr;
+  return (node && node->level == 1) ? entry : nullptr;
+}
+#endif
+
 inline void TreeCache::statistics() {
   printf(" ----- [TreeCache]:  cache size=%lu MB free_size=%.3lf MB skiplist_node_cnt=%d ----- \n", cache_size, (double)free_size.load() / define::MB, (int)skiplist_node_cnt.load());
   printf("consumed cache size = %.3lf MB\n", (double)cache_size - (double)free_size.load() / define::MB);
@@ -7,14 +7,15 @@
 #include "Tree.h"
 
 struct TreeCacheEntry {
+  uint16_t tree_id;  // trees of a catalog share one cache
   Key from;
   Key to; // [from, to]
   mutable uint64_t cache_entry_freq;
-  mutable InternalNode *ptr;
+  mutable CachedInternalNode *ptr;
 }
  __attribute__((packed));
 
-static_assert(sizeof(TreeCacheEntry) == 2 * sizeof(Key) + sizeof(uint64_t) * 2);
+static_assert(sizeof(TreeCacheEntry) == sizeof(uint16_t) + 2 * sizeof(Key) + sizeof(uint64_t) * 2);
 
 inline std::ostream &operator<<(std::ostream &os, const TreeCacheEntry &obj) {
   os << "[" << key2int(obj.from) << ", " << key2int(obj.to + 1) << ")";
@@ -28,7 +29,11 @@ struct TreeCacheEntryComparator {
 
   static DecodedType decode_key(const char *b) { return Decode(b); }
 
-  int cmp(const DecodedType a_v, const DecodedType b_v) const {  // entry larger => (to larger, from smaller)
+  int cmp(const DecodedType a_v, const DecodedType b_v) const {  // entry larger => (tree_id larger, to larger, from smaller)
+    if (a_v.tree_id != b_v.tree_id) {
+      return a_v.tree_id < b_v.tree_id ? -1 : +1;
+    }
+
     if (a_v.to < b_v.to) {
       return -1;
     }
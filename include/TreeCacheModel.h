@@ -0,0 +1,83 @@
+#if !defined(_TREE_CACHE_MODEL_H_)
+#define _TREE_CACHE_MODEL_H_
+
+#include "Common.h"
+#include "TreeCacheEntry.h"
+
+#include <atomic>
+
+
+/*
+  Learned index over the cached level-1 nodes of a tree.
+  A linear model (key - base) >> shift maps a key to one of kCacheModelSlotNum slots, and each slot hints the cache entry
+  covering the keys of the slot; together with the kv-sorted separators in the hinted node, it is a piecewise-linear model
+  of the cached leaf pointers. A hint is only a guess, so the lookup checks it, corrects it with the neighbouring slots,
+  and leaves the rest to the skiplist.
+*/
+class TreeCacheModel {
+
+public:
+  TreeCacheModel(uint64_t min_key, uint64_t max_key) : min_key(min_key), max_key(max_key), shift(0) {
+    // leave half of the slots for the growing keys
+    while (((max_key - min_key) >> shift) >= define::kCacheModelSlotNum / 2) ++ shift;
+    base = (min_key >> shift) << shift;
+    slots = new std::atomic<const TreeCacheEntry *>[define::kCacheModelSlotNum];
+    for (int i = 0; i < (int)define::kCacheModelSlotNum; ++ i) slots[i].store(nullptr, std::memory_order_relaxed);
+  }
+  ~TreeCacheModel() { delete[] slots; }
+
+  static uint64_t model_key(const Key& k) {  // the leading 8 bytes keep the key order
+    uint64_t res = 0;
+    for (int i = 0; i < (int)sizeof(uint64_t); ++ i) res = (res << 8) + (i < (int)define::keyLen ? k[i] : 0);
+    return res;
+  }
+
+  bool is_covered(const Key& k) const {
+    auto mk = model_key(k);
+    return mk >= base && get_slot(mk) < define::kCacheModelSlotNum;
+  }
+
+  void add(const TreeCacheEntry *entry) {  // the lower fence key must be covered
+    auto from_slot = get_slot(model_key(entry->from));
+    auto to_slot = std::min(get_slot(model_key(entry->to)), (uint64_t)define::kCacheModelSlotNum - 1);
+    for (auto i = from_slot; i <= to_slot; ++ i) slots[i].store(entry, std::memory_order_release);
+  }
+
+  void remove(const TreeCacheEntry *entry) {
+    auto from_slot = get_slot(model_key(entry->from));
+    if (from_slot >= define::kCacheModelSlotNum) return;
+    auto to_slot = std::min(get_slot(model_key(entry->to)), (uint64_t)define::kCacheModelSlotNum - 1);
+    for (auto i = from_slot; i <= to_slot; ++ i) {
+      auto expected = entry;
+      slots[i].compare_exchange_strong(expected, nullptr);
+    }
+  }
+
+  const TreeCacheEntry *lookup(const Key& k) const {  // the hinted entry surrounding k, if any
+    auto mk = model_key(k);
+    if (mk < base) return nullptr;
+    int64_t s = get_slot(mk);
+    if (s >= (int64_t)define::kCacheModelSlotNum) return nullptr;
+    // bounded correction search
+    for (int d = 0; d <= define::kCacheModelProbeNum; ++ d) {
+      for (auto i : {s - d, s + d}) {
+        if (i < 0 || i >= (int64_t)define::kCacheModelSlotNum || (d == 0 && i != s)) continue;
+        auto entry = slots[i].load(std::memory_order_acquire);
+        if (entry && entry->from <= k && entry->to >= k) return entry;
+      }
+    }
+    return nullptr;
+  }
+
+  const uint64_t min_key;  // bounds of the lower fence keys the model is fitted to
+  const uint64_t max_key;
+
+private:
+  uint64_t get_slot(uint64_t mk) const { return (mk - base) >> shift; }
+
+  uint64_t base;
+  int shift;
+  std::atomic<const TreeCacheEntry *> *slots;
+};
+
+#endif // _TREE_CACHE_MODEL_H_
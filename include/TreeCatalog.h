@@ -0,0 +1,79 @@
+#if !defined(_TREE_CATALOG_H_)
+#define _TREE_CATALOG_H_
+
+#include "Tree.h"
+
+#include <map>
+#include <mutex>
+
+
+/*
+  Tree Catalog: hosts many trees per DSM, which share one TreeCache, IdxCache, LocalLockTable and BlockAllocator.
+  The trees may differ in their neighborhood sizes and value placement, but share the node sizes of the build.
+*/
+class TreeCatalog {
+public:
+  TreeCatalog(DSM *dsm, int cache_size = define::kIndexCacheSize);  // cache_size (MB) is the budget of all the trees
+  ~TreeCatalog();  // NOTE: the trees must be idle
+
+  Tree *open_tree(uint16_t tree_id, int neighbor_size = define::neighborSize, bool inline_value = false);  // the tree is created on the first open of node 0, and kept by the later ones
+  void statistics();
+
+private:
+  DSM *dsm;
+  TreeCache *tree_cache;
+  IdxCache *idx_cache;
+  LocalLockTable *local_lock_table;
+  BlockAllocator *block_allocator;
+
+  std::map<uint16_t, Tree*> trees;
+  std::mutex trees_lock;
+};
+
+
+inline TreeCatalog::TreeCatalog(DSM *dsm, int cache_size) : dsm(dsm), tree_cache(nullptr), idx_cache(nullptr) {
+  // split the budget in the same way as a standalone tree
+#ifdef TREE_ENABLE_CACHE
+#ifdef SPECULATIVE_READ
+  if (cache_size > define::kHotspotBufSize + 20) tree_cache = new TreeCache(cache_size - define::kHotspotBufSize, dsm);  // enable hotspot idx cache
+  else tree_cache = new TreeCache(cache_size, dsm);
+#else
+  tree_cache = new TreeCache(cache_size, dsm);
+#endif
+#endif
+
+#ifdef SPECULATIVE_READ
+  if (cache_size > define::kHotspotBufSize + 20) idx_cache = new IdxCache(define::kHotspotBufSize, dsm);
+  else idx_cache = new IdxCache(0, dsm);
+#endif
+
+  local_lock_table = new LocalLockTable();
+  block_allocator = new BlockAllocator(dsm);
+}
+
+inline TreeCatalog::~TreeCatalog() {
+  for (auto& [_, tree] : trees) delete tree;
+  delete tree_cache;
+  delete idx_cache;
+  delete local_lock_table;
+  delete block_allocator;
+}
+
+inline Tree *TreeCatalog::open_tree(uint16_t tree_id, int neighbor_size, bool inline_value) {
+  std::lock_guard<std::mutex> guard(trees_lock);
+  auto& tree = trees[tree_id];
+  if (!tree) tree = new Tree(dsm, tree_id, tree_cache, idx_cache, local_lock_table, block_allocator, neighbor_size, inline_value);
+  return tree;
+}
+
+inline void TreeCatalog::statistics() {
+  printf(" ----- [TreeCatalog]:  tree num=%lu ----- \n", trees.size());
+#ifdef TREE_ENABLE_CACHE
+  tree_cache->statistics();
+#endif
+#ifdef SPECULATIVE_READ
+  idx_cache->statistics();
+#endif
+}
+
+#endif // _TREE_CATALOG_H_
@@ -294,6 +294,37 @@ void DSM::read_batches_sync(const std::vector<RdmaOpRegion>& rs, CoroPull* sink)
   }
 }
 
+// post the batches without yielding, so that the caller can overlap its own work with the reads
+int DSM::read_batches_async(const std::vector<RdmaOpRegion>& rs, CoroPull* sink) {
+  std::map<uint64_t, std::vector<RdmaOpRegion> > each_rs;
+
+  for (const auto& r : rs) {
+    int node_id = GlobalAddress{r.dest}.nodeID;
+    each_rs[node_id].emplace_back(r);
+  }
+  for (auto& p : each_rs) {
+    auto& _rs = p.second;
+    for (auto& r : _rs) {
+      GlobalAddress gaddr;
+      gaddr.val = r.dest;
+      fill_keys_dest(r, gaddr, r.is_on_chip);
+    }
+    rdmaReadBatch(iCon->data[0][p.first], &_rs[0], (int)_rs.size(), true, sink ? sink->get() : 0ULL);
+  }
+  return (int)each_rs.size();
+}
+
+void DSM::wait_batches(int cnt, CoroPull* sink) {
+  if (cnt <= 0) return;
+  if (sink == nullptr) {
+    ibv_wc wc;
+    pollWithCQ(iCon->cq, cnt, &wc);
+  } else {
+    // the master coroutine resumes this coroutine once per completion
+    for (int i = 0; i < cnt; ++ i) (*sink)();
+  }
+}
+
 void DSM::write_batch(RdmaOpRegion *rs, int k, bool signal, CoroPull* sink) {
   int node_id = -1;
   for (int i = 0; i < k; ++i) {
@@ -4,6 +4,7 @@
 #include "LeafNode.h"
 #include "InternalNode.h"
 #include "Hash.h"
+#include "LeafHashScheme.h"
 
 #include <algorithm>
 #include <city.h>
@@ -35,13 +36,18 @@ uint64_t try_speculative_read[MAX_APP_THREAD];
 uint64_t try_read_leaf[MAX_APP_THREAD];
 uint64_t read_two_segments[MAX_APP_THREAD];
 uint64_t try_read_hopscotch[MAX_APP_THREAD];
+uint64_t read_hopscotch_entry[MAX_APP_THREAD];
 uint64_t retry_cnt[MAX_APP_THREAD][MAX_FLAG_NUM];
 uint64_t try_insert_op[MAX_APP_THREAD];
 uint64_t split_node[MAX_APP_THREAD];
+uint64_t merge_node[MAX_APP_THREAD];
 uint64_t try_write_segment[MAX_APP_THREAD];
 uint64_t write_two_segments[MAX_APP_THREAD];
 double load_factor_sum[MAX_APP_THREAD];
 uint64_t split_hopscotch[MAX_APP_THREAD];
+uint64_t rehash_leaf[MAX_APP_THREAD];
+uint64_t widen_neighborhood[MAX_APP_THREAD];
+uint64_t read_wider_neighborhood[MAX_APP_THREAD];
 
 uint64_t latency[MAX_APP_THREAD][MAX_CORO_NUM][LATENCY_WINDOWS];
 volatile bool need_stop = false;
@@ -52,12 +58,17 @@ thread_local CoroQueue Tree::busy_waiting_queue;
 thread_local GlobalAddress path_stack[MAX_CORO_NUM][MAX_TREE_HEIGHT];
 
 
-Tree::Tree(DSM *dsm, uint16_t tree_id, bool init_root) : dsm(dsm), tree_id(tree_id) {
+Tree::Tree(DSM *dsm, uint16_t tree_id, bool init_root, int neighbor_size, bool inline_value)
+    : dsm(dsm), tree_id(tree_id), neighbor_size(neighbor_size), indirect_value(is_indirect_value(inline_value)) {
   assert(dsm->is_register());
+  assert(neighbor_size > 0 && neighbor_size <= (int)define::neighborSize);
   std::fill(need_clear, need_clear + MAX_APP_THREAD, false);
   clear_debug_info();
 
   local_lock_table = new LocalLockTable();
+#ifdef ENABLE_VAR_LEN_KV
+  block_allocator = new BlockAllocator(dsm);
+#endif
   if (!init_root) return;
 
 #ifdef TREE_ENABLE_CACHE
@@ -75,49 +86,83 @@ Tree::Tree(DSM *dsm, uint16_t tree_id, bool init_root) : dsm(dsm), tree_id(tree_
 #endif
 
   root_ptr_ptr = get_root_ptr_ptr();
+  if (dsm->getMyNodeID() == 0) init_root_leaf();
+}
 
-  if (dsm->getMyNodeID() == 0) {
-    // init root page
-    auto leaf_addr = dsm->alloc(define::allocationLeafSize, PACKED_ADDR_ALIGN_BIT);
-    auto leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
-    auto root_leaf = new (leaf_buffer) LeafNode;
-    root_leaf->metadata.sibling_ptr = GlobalAddress::Widest();
-    Key ghost_key;
-    ghost_key.fill(0xff);
-    ghost_key = ghost_key - 1;
-    int max_key_idx = 0;
+
+Tree::Tree(DSM *dsm, uint16_t tree_id, TreeCache *tree_cache, IdxCache *idx_cache, LocalLockTable *local_lock_table, BlockAllocator *block_allocator,
+           int neighbor_size, bool inline_value)
+    : dsm(dsm), tree_cache(tree_cache), tree_id(tree_id), neighbor_size(neighbor_size), indirect_value(is_indirect_value(inline_value)) {
+  assert(dsm->is_register());
+  assert(neighbor_size > 0 && neighbor_size <= (int)define::neighborSize);
+#ifdef SPECULATIVE_READ
+  this->idx_cache = idx_cache;
+#else
+  UNUSED(idx_cache);
+#endif
+  this->local_lock_table = local_lock_table;
+#ifdef ENABLE_VAR_LEN_KV
+  this->block_allocator = block_allocator;
+#else
+  UNUSED(block_allocator);
+#endif
+
+  root_ptr_ptr = get_root_ptr_ptr();
+  if (dsm->getMyNodeID() == 0) init_root_leaf();
+}
+
+
+bool Tree::is_indirect_value(bool inline_value) {
+#ifdef ENABLE_VAR_LEN_KV
+  return !inline_value;
+#else
+  UNUSED(inline_value);
+  return false;  // values are always inline
+#endif
+}
+
+
+/* Create the root leaf if the tree does not exist yet; an existing root, e.g., created by another compute node, is kept */
+void Tree::init_root_leaf() {
+  if ((uint64_t)get_root_ptr(nullptr) != 0) return;
+  // init root page
+  auto leaf_addr = dsm->alloc(define::allocationLeafSize, PACKED_ADDR_ALIGN_BIT);
+  auto leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
+  auto root_leaf = new (leaf_buffer) LeafNode;
+  root_leaf->metadata.sibling_ptr = GlobalAddress::Widest();
+  Key ghost_key;
+  ghost_key.fill(0xff);
+  ghost_key = ghost_key - 1;
+  int max_key_idx = 0;
 #ifdef HOPSCOTCH_LEAF_NODE
-    max_key_idx = hopscotch_insert_locally(root_leaf->records, ghost_key, define::kValueNull);
+  max_key_idx = hopscotch_insert_locally(root_leaf->records, ghost_key, define::kValueNull);
+  fit_leaf_neighbor_size(root_leaf);
 #else
-    root_leaf->records[max_key_idx].update(ghost_key, define::kValueNull);
+  root_leaf->records[max_key_idx].update(ghost_key, define::kValueNull);
 #endif
 #ifdef VACANCY_AWARE_LOCK
-    // init insert friendly lock
-    auto lock_buffer = (dsm->get_rbuf(nullptr)).get_lock_buffer();
-    auto if_lock = new (lock_buffer) VALOCK(0ULL, max_key_idx);
-    if_lock->update_vacancy(max_key_idx, max_key_idx, std::vector<int>{});
-    auto lock_offset = get_lock_info(true);  // unlock
-    dsm->write_sync((char*)lock_buffer, leaf_addr + lock_offset, sizeof(uint64_t));
-#endif
-    auto encoded_leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
+  // init insert friendly lock
+  auto lock_buffer = (dsm->get_rbuf(nullptr)).get_lock_buffer();
+  auto if_lock = new (lock_buffer) VALOCK(0ULL, max_key_idx);
+  if_lock->update_vacancy(max_key_idx, max_key_idx, std::vector<int>{});
+  auto lock_offset = get_lock_info(true);  // unlock
+  dsm->write_sync((char*)lock_buffer, leaf_addr + lock_offset, sizeof(uint64_t));
+#endif
+  auto encoded_leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
 #ifdef METADATA_REPLICATION
-    auto intermediate_leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
-    MetadataManager::encode_node_metadata(leaf_buffer, intermediate_leaf_buffer);
-    LeafVersionManager::encode_node_versions(intermediate_leaf_buffer, encoded_leaf_buffer);
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
+  MetadataManager::encode_node_metadata(leaf_buffer, intermediate_leaf_buffer);
+  LeafVersionManager::encode_node_versions(intermediate_leaf_buffer, encoded_leaf_buffer);
 #else
-    VersionManager<LeafNode, LeafEntry>::encode_node_versions(leaf_buffer, encoded_leaf_buffer);
+  VersionManager<LeafNode, LeafEntry>::encode_node_versions(leaf_buffer, encoded_leaf_buffer);
 #endif
-    dsm->write_sync(encoded_leaf_buffer, leaf_addr, define::transLeafSize);
+  dsm->write_sync(encoded_leaf_buffer, leaf_addr, define::transLeafSize);
 
-    // install root pointer
-    auto cas_buffer = (dsm->get_rbuf(nullptr)).get_cas_buffer();
-    auto root_entry = RootEntry(1, leaf_addr);
-    auto p = 0ULL;
-retry:
-    bool res = dsm->cas_sync(root_ptr_ptr, p, root_entry, cas_buffer);
-    if (!res && (p = *(uint64_t *)cas_buffer) != (uint64_t)root_entry) {
-      goto retry;
-    }
+  // install root pointer
+  auto cas_buffer = (dsm->get_rbuf(nullptr)).get_cas_buffer();
+  auto root_entry = RootEntry(1, leaf_addr);
+  if (!dsm->cas_sync(root_ptr_ptr, 0ULL, root_entry, cas_buffer)) {  // lost the race, the leaf has never been reachable
+    dsm->free(leaf_addr, define::allocationLeafSize);
   }
 }
 
@@ -127,6 +172,11 @@ GlobalAddress Tree::get_root_ptr_ptr() {
 }
 
 
+GlobalAddress Tree::get_retired_leaf_head_ptr() {
+  return GlobalAddress{0, define::kRetiredLeafStoreOffest + sizeof(GlobalAddress) * tree_id};
+}
+
+
 RootEntry Tree::get_root_ptr(CoroPull* sink) {
   auto root_buffer = (dsm->get_rbuf(sink)).get_cas_buffer();
   dsm->read_sync((char *)root_buffer, root_ptr_ptr, sizeof(RootEntry), sink);
@@ -157,9 +207,14 @@ inline void Tree::before_operation(CoroPull* sink) {
     try_read_leaf[tid]           = 0;
     read_two_segments[tid]       = 0;
     try_read_hopscotch[tid]      = 0;
+    read_hopscotch_entry[tid]    = 0;
     std::fill(retry_cnt[tid], retry_cnt[tid] + MAX_FLAG_NUM, 0);
     try_insert_op[tid]           = 0;
     split_node[tid]              = 0;
+    merge_node[tid]              = 0;
+    rehash_leaf[tid]             = 0;
+    widen_neighborhood[tid]      = 0;
+    read_wider_neighborhood[tid] = 0;
     // load_factor_sum[tid]         = 0;
     // split_hopscotch[tid]         = 0;
     try_write_segment[tid]       = 0;
@@ -184,10 +239,10 @@ inline void Tree::record_cache_hit_ratio(bool from_cache, int level) {
 void Tree::cache_node(InternalNode* node) {
 #ifdef TREE_ENABLE_CACHE
 #ifdef CACHE_MORE_INTERNAL_NODE
-  tree_cache->add_to_cache(node);
+  tree_cache->add_to_cache(node, tree_id);
 #else
   if (node->metadata.level == 1) {  // only cache level-1 internal node
-    tree_cache->add_to_cache(node);
+    tree_cache->add_to_cache(node, tree_id);
   }
 #endif
 #endif
@@ -244,9 +299,20 @@ void Tree::unlock_node(const GlobalAddress &node_addr, uint64_t* lock_buffer, bo
 
 
 void Tree::insert(const Key &k, Value v, CoroPull* sink) {
+  insert(k, nullptr, v, sink);
+}
+
+
+void Tree::insert(const Key &k, const std::string* full_key, Value v, CoroPull* sink, const ValueBytes* val_bytes) {
   assert(dsm->is_register());
   before_operation(sink);
 
+#ifdef ENABLE_VAR_LEN_KV
+  assert(indirect_value || !full_key || full_key->size() <= define::keyLen);  // the rest of a long key is stored in the DataBlock
+  assert(!indirect_value || !val_bytes);  // value bytes are only kept inline
+#endif
+  if (val_bytes) v = LeafEntry::get_leading_value(*val_bytes);  // the rest of the bytes are filled once k is placed
+
   // handover
   bool write_handover = false;
   std::pair<bool, bool> lock_res = std::make_pair(false, false);
@@ -265,7 +331,9 @@ void Tree::insert(const Key &k, Value v, CoroPull* sink) {
   try_insert_op[dsm->getMyThreadID()] ++;
 
 #ifdef TREE_ENABLE_WRITE_COMBINING
-  lock_res = local_lock_table->acquire_local_write_lock(k, v, &busy_waiting_queue, sink);
+  // the string keys sharing an inline key and the value bytes are not combined, as the combined writes only carry a Value
+  if (full_key || val_bytes) lock_res = std::make_pair(false, true);
+  else lock_res = local_lock_table->acquire_local_write_lock(k, v, &busy_waiting_queue, sink, tree_id);
   write_handover = (lock_res.first && !lock_res.second);
 #else
   UNUSED(lock_res);
@@ -276,7 +344,7 @@ void Tree::insert(const Key &k, Value v, CoroPull* sink) {
   }
 
 #ifdef TREE_ENABLE_CACHE
-  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
   if (cache_entry) from_cache = true;
 #endif
   if (!from_cache) {
@@ -292,10 +360,10 @@ next:
   path_stack[sink ? sink->get() : 0][level - 1] = p;
   // read leaf node
   if (level == 1) {
-    if (!leaf_node_insert(p, sibling_p, k, v, from_cache, sink)) {  // return false if cache validation fail
+    if (!leaf_node_insert(p, sibling_p, k, v, from_cache, sink, full_key, val_bytes)) {  // return false if cache validation fail or the leaf is merged
       if (cache_entry) tree_cache->invalidate(cache_entry);
 #ifdef CACHE_MORE_INTERNAL_NODE
-      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
       from_cache = cache_entry ? true : false;
 #else
       from_cache = false;
@@ -315,7 +383,7 @@ next:
     assert(from_cache);
     tree_cache->invalidate(cache_entry);
 #ifdef CACHE_MORE_INTERNAL_NODE
-    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
     from_cache = cache_entry ? true : false;
 #else
     from_cache = false;
@@ -333,7 +401,7 @@ next:
 
 insert_finish:
 #ifdef TREE_ENABLE_WRITE_COMBINING
-  local_lock_table->release_local_write_lock(k, lock_res);
+  local_lock_table->release_local_write_lock(k, lock_res, tree_id);
 #endif
   return;
 }
@@ -410,7 +478,7 @@ re_read:
 
 
 bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v,
-                           bool from_cache, CoroPull* sink) {
+                           bool from_cache, CoroPull* sink, const std::string* full_key, const ValueBytes* val_bytes) {
   // lock node
   auto lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
   lock_node(node_addr, lock_buffer, true, sink);
@@ -418,19 +486,12 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
 #if (defined HOPSCOTCH_LEAF_NODE && defined VACANCY_AWARE_LOCK)
   auto if_lock = (VALOCK *)lock_buffer;
   auto max_key_idx = if_lock->get_max_key_idx();
-  int l_idx = get_hashed_leaf_entry_index(k);
+  int l_idx = LeafHashScheme::get_home_index(k);
   read_entry_num = if_lock->get_read_entry_num_from_bitmap(l_idx, true); // [l_idx, r_idx)
   int r_idx = l_idx + read_entry_num;
-#ifdef METADATA_REPLICATION
   // ensure to read one stattered metadata
-  if (read_entry_num < (int)define::neighborSize
-      && (l_idx % define::neighborSize)
-      && (l_idx / define::neighborSize == (r_idx - 1) / define::neighborSize)) {
-    r_idx = (r_idx - 1 + define::neighborSize) / define::neighborSize * define::neighborSize + 1;
-    read_entry_num = r_idx - l_idx;
-  }
-#endif
-  r_idx = r_idx % define::leafSpanSize;
+  read_entry_num = cover_scattered_metadata(l_idx, read_entry_num);
+  r_idx = (l_idx + read_entry_num) % define::leafSpanSize;
 #endif
   // read leaf
   auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
@@ -457,7 +518,7 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
 #ifdef SIBLING_BASED_VALIDATION
   const auto& sibling_ptr = (leaf->metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)leaf->metadata.sibling_ptr);
   // cache validation
-  if (!leaf->metadata.valid || (from_cache && sibling_addr != sibling_ptr)) {  // invalid || cache is outdated
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && sibling_addr != sibling_ptr)) {  // invalid || cache is outdated
     unlock_node(node_addr, lock_buffer, true, sink, true);
     return false;
   }
@@ -494,7 +555,7 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
     if (k >= split_key) {  // should turn right
       unlock_node(node_addr, lock_buffer, true, sink, true);
       assert(leaf->metadata.sibling_ptr != GlobalAddress::Null());
-      leaf_node_insert(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink);
+      leaf_node_insert(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink, full_key, val_bytes);
       return true;
     }
   }
@@ -502,7 +563,7 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
   UNUSED(sibling_addr);
   // cache validation
   const auto& fence_keys = leaf->metadata.fence_keys;
-  if (from_cache && (!leaf->metadata.valid || k < fence_keys.lowest || k >= fence_keys.highest)) {  // cache is outdated
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && (k < fence_keys.lowest || k >= fence_keys.highest))) {  // invalid || cache is outdated
     unlock_node(node_addr, lock_buffer, true, sink, true);
     return false;
   }
@@ -510,26 +571,26 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
   if (k >= fence_keys.highest) {  // should turn right
     unlock_node(node_addr, lock_buffer, true, sink, true);
     assert(leaf->metadata.sibling_ptr != GlobalAddress::Null());
-    leaf_node_insert(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink);
+    leaf_node_insert(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink, full_key, val_bytes);
     return true;
   }
   assert(k >= fence_keys.lowest);
 #endif
 
-  // start insert
-#ifdef TREE_ENABLE_WRITE_COMBINING
-  local_lock_table->get_combining_value(k, v);
+#if (defined HOPSCOTCH_LEAF_NODE && defined VACANCY_AWARE_LOCK)
+  // removes and splits leave holes, so the keys hashed to l_idx may lie beyond the read range
+  if (hopping_read && read_entry_num < neighbor_size &&
+      (leaf->records[l_idx].hop_bitmap & ((1ULL << (define::neighborSize - read_entry_num)) - 1))) {
+    hopscotch_search(node_addr, r_idx, raw_leaf_buffer, leaf_buffer, sink, neighbor_size - read_entry_num, true);
+  }
 #endif
 
-#ifdef ENABLE_VAR_LEN_KV
-  {
-  // first write a new DataBlock out-of-place
-  auto block_buffer = (dsm->get_rbuf(sink)).get_block_buffer();
-  auto data_block = new (block_buffer) DataBlock(v);
-  auto block_addr = dsm->alloc(define::dataBlockLen, PACKED_ADDR_ALIGN_BIT);
-  dsm->write_sync(block_buffer, block_addr, define::dataBlockLen, sink);
-  // change value into the DataPointer value pointing to the DataBlock
-  v = (uint64_t)DataPointer(define::dataBlockLen, block_addr);
+  // start insert
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  if (!full_key && !val_bytes) local_lock_table->get_combining_value(k, v, tree_id);  // string keys and value bytes are not combined
+  if (v == define::kValueNull) {  // combined with a later remove
+    leaf_entry_remove_and_unlock(leaf, k, node_addr, lock_buffer, sink);
+    return true;
   }
 #endif
 
@@ -545,34 +606,52 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
   // update
   for (i = 0; i < (int)define::leafSpanSize; ++ i) if (records[i].key == k) break;
   if (i != (int)define::leafSpanSize) {
+#ifdef ENABLE_VAR_LEN_KV
+    // first write the new DataBlocks out-of-place, which keep the records of the other keys sharing the inline key
+    std::vector<Value> old_blocks;
+    if (indirect_value) v = write_data_records(k, full_key, v, records[i].value, old_blocks, sink);
+#endif
+    if (val_bytes) records[i].set_value_bytes(*val_bytes);
     entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, k, v, node_addr, lock_buffer, sink);
+#ifdef ENABLE_VAR_LEN_KV
+    for (auto old_v : old_blocks) retire_data_block(old_v);
+#endif
     return true;
   }
+#ifdef ENABLE_VAR_LEN_KV
+  // first write the new DataBlock out-of-place, and change value into the DataPointer value pointing to it
+  std::vector<Value> old_blocks;
+  if (indirect_value) v = write_data_records(k, full_key, v, define::kValueNull, old_blocks, sink);
+#endif
 
   // search for empty entry (insert)
 #ifdef HOPSCOTCH_LEAF_NODE
   // use a leaf copy to hop since it may fail
   auto leaf_copy_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
   memcpy(leaf_copy_buffer, leaf_buffer, sizeof(LeafNode));
-  if (!(hopscotch_insert_and_unlock((LeafNode *)leaf_copy_buffer, k, v, node_addr, lock_buffer, sink, read_entry_num))) {  // return false(remain locked) if need split
+  if (!(hopscotch_insert_and_unlock((LeafNode *)leaf_copy_buffer, k, v, node_addr, lock_buffer, sink, read_entry_num, get_leaf_neighbor_size(leaf), val_bytes))) {  // return false(remain locked) if need split
 #ifdef VACANCY_AWARE_LOCK
     // read the rest of the leaf
     if (read_entry_num < (int)define::leafSpanSize) {
       hopscotch_search(node_addr, r_idx, raw_leaf_buffer, leaf_buffer, sink, define::leafSpanSize - read_entry_num, true);
     }
 #endif
-    // split leaf node
-    hopscotch_split_and_unlock(leaf, k, v, node_addr, lock_buffer, sink);
+    // rehash the churned leaf in place, widen its neighborhood, or split it
+    if (!hopscotch_rehash_and_unlock(leaf, k, v, node_addr, lock_buffer, sink, val_bytes) &&
+        !hopscotch_widen_and_unlock(leaf, k, v, node_addr, lock_buffer, sink, val_bytes)) {
+      hopscotch_split_and_unlock(leaf, k, v, node_addr, lock_buffer, sink, val_bytes);
+    }
   }
 #else
   for (i = 0; i < (int)define::leafSpanSize; ++ i) if (records[i].key == define::kkeyNull) break;
   bool need_split = (i == define::leafSpanSize);
   if (!need_split) {
+    if (val_bytes) records[i].set_value_bytes(*val_bytes);
     entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, k, v, node_addr, lock_buffer, sink);
   }
   else {
     // split leaf node, level(leaf) = 0
-    node_split_and_unlock<LeafNode, LeafEntry, Value, define::leafSpanSize, define::allocationLeafSize, define::transLeafSize>(leaf, k, v, node_addr, lock_buffer, 0, sink);
+    node_split_and_unlock<LeafNode, LeafEntry, Value, define::leafSpanSize, define::allocationLeafSize, define::transLeafSize>(leaf, k, v, node_addr, lock_buffer, 0, sink, val_bytes);
   }
 #endif
   return true;
@@ -580,159 +659,152 @@ bool Tree::leaf_node_insert(const GlobalAddress& node_addr, const GlobalAddress&
 
 
 #ifdef HOPSCOTCH_LEAF_NODE
-bool Tree::hopscotch_insert_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, int entry_num) {
-  auto& records = leaf->records;
-  auto get_entry = [=, &records](int logical_idx) -> LeafEntry& {
-    return records[(logical_idx + define::leafSpanSize) % define::leafSpanSize];
-  };
-  // caculate hash idx
-  int hash_idx = get_hashed_leaf_entry_index(k);
-  // find an empty slot
-  int empty_idx = -1;
-  for (int i = hash_idx; i < hash_idx + entry_num; ++ i) {
-    if (get_entry(i).key == define::kkeyNull) {
-      empty_idx = i;
-      break;
-    }
+/* Extend the read range [l_idx, l_idx + entry_num) so that it covers at least one scattered metadata */
+int Tree::cover_scattered_metadata(int l_idx, int entry_num) {
+#ifdef METADATA_REPLICATION
+  int r_idx = l_idx + entry_num;
+  if (entry_num < (int)define::neighborSize
+      && (l_idx % define::neighborSize)
+      && (l_idx / define::neighborSize == (r_idx - 1) / define::neighborSize)) {
+    r_idx = (r_idx - 1 + define::neighborSize) / define::neighborSize * define::neighborSize + 1;
   }
-  if (empty_idx < 0) return false;  // no empty slot
-  // hop
-  int j = empty_idx;
+  return r_idx - l_idx;
+#else
+  return entry_num;
+#endif
+}
+
+
+bool Tree::hopscotch_insert_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, int entry_num, int leaf_neighbor_size,
+                                       const ValueBytes* val_bytes) {
+  // caculate hash idx
+  int hash_idx = LeafHashScheme::get_home_index(k);
+  // find an empty slot among the read ones, and place k by the scheme
   std::vector<int> hopped_idxes;
-next_hop:
-  hopped_idxes.emplace_back(j % define::leafSpanSize);
-  if (j < hash_idx + (int)define::neighborSize) {
-    get_entry(j).update(k, v);
-    get_entry(hash_idx).set_hop_bit(j - hash_idx);
-    segment_write_and_unlock(leaf, hash_idx, empty_idx % define::leafSpanSize, hopped_idxes, node_addr, lock_buffer, sink);
-    return true;
+  int insert_idx = LeafHashScheme::insert(leaf->records, k, v, leaf_neighbor_size, entry_num, &hopped_idxes);
+  if (insert_idx < 0) return false;  // no empty slot || placing fails
+  if (val_bytes) leaf->records[insert_idx].set_value_bytes(*val_bytes);
+  segment_write_and_unlock(leaf, hash_idx, hopped_idxes.front(), hopped_idxes, node_addr, lock_buffer, sink);
+  return true;
+}
+
+
+int Tree::hopscotch_insert_locally(LeafEntry* records, const Key& k, Value v, int leaf_neighbor_size) {
+  return LeafHashScheme::insert(records, k, v, leaf_neighbor_size ? leaf_neighbor_size : neighbor_size);
+}
+
+
+/* Removes and splits leave the entries hopped far from their home buckets, which blocks the later hops.
+   Re-insert the entries by the order of home buckets, so that each one lies as close to its home as possible. */
+bool Tree::hopscotch_rehash_locally(LeafEntry* records) {
+  std::vector<std::pair<int, LeafEntry> > entries;  // [hash_idx, entry]
+  for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
+    auto& e = records[i];
+    if (e.key != define::kkeyNull) entries.emplace_back(LeafHashScheme::get_home_index(e.key), e);
+    e.update(define::kkeyNull, define::kValueNull);
+    e.hop_bitmap = 0;
   }
-  for (int offset = define::neighborSize - 1; offset > 0; -- offset) {
-    int h = j - offset;
-    // speed up using hopscotch bitmap
-    // int h_hash_idx = get_hashed_leaf_entry_index(get_entry(h).key);
-    int h_hash_idx = -1;
-    for (int z = define::neighborSize - 1; z >= 0; -- z) {
-      int h_home = (h - z + define::leafSpanSize) % define::leafSpanSize;
-      // corner case
-      if (h - h_home < 0) h_home -= define::leafSpanSize;
-      else if (h - h_home >= (int)define::neighborSize) h_home += define::leafSpanSize;
-      assert(h_home <= h);
-      if (h_home + (int)define::neighborSize > j && (get_entry(h_home).hop_bitmap & (1ULL << (define::neighborSize - z - 1)))) {
-        h_hash_idx = h_home;
-        break;
-      }
-    }
-    if (h_hash_idx < 0) continue;
-    get_entry(j).update(get_entry(h).key, get_entry(h).value);
-    get_entry(h_hash_idx).unset_hop_bit(h - h_hash_idx);
-    get_entry(h_hash_idx).set_hop_bit(j - h_hash_idx);
-    j = h;
-    goto next_hop;
+  std::sort(entries.begin(), entries.end(), [](const std::pair<int, LeafEntry>& a, const std::pair<int, LeafEntry>& b){
+    return a.first < b.first || (a.first == b.first && a.second.key < b.second.key);
+  });
+  for (const auto& [hash_idx, e] : entries) {
+    int insert_idx = hopscotch_insert_locally(records, e.key, e.value);
+    if (insert_idx < 0) return false;
+    records[insert_idx].update(e);  // keep the whole value field
   }
-  return false;  // hop fails
+  return true;
 }
 
 
-Key Tree::hopscotch_get_split_key(LeafEntry* records, const Key& k) {
-  // calculate a proper split key to ensure k can be inserted after node split
-  auto get_entry = [=](int logical_idx) -> const LeafEntry& {
-    return records[(logical_idx + define::leafSpanSize) % define::leafSpanSize];
-  };
+bool Tree::hopscotch_rehash_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                       const ValueBytes* val_bytes) {
+  auto& records = leaf->records;
+  int live_cnt = std::count_if(records, records + define::leafSpanSize, [](const LeafEntry& e){ return e.key != define::kkeyNull; });
+  if (live_cnt >= (int)define::leafRehashCapacity) return false;  // crowded enough to split
+  // rehash a leaf copy since it may fail
+  auto rehashed_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  memcpy(rehashed_buffer, (char *)leaf, sizeof(LeafNode));
+  auto rehashed = (LeafNode *)rehashed_buffer;
+  if (!hopscotch_rehash_locally(rehashed->records)) return false;
+  int insert_idx = hopscotch_insert_locally(rehashed->records, k, v);
+  if (insert_idx < 0) return false;
+  if (val_bytes) rehashed->records[insert_idx].set_value_bytes(*val_bytes);
+  fit_leaf_neighbor_size(rehashed);
+  // rewrite the whole leaf under the same lock
+  leaf_write_and_unlock(rehashed, node_addr, lock_buffer, sink);
+  rehash_leaf[dsm->getMyThreadID()] ++;
+  return true;
+}
 
-  std::vector<Key> critical_keys;
-  int hash_idx = get_hashed_leaf_entry_index(k);
-  for (int empty_idx = hash_idx; empty_idx < hash_idx + (int)define::leafSpanSize; ++ empty_idx) {
-    if (get_entry(empty_idx).key == define::kkeyNull) break;
-    // try hopping assuming that get_entry(empty_idx) is empty
-    int j = empty_idx;
-next_hop:
-    if (j < hash_idx + (int)define::neighborSize) {
-      critical_keys.emplace_back(get_entry(empty_idx).key);
-      continue;
-    }
-    for (int offset = define::neighborSize - 1; offset > 0; -- offset) {
-      int h = j - offset;
-      int h_hash_idx = get_hashed_leaf_entry_index(get_entry(h).key);
-      // corner case
-      if (h - h_hash_idx < 0) h_hash_idx -= define::leafSpanSize;
-      else if (h - h_hash_idx >= (int)define::neighborSize) h_hash_idx += define::leafSpanSize;
-      // hop h => j is ok
-      if (h_hash_idx + (int)define::neighborSize > j) {
-        j = h;
-        goto next_hop;
-      }
-    }
+
+bool Tree::hopscotch_widen_locally(const LeafNode* leaf, LeafNode* widened, const Key& k, Value v, const ValueBytes* val_bytes) {
+  for (int leaf_neighbor_size = get_leaf_neighbor_size(leaf) + 1; leaf_neighbor_size <= neighbor_size; ++ leaf_neighbor_size) {
+    memcpy((char *)widened, (const char *)leaf, sizeof(LeafNode));
+    int insert_idx = hopscotch_insert_locally(widened->records, k, v, leaf_neighbor_size);
+    if (insert_idx < 0) continue;
+    if (val_bytes) widened->records[insert_idx].set_value_bytes(*val_bytes);
+    widened->metadata.neighbor_size = leaf_neighbor_size;
+    widen_neighborhood[dsm->getMyThreadID()] ++;
+    return true;
   }
-  assert(!critical_keys.empty());
-  critical_keys.emplace_back(k);
-  std::sort(critical_keys.begin(), critical_keys.end());
-  return critical_keys.at(critical_keys.size() / 2);
+  return false;
 }
 
 
-int Tree::hopscotch_insert_locally(LeafEntry* records, const Key& k, Value v) {
-  auto get_entry = [=, &records](int logical_idx) -> LeafEntry& {
-    return records[(logical_idx + define::leafSpanSize) % define::leafSpanSize];
-  };
-  // caculate hash idx
-  int hash_idx = get_hashed_leaf_entry_index(k);
-  // find an empty slot
-  int j = -1;
-  for (int i = hash_idx; i < hash_idx + (int)define::leafSpanSize; ++ i) {
-    if (get_entry(i).key == define::kkeyNull) {
-      j = i;
-      break;
-    }
-  }
-  // hop
-  assert(j >= 0);
-next_hop:
-  if (j < hash_idx + (int)define::neighborSize) {
-    get_entry(j).update(k, v);
-    get_entry(hash_idx).set_hop_bit(j - hash_idx);
-    return j % define::leafSpanSize;
-  }
-  for (int offset = define::neighborSize - 1; offset > 0; -- offset) {
-    int h = j - offset;
-    // speed up using hopscotch bitmap
-    // int h_hash_idx = get_hashed_leaf_entry_index(get_entry(h).key);
-    int h_hash_idx = -1;
-    for (int z = define::neighborSize - 1; z >= 0; -- z) {
-      int h_home = (h - z + define::leafSpanSize) % define::leafSpanSize;
-      // corner case
-      if (h - h_home < 0) h_home -= define::leafSpanSize;
-      else if (h - h_home >= (int)define::neighborSize) h_home += define::leafSpanSize;
-      assert(h_home <= h);
-      if (h_home + (int)define::neighborSize > j && (get_entry(h_home).hop_bitmap & (1ULL << (define::neighborSize - z - 1)))) {
-        h_hash_idx = h_home;
-        break;
-      }
-    }
-    if (h_hash_idx < 0) continue;
-    // hop h => j is ok
-    get_entry(j).update(get_entry(h).key, get_entry(h).value);
-    get_entry(h_hash_idx).unset_hop_bit(h - h_hash_idx);
-    get_entry(h_hash_idx).set_hop_bit(j - h_hash_idx);
-    j = h;
-    goto next_hop;
+bool Tree::hopscotch_widen_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                      const ValueBytes* val_bytes) {
+  auto widened = (LeafNode *)(dsm->get_rbuf(sink)).get_leaf_buffer();
+  if (!hopscotch_widen_locally(leaf, widened, k, v, val_bytes)) return false;
+  // the metadata replicas change, so rewrite the whole leaf
+  leaf_write_and_unlock(widened, node_addr, lock_buffer, sink);
+  return true;
+}
+
+
+/* The keys of a leaf lie within its neighborhood size, which grows when hopping fails and shrinks when the leaf is rebuilt */
+int Tree::get_leaf_neighbor_size(const LeafNode* leaf) const {
+  return std::max(std::min((int)leaf->metadata.neighbor_size, neighbor_size), std::min((int)define::minNeighborSize, neighbor_size));
+}
+
+
+void Tree::fit_leaf_neighbor_size(LeafNode* leaf) const {
+  int leaf_neighbor_size = std::min((int)define::minNeighborSize, neighbor_size);
+  for (const auto& e : leaf->records) if (e.hop_bitmap) {  // the lowest bit marks the farthest hop
+    leaf_neighbor_size = std::max(leaf_neighbor_size, (int)define::neighborSize - __builtin_ctz(e.hop_bitmap));
   }
-  assert(false);
+  leaf->metadata.neighbor_size = leaf_neighbor_size;
 }
 
 
-void Tree::hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink) {
+/* The searches read the neighborhood size they saw last time, kept next to the leaf pointer in the cached parent,
+   and read again if the hop bitmap shows a wider one */
+int Tree::get_neighbor_hint(const TreeCacheEntry *cache_entry, const Key& k, const GlobalAddress& leaf_addr) const {
+  auto hint = tree_cache->search_neighbor_size(cache_entry, k, leaf_addr);
+  int leaf_neighbor_size = hint ? __atomic_load_n(hint, __ATOMIC_RELAXED) : 0;
+  return leaf_neighbor_size ? std::min(leaf_neighbor_size, neighbor_size) : std::min((int)define::minNeighborSize, neighbor_size);
+}
+
+
+void Tree::set_neighbor_hint(const TreeCacheEntry *cache_entry, const Key& k, const GlobalAddress& leaf_addr, int leaf_neighbor_size) {
+  auto hint = tree_cache->search_neighbor_size(cache_entry, k, leaf_addr);
+  if (hint) __atomic_store_n(hint, (uint8_t)leaf_neighbor_size, __ATOMIC_RELAXED);
+}
+
+
+void Tree::hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                      const ValueBytes* val_bytes) {
   split_node[dsm->getMyThreadID()] ++;
   split_hopscotch[dsm->getMyThreadID()] ++;
   bool is_root = leaf->is_root();
   auto& records = leaf->records;
   // calculate split_key
-  auto split_key = hopscotch_get_split_key(records, k);
+  auto split_key = LeafHashScheme::get_split_key(records, k, neighbor_size);
 
   // sibling node
-  auto sibling_addr = dsm->alloc(define::allocationLeafSize);
+  auto sibling_addr = alloc_leaf(sink);
   auto sibling_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
   auto sibling_leaf = new (sibling_buffer) LeafNode;
+  sibling_leaf->metadata.incarnation = sibling_addr.incarnation;
   // move data
   int non_empty_entry_cnt = 0;
   for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
@@ -740,9 +812,9 @@ void Tree::hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, con
     if (old_e.key != define::kkeyNull) {
       ++ non_empty_entry_cnt;
       if (old_e.key >= split_key) {
-        int hash_idx = get_hashed_leaf_entry_index(old_e.key);
+        int hash_idx = LeafHashScheme::get_home_index(old_e.key);
         // move
-        sibling_leaf->records[i].update(old_e.key, old_e.value);
+        sibling_leaf->records[i].update(old_e);
         old_e.update(define::kkeyNull, define::kValueNull);
         // update hop_bit
         auto offset = (i >= hash_idx ? i - hash_idx : i + (int)define::leafSpanSize - hash_idx);
@@ -753,8 +825,12 @@ void Tree::hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, con
   }
   load_factor_sum[dsm->getMyThreadID()] += (double)non_empty_entry_cnt / define::leafSpanSize;
   // newly insert kv
-  if (k < split_key) hopscotch_insert_locally(records, k, v);
-  else hopscotch_insert_locally(sibling_leaf->records, k, v);
+  auto insert_records = (k < split_key ? records : sibling_leaf->records);
+  int insert_idx = hopscotch_insert_locally(insert_records, k, v);
+  assert(insert_idx >= 0);
+  if (val_bytes) insert_records[insert_idx].set_value_bytes(*val_bytes);
+  fit_leaf_neighbor_size(leaf);
+  fit_leaf_neighbor_size(sibling_leaf);
 
   // change metadata
   auto get_max_key_idx = [=](LeafNode* leaf_node) {
@@ -872,7 +948,7 @@ void Tree::hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, con
 #ifdef TREE_ENABLE_CACHE
   const TreeCacheEntry *cache_entry = nullptr;
   bool from_cache = false;
-  if (parent_node_addr != GlobalAddress::Null() || (cache_entry = tree_cache->search_ptr_from_cache(split_key, parent_node_addr, 1))) {  // normal cases || in case the internal node needed to split is searched(pointed) from cache
+  if (parent_node_addr != GlobalAddress::Null() || (cache_entry = tree_cache->search_ptr_from_cache(split_key, parent_node_addr, 1, tree_id))) {  // normal cases || in case the internal node needed to split is searched(pointed) from cache
     assert(parent_node_addr != GlobalAddress::Null());
     from_cache = (cache_entry != nullptr);
     if(internal_node_insert(parent_node_addr, split_key, sibling_addr, from_cache, 1, sink)) {
@@ -897,6 +973,8 @@ void Tree::hopscotch_split_and_unlock(LeafNode* leaf, const Key& k, Value v, con
 void Tree::hopscotch_search(const GlobalAddress& node_addr, int hash_idx, char *raw_leaf_buffer, char *leaf_buffer, CoroPull* sink, int entry_num, bool for_write) {
   try_read_hopscotch[dsm->getMyThreadID()] ++;
   auto leaf = (LeafNode *)leaf_buffer;
+  entry_num = cover_scattered_metadata(hash_idx, entry_num);
+  read_hopscotch_entry[dsm->getMyThreadID()] += entry_num;
   auto segment_size_r = std::min(entry_num, (int)define::leafSpanSize - hash_idx);
   auto segment_size_l = entry_num <= (int)define::leafSpanSize - hash_idx ? 0 : entry_num - ((int)define::leafSpanSize - hash_idx);
 
@@ -1117,6 +1195,90 @@ void Tree::segment_write_and_unlock(LeafNode* leaf, int l_idx, int r_idx, const
 }
 
 
+#ifdef HOPSCOTCH_LEAF_NODE
+/* Call with the entire leaf read. The dirty entries are written back by segments in one doorbell batch. */
+void Tree::segments_write_and_unlock(LeafNode* leaf, const std::vector<int>& dirty_idxes, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink) {
+  try_write_segment[dsm->getMyThreadID()] ++;
+  auto& records = leaf->records;
+  const auto& metadata = leaf->metadata;
+  auto lock_offset = get_lock_info(true);
+  assert(!(*lock_buffer & (1ULL << 63)));
+  assert(!dirty_idxes.empty());
+
+  auto get_offset_info = [](int l_idx, int r_idx) {  // segment [l_idx, r_idx]
+#ifdef METADATA_REPLICATION
+    return LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx + 1);
+#else
+    return VersionManager<LeafNode, LeafEntry>::get_offset_info(l_idx, r_idx - l_idx + 1);
+#endif
+  };
+  // merge the dirty entries into segments without overlapped cachelines
+  std::vector<std::pair<int, int> > segments;
+  for (int idx : dirty_idxes) {
+    if (!segments.empty()) {
+      auto& [l_idx, r_idx] = segments.back();
+      auto [raw_offset, raw_len, first_offset] = get_offset_info(l_idx, r_idx);
+      auto [next_raw_offset, next_raw_len, next_first_offset] = get_offset_info(idx, idx);
+      UNUSED(first_offset), UNUSED(next_raw_len), UNUSED(next_first_offset);
+      if (next_raw_offset <= raw_offset + raw_len) {
+        r_idx = idx;
+        continue;
+      }
+    }
+    segments.emplace_back(std::make_pair(idx, idx));
+  }
+
+#ifdef VACANCY_AWARE_LOCK
+  auto if_lock = (VALOCK *)lock_buffer;
+  // update max_key_idx
+  auto max_key = define::kkeyNull;
+  int max_key_idx = 0;
+  std::vector<int> empty_idxes;
+  for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
+    const auto& e = records[i];
+    if (e.key == define::kkeyNull) empty_idxes.emplace_back(i);
+    else if (e.key > max_key) max_key = e.key, max_key_idx = i;
+  }
+  if_lock->update_max_key_idx(max_key_idx);
+  // update vacancy bitmap
+  if_lock->update_vacancy(0, define::leafSpanSize - 1, empty_idxes);
+#endif
+
+  // encode segments in place
+  auto encoded_leaf_buffer = (dsm->get_rbuf(sink)).get_range_buffer();
+  std::vector<RdmaOpRegion> rs;
+  for (const auto& [l_idx, r_idx] : segments) {
+    auto [raw_offset, raw_len, first_offset] = get_offset_info(l_idx, r_idx);
+#ifdef METADATA_REPLICATION
+    auto intermediate_segment_buffer = (dsm->get_rbuf(sink)).get_segment_buffer();
+    auto [first_metadata_offset, new_len] = MetadataManager::get_offset_info(l_idx, r_idx - l_idx + 1);
+    MetadataManager::encode_segment_metadata((char *)&records[l_idx], intermediate_segment_buffer, first_metadata_offset, r_idx - l_idx + 1, metadata);
+    LeafVersionManager::encode_segment_versions(intermediate_segment_buffer, encoded_leaf_buffer + raw_offset, first_offset, dirty_idxes, l_idx, r_idx, first_metadata_offset, new_len);
+#else
+    UNUSED(metadata);
+    VersionManager<LeafNode, LeafEntry>::encode_segment_versions((char *)&records[l_idx], encoded_leaf_buffer + raw_offset, first_offset, dirty_idxes, l_idx, r_idx);
+#endif
+    RdmaOpRegion r;
+    r.source     = (uint64_t)encoded_leaf_buffer + raw_offset;
+    r.dest       = (node_addr + raw_offset).to_uint64();
+    r.size       = raw_len;
+    r.is_on_chip = false;
+    rs.push_back(r);
+  }
+  assert((dsm->get_rbuf(sink)).is_safe(encoded_leaf_buffer + define::transLeafSize));
+  // write segments and unlock
+  RdmaOpRegion r;
+  r.source     = (uint64_t)lock_buffer;
+  r.dest       = (node_addr + lock_offset).to_uint64();
+  r.size       = sizeof(uint64_t);
+  r.is_on_chip = false;
+  rs.push_back(r);
+  dsm->write_batch_sync(&rs[0], (int)rs.size(), sink);
+  return;
+}
+#endif
+
+
 bool Tree::internal_node_insert(const GlobalAddress& node_addr, const Key &k, const GlobalAddress &v, bool from_cache, uint8_t level,
                                CoroPull* sink) {
   // lock node
@@ -1177,7 +1339,7 @@ re_read:
 
 template <class NODE, class ENTRY, class VAL, int SPAN_SIZE, int ALLOC_SIZE, int TRANS_SIZE>
 void Tree::node_split_and_unlock(NODE* node, const Key& k, VAL v, const GlobalAddress& node_addr, uint64_t* lock_buffer, uint8_t level,
-                                 CoroPull* sink) {
+                                 CoroPull* sink, const ValueBytes* val_bytes) {
   split_node[dsm->getMyThreadID()] ++;
   bool is_root = node->is_root();
   auto& records = node->records;
@@ -1192,17 +1354,19 @@ void Tree::node_split_and_unlock(NODE* node, const Key& k, VAL v, const GlobalAd
   auto split_key = records[m].key;
   assert(split_key != define::kkeyNull);
   // sibling node
-  auto sibling_addr = dsm->alloc(ALLOC_SIZE);
+  auto sibling_addr = (NODE::IS_LEAF ? alloc_leaf(sink) : dsm->alloc(ALLOC_SIZE));
   auto sibling_buffer = (dsm->get_rbuf(sink)).get_node_buffer<NODE>();
   auto sibling_node = new (sibling_buffer) NODE;
+  if (NODE::IS_LEAF) ((LeafNode*)sibling_node)->metadata.incarnation = sibling_addr.incarnation;
   // move && insert new kv && re-determined split-key (if needed)
   if (NODE::IS_LEAF) {
     for (int i = m; i < SPAN_SIZE; ++ i) {
       sibling_node->records[i - m] = records[i];
     }
     std::fill(records + m, records + SPAN_SIZE, ENTRY::Null());
-    if (k < split_key) records[m] = ENTRY(k, v);
-    else sibling_node->records[SPAN_SIZE - m] = ENTRY(k, v);
+    auto& insert_entry = (k < split_key ? records[m] : sibling_node->records[SPAN_SIZE - m]);
+    insert_entry = ENTRY(k, v);
+    if (val_bytes) ((LeafEntry *)&insert_entry)->set_value_bytes(*val_bytes);
 #ifdef SIBLING_BASED_VALIDATION
     auto max_key = ((k < split_key && records[m - 1].key < k) ? k : records[m - 1].key);
     split_key = max_key + 1;
@@ -1305,7 +1469,7 @@ void Tree::node_split_and_unlock(NODE* node, const Key& k, VAL v, const GlobalAd
 #ifdef TREE_ENABLE_CACHE
   const TreeCacheEntry *cache_entry = nullptr;
   bool from_cache = false;
-  if (parent_node_addr != GlobalAddress::Null() || (cache_entry = tree_cache->search_ptr_from_cache(split_key, parent_node_addr, level + 1))) {  // normal cases || in case the internal node needed to split is searched(pointed) from cache
+  if (parent_node_addr != GlobalAddress::Null() || (cache_entry = tree_cache->search_ptr_from_cache(split_key, parent_node_addr, level + 1, tree_id))) {  // normal cases || in case the internal node needed to split is searched(pointed) from cache
     assert(parent_node_addr != GlobalAddress::Null());
     from_cache = (cache_entry != nullptr);
     if(internal_node_insert(parent_node_addr, split_key, sibling_addr, from_cache, level + 1, sink)) {
@@ -1337,11 +1501,10 @@ void Tree::entry_write_and_unlock(NODE* node, const int idx, const Key& k, VAL v
   auto encoded_entry_buffer = (dsm->get_rbuf(sink)).get_entry_buffer();
 #if (defined METADATA_REPLICATION && defined HOPSCOTCH_LEAF_NODE)
   auto get_info_and_encode_versions = [=, &entry, &metadata](int idx){
-    if (NODE::IS_LEAF) {
+    if constexpr (NODE::IS_LEAF) {
       auto intermediate_segment_buffer = (dsm->get_rbuf(sink)).get_segment_buffer();
       auto [first_metadata_offset, new_len] = MetadataManager::get_offset_info(idx);
-      MetadataManager::encode_segment_metadata((char *)&entry, intermediate_segment_buffer, first_metadata_offset, 1,
-                                               LeafMetadata(metadata.h_version, 0, metadata.valid, metadata.sibling_ptr, metadata.fence_keys));
+      MetadataManager::encode_segment_metadata((char *)&entry, intermediate_segment_buffer, first_metadata_offset, 1, metadata);
       auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(idx);
       LeafVersionManager::encode_segment_versions(intermediate_segment_buffer, encoded_entry_buffer, first_offset, std::vector<int>{idx}, idx, idx, first_metadata_offset, new_len);
       return std::make_pair(raw_offset, raw_len);
@@ -1384,6 +1547,50 @@ void Tree::entry_write_and_unlock(NODE* node, const int idx, const Key& k, VAL v
 }
 
 
+void Tree::leaf_write_and_unlock(LeafNode* leaf, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink) {
+  auto encoded_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+#ifdef METADATA_REPLICATION
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  MetadataManager::encode_node_metadata((char *)leaf, intermediate_leaf_buffer);
+  LeafVersionManager::encode_node_versions(intermediate_leaf_buffer, encoded_leaf_buffer);
+#else
+  VersionManager<LeafNode, LeafEntry>::encode_node_versions((char *)leaf, encoded_leaf_buffer);
+#endif
+#ifdef VACANCY_AWARE_LOCK
+  // update in-lock metadata
+  int max_key_idx = 0;
+  std::vector<int> empty_idxes;
+  for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
+    const auto& e = leaf->records[i];
+    if (e.key == define::kkeyNull) empty_idxes.emplace_back(i);
+    else if (e.key > leaf->records[max_key_idx].key) max_key_idx = i;
+  }
+  auto if_lock = (VALOCK *)lock_buffer;
+  if_lock->update_max_key_idx(max_key_idx);
+  if_lock->update_vacancy(0, define::leafSpanSize - 1, empty_idxes);
+#endif
+  auto lock_offset = get_lock_info(true);
+  assert(!(*lock_buffer & (1ULL << 63)));
+#ifdef SPLIT_WRITE_UNLATCH
+  memcpy(encoded_leaf_buffer + lock_offset, lock_buffer, sizeof(uint64_t));  // unlock
+  dsm->write_sync(encoded_leaf_buffer, node_addr, define::transLeafSize + define::allocationLockSize, sink);
+#else
+  std::vector<RdmaOpRegion> rs(2);
+  rs[0].source = (uint64_t)encoded_leaf_buffer;
+  rs[0].dest = node_addr.to_uint64();
+  rs[0].size = define::transLeafSize;
+  rs[0].is_on_chip = false;
+
+  rs[1].source = (uint64_t)lock_buffer;
+  rs[1].dest = (node_addr + lock_offset).to_uint64();
+  rs[1].size = sizeof(uint64_t);
+  rs[1].is_on_chip = false;
+  dsm->write_batch_sync(&rs[0], 2, sink);
+#endif
+  return;
+}
+
+
 template <class NODE, class ENTRY, int TRANS_SIZE>
 void Tree::node_write_and_unlock(NODE* node, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink, bool async) {
   // write the whole node
@@ -1414,38 +1621,107 @@ void Tree::node_write_and_unlock(NODE* node, const GlobalAddress& node_addr, uin
 
 
 void Tree::update(const Key &k, Value v, CoroPull* sink) {
+  update(k, nullptr, v, sink);
+}
+
+
+void Tree::update(const Key &k, const std::string* full_key, Value v, CoroPull* sink, const ValueBytes* val_bytes) {
   assert(dsm->is_register());
   before_operation(sink);
 
+#ifdef ENABLE_VAR_LEN_KV
+  assert(indirect_value || !full_key || full_key->size() <= define::keyLen);  // the rest of a long key is stored in the DataBlock
+  assert(!indirect_value || !val_bytes);  // value bytes are only kept inline
+#endif
+  if (val_bytes) v = LeafEntry::get_leading_value(*val_bytes);
+
   // handover
   bool write_handover = false;
   std::pair<bool, bool> lock_res = std::make_pair(false, false);
 
-  // cache
-  bool from_cache = false;
-  const TreeCacheEntry *cache_entry = nullptr;
-
-  // traversal
-  GlobalAddress p;
-  GlobalAddress sibling_p;
-  uint16_t level;
-  int retry_flag = FIRST_TRY;
-
   try_write_op[dsm->getMyThreadID()]++;
 
 #ifdef TREE_ENABLE_WRITE_COMBINING
-  lock_res = local_lock_table->acquire_local_write_lock(k, v, &busy_waiting_queue, sink);
+  // the string keys sharing an inline key and the value bytes are not combined, as the combined writes only carry a Value
+  if (full_key || val_bytes) lock_res = std::make_pair(false, true);
+  else lock_res = local_lock_table->acquire_local_write_lock(k, v, &busy_waiting_queue, sink, tree_id);
   write_handover = (lock_res.first && !lock_res.second);
 #else
   UNUSED(lock_res);
 #endif
   if (write_handover) {
     write_handover_num[dsm->getMyThreadID()]++;
-    goto update_finish;
   }
+  else {
+    update_traverse(k, v, nullptr, sink, full_key, val_bytes);
+  }
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  local_lock_table->release_local_write_lock(k, lock_res, tree_id);
+#endif
+  return;
+}
+
+
+Value Tree::rmw(const Key &k, const RMWFunc& func, CoroPull* sink) {
+  assert(dsm->is_register());
+  before_operation(sink);
+
+  try_write_op[dsm->getMyThreadID()]++;
+
+  RMWRequest req(k, func, tree_id);
+  std::vector<RMWRequest*> reqs;
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  auto lock_res = local_lock_table->acquire_local_rmw_lock(k, &req, &busy_waiting_queue, sink, tree_id);
+  if (lock_res.first) {  // combined by another rmw
+    write_handover_num[dsm->getMyThreadID()]++;
+    return req.old_v;
+  }
+  if (lock_res.second) reqs.emplace_back(&req);
+  else local_lock_table->get_combining_rmws(k, reqs, tree_id);
+#else
+  reqs.emplace_back(&req);
+#endif
+  // apply the combined rmws in order under one leaf lock; a null result is dropped, as it would read as a removed value
+  update_traverse(k, define::kValueNull, [&reqs](Value v){
+    for (auto r : reqs) {
+      r->old_v = v;
+      auto new_v = r->func(v);
+      if (new_v != define::kValueNull) v = new_v;
+    }
+    return v;
+  }, sink);
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  for (auto r : reqs) if (r != &req) r->done = true;
+  local_lock_table->release_local_rmw_lock(k, lock_res, tree_id);
+#endif
+  return req.old_v;
+}
+
+
+Value Tree::fetch_add(const Key &k, Value delta, CoroPull* sink) {
+  return rmw(k, [delta](Value v){ return v + delta; }, sink);
+}
+
+
+bool Tree::compare_and_swap(const Key &k, Value expected, Value desired, CoroPull* sink) {
+  if (desired == define::kValueNull) return false;  // a null value cannot be stored
+  return rmw(k, [expected, desired](Value v){ return v == expected ? desired : v; }, sink) == expected;
+}
+
+
+void Tree::update_traverse(const Key &k, Value v, const RMWFunc& func, CoroPull* sink, const std::string* full_key, const ValueBytes* val_bytes) {
+  // cache
+  bool from_cache = false;
+  const TreeCacheEntry *cache_entry = nullptr;
+
+  // traversal
+  GlobalAddress p;
+  GlobalAddress sibling_p;
+  uint16_t level;
+  int retry_flag = FIRST_TRY;
 
 #ifdef TREE_ENABLE_CACHE
-  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
   if (cache_entry) from_cache = true;
 #endif
   if (!from_cache) {
@@ -1459,12 +1735,10 @@ next:
   retry_cnt[dsm->getMyThreadID()][retry_flag] ++;
   // read leaf node
   if (level == 1) {
-    if (!leaf_node_update(p, sibling_p, k, v, from_cache, sink)) {  // return false if cache validation fail
-      // cache invalidation
-      assert(from_cache);
-      tree_cache->invalidate(cache_entry);
+    if (!leaf_node_update(p, sibling_p, k, v, from_cache, sink, func, full_key, val_bytes)) {  // return false if cache validation fail or the leaf is merged
+      if (cache_entry) tree_cache->invalidate(cache_entry);
 #ifdef CACHE_MORE_INTERNAL_NODE
-      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
       from_cache = cache_entry ? true : false;
 #else
       from_cache = false;
@@ -1476,7 +1750,7 @@ next:
       retry_flag = INVALID_LEAF;
       goto next;
     }
-    goto update_finish;
+    return;
   }
   // traverse internal nodes
   if (!internal_node_search(p, sibling_p, k, level, from_cache, sink)) {  // return false if cache validation fail
@@ -1484,7 +1758,7 @@ next:
     assert(from_cache);
     tree_cache->invalidate(cache_entry);
 #ifdef CACHE_MORE_INTERNAL_NODE
-    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
     from_cache = cache_entry ? true : false;
 #else
     from_cache = false;
@@ -1499,17 +1773,13 @@ next:
   from_cache = false;
   retry_flag = FIND_NEXT;
   goto next;  // search next level
-
-update_finish:
-#ifdef TREE_ENABLE_WRITE_COMBINING
-  local_lock_table->release_local_write_lock(k, lock_res);
-#endif
-  return;
-}
+}
 
 
-bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v, bool from_cache, CoroPull* sink) {
+bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value v, bool from_cache, CoroPull* sink,
+                            const RMWFunc& func, const std::string* full_key, const ValueBytes* val_bytes) {
   int i;
+  bool speculative_hit = false;
   try_read_leaf[dsm->getMyThreadID()] ++;
   // lock node
   auto lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
@@ -1523,20 +1793,22 @@ bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress&
   FenceKeys fence_keys;
 
 #ifdef HOPSCOTCH_LEAF_NODE
-  int hash_idx = get_hashed_leaf_entry_index(k);
+  int hash_idx = LeafHashScheme::get_home_index(k);
 #ifdef SPECULATIVE_READ
   Value old_v;
-  if (speculative_read(node_addr, std::make_pair(hash_idx, (hash_idx + define::neighborSize) % define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, old_v, i, sink, true)) {
+  if (speculative_read(node_addr, std::make_pair(hash_idx, (hash_idx + neighbor_size) % define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, old_v, i, sink, true)) {
     UNUSED(old_v);
+    speculative_hit = true;
     goto update_entry;
   }
 #endif
-  hopscotch_search(node_addr, hash_idx, raw_leaf_buffer, leaf_buffer, sink, define::neighborSize, true);
+  hopscotch_search(node_addr, hash_idx, raw_leaf_buffer, leaf_buffer, sink, neighbor_size, true);
 #else
 #ifdef SPECULATIVE_READ
   Value old_v;
   if (speculative_read(node_addr, std::make_pair(0, define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, old_v, i, sink, true)) {
     UNUSED(old_v);
+    speculative_hit = true;
     goto update_entry;
   }
 #endif
@@ -1549,7 +1821,7 @@ bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress&
   UNUSED(fence_keys);
   sibling_ptr = (leaf->metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)leaf->metadata.sibling_ptr);
   // cache validation
-  if (from_cache && (!leaf->metadata.valid || sibling_addr != sibling_ptr)) {  // cache is outdated
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && sibling_addr != sibling_ptr)) {  // invalid || cache is outdated
     unlock_node(node_addr, lock_buffer, true, sink, true);
     leaf_cache_invalid[dsm->getMyThreadID()] ++;
     return false;
@@ -1559,7 +1831,7 @@ bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress&
   UNUSED(sibling_addr);
   // cache validation
   fence_keys = leaf->metadata.fence_keys;
-  if (from_cache && (!leaf->metadata.valid || k < fence_keys.lowest || k >= fence_keys.highest)) {  // cache is outdated
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && (k < fence_keys.lowest || k >= fence_keys.highest))) {  // invalid || cache is outdated
     unlock_node(node_addr, lock_buffer, true, sink, true);
     leaf_cache_invalid[dsm->getMyThreadID()] ++;
     return false;
@@ -1569,7 +1841,7 @@ bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress&
     unlock_node(node_addr, lock_buffer, true, sink, true);
     assert(leaf->metadata.sibling_ptr != GlobalAddress::Null());
     leaf_read_sibling[dsm->getMyThreadID()] ++;
-    leaf_node_update(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink);
+    leaf_node_update(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink, func, full_key, val_bytes);
     return true;
   }
   assert(k >= fence_keys.lowest);
@@ -1579,65 +1851,348 @@ bool Tree::leaf_node_update(const GlobalAddress& node_addr, const GlobalAddress&
   // search for existing key
 #ifdef HOPSCOTCH_LEAF_NODE
   int j;
-  for (j = 0; j < (int)define::neighborSize; ++ j) {
+  for (j = 0; j < neighbor_size; ++ j) {
     i = (hash_idx + j) % define::leafSpanSize;
     if (records[i].key == k) break;
   }
 #ifdef SIBLING_BASED_VALIDATION
   // turn right check
-  if (j == (int)define::neighborSize && sibling_addr != sibling_ptr) {  // search sibling node
+  if (j == neighbor_size && sibling_addr != sibling_ptr && sibling_ptr != GlobalAddress::Null()) {  // search sibling node
     unlock_node(node_addr, lock_buffer, true, sink, true);
-    assert(sibling_ptr != GlobalAddress::Null());
     leaf_read_sibling[dsm->getMyThreadID()] ++;
-    leaf_node_update(sibling_ptr, sibling_addr, k, v, false, sink);
+    leaf_node_update(sibling_ptr, sibling_addr, k, v, false, sink, func, full_key, val_bytes);
     return true;
   }
 #endif
-  assert(j != (int)define::neighborSize);
+  if (j == neighbor_size) {  // key not found, e.g., a rmw on a key never inserted
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    return true;
+  }
 #else
   for (i = 0; i < (int)define::leafSpanSize; ++ i) if (records[i].key == k) break;
 #ifdef SIBLING_BASED_VALIDATION
-  if (i == (int)define::leafSpanSize && sibling_addr != sibling_ptr) {  // search sibling node
+  if (i == (int)define::leafSpanSize && sibling_addr != sibling_ptr && sibling_ptr != GlobalAddress::Null()) {  // search sibling node
     unlock_node(node_addr, lock_buffer, true, sink, true);
-    assert(sibling_ptr != GlobalAddress::Null());
-    leaf_node_update(sibling_ptr, sibling_addr, k, v, false, sink);
+    leaf_node_update(sibling_ptr, sibling_addr, k, v, false, sink, func, full_key, val_bytes);
     return true;
   }
 #endif
-  assert(i != (int)define::leafSpanSize);
+  if (i == (int)define::leafSpanSize) {  // key not found, e.g., a rmw on a key never inserted
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    return true;
+  }
 #endif
 #ifdef SPECULATIVE_READ
   idx_cache->add_to_cache(node_addr, i, k);
 update_entry:
 #endif
+#ifdef ENABLE_VAR_LEN_KV
+  std::vector<Value> old_blocks;
+#endif
+  if (func) {  // read-modify-write
+    auto old_v = records[i].value;
+    if (old_v == define::kValueNull) {  // the removed max key, which has no DataBlock either
+      unlock_node(node_addr, lock_buffer, true, sink, true);
+      return true;
+    }
+#ifdef ENABLE_VAR_LEN_KV
+    auto block_buffer = (dsm->get_rbuf(sink)).get_block_buffer();
+    auto data_ptr = (DataPointer *)&records[i].value;
+    if (indirect_value) {  // read the first DataBlock
+      dsm->read_sync(block_buffer, (GlobalAddress)data_ptr->ptr, data_ptr->data_len, sink);
+      old_v = ((DataBlock*)block_buffer)->first_record()->value;
+    }
+#endif
+    v = func(old_v);
+    if (v == old_v) {  // nothing to write
+      unlock_node(node_addr, lock_buffer, true, sink, true);
+      return true;
+    }
+#ifdef ENABLE_VAR_LEN_KV
+    if (indirect_value) {  // write a new DataBlock out-of-place, which keeps the rest of the records and the chain
+      ((DataBlock*)block_buffer)->first_record()->value = v;
+      ((DataBlock*)block_buffer)->version = DataBlock::next_version(records[i].value);
+      old_blocks.emplace_back((Value)records[i].value);
+      v = write_data_block((DataBlock*)block_buffer, sink, data_ptr->chained);
+    }
+#endif
+  }
+  else {
 #ifdef TREE_ENABLE_WRITE_COMBINING
-  local_lock_table->get_combining_value(k, v);
+    if (!full_key && !val_bytes) local_lock_table->get_combining_value(k, v, tree_id);  // string keys and value bytes are not combined
+    if (v == define::kValueNull && !speculative_hit) {  // combined with a later remove; only the target entry is read if speculative_hit
+      leaf_entry_remove_and_unlock(leaf, k, node_addr, lock_buffer, sink);
+      return true;
+    }
+#else
+    UNUSED(speculative_hit);
+#endif
+#ifdef ENABLE_VAR_LEN_KV
+    // first write the new DataBlocks out-of-place, which keep the records of the other keys sharing the inline key
+    if (indirect_value) v = write_data_records(k, full_key, v, records[i].value, old_blocks, sink);
+#endif
+    if (val_bytes) records[i].set_value_bytes(*val_bytes);
+  }
+  entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, k, v, node_addr, lock_buffer, sink);
+#ifdef ENABLE_VAR_LEN_KV
+  for (auto old_v : old_blocks) retire_data_block(old_v);
+#endif
+  return true;
+}
+
+
+void Tree::multi_insert(const std::vector<Key> &keys, const std::vector<Value> &values, CoroPull* sink) {
+  multi_write(keys, values, true, sink);
+}
+
+
+void Tree::multi_update(const std::vector<Key> &keys, const std::vector<Value> &values, CoroPull* sink) {
+  multi_write(keys, values, false, sink);
+}
+
+
+/*
+  Batched write: keys are partitioned by the cached leaves, and each leaf is locked and read once.
+  Keys that miss the cache, fail the validation or hit a leaf alone fall back to insert()/update() in the input order.
+*/
+void Tree::multi_write(const std::vector<Key> &keys, const std::vector<Value> &values, bool is_insert, CoroPull* sink) {
+  assert(dsm->is_register());
+  assert(keys.size() == values.size());
+#if (defined TREE_ENABLE_CACHE && defined HOPSCOTCH_LEAF_NODE)
+  before_operation(sink);
+  auto tid = dsm->getMyThreadID();
+
+  struct LeafBatch {
+    const TreeCacheEntry *cache_entry;
+    GlobalAddress sibling_addr;
+    std::vector<int> key_ids;
+  };
+  std::map<GlobalAddress, LeafBatch> leaf_batches;
+  std::vector<int> fallback_ids;
+
+  // partition keys by leaves
+  for (int i = 0; i < (int)keys.size(); ++ i) {
+    GlobalAddress p;
+    GlobalAddress sibling_p;
+    uint16_t level;
+    auto cache_entry = tree_cache->search_from_cache(keys[i], p, sibling_p, level, tree_id);
+    if (!cache_entry || level != 1) {
+      fallback_ids.emplace_back(i);
+      continue;
+    }
+    auto& batch = leaf_batches[p];
+    if (batch.key_ids.empty()) batch.cache_entry = cache_entry, batch.sibling_addr = sibling_p;
+    else if (batch.sibling_addr != sibling_p) {  // inconsistent cache entries
+      fallback_ids.emplace_back(i);
+      continue;
+    }
+    batch.key_ids.emplace_back(i);
+  }
+
+  for (const auto& [leaf_addr, batch] : leaf_batches) {
+    if (batch.key_ids.size() == 1) {  // the hopping read of a single write is cheaper
+      fallback_ids.emplace_back(batch.key_ids.front());
+      continue;
+    }
+    try_write_op[tid] += batch.key_ids.size();
+    if (is_insert) try_insert_op[tid] += batch.key_ids.size();
+    for (int j = 0; j < (int)batch.key_ids.size(); ++ j) record_cache_hit_ratio(true, 1);
+    // record search path for split
+    path_stack[sink ? sink->get() : 0][0] = leaf_addr;
+    path_stack[sink ? sink->get() : 0][1] = GlobalAddress::Null();
+    if (!leaf_node_multi_write(leaf_addr, batch.sibling_addr, keys, values, batch.key_ids, is_insert, fallback_ids, sink)) {  // return false if cache validation fail or the leaf is merged
+      tree_cache->invalidate(batch.cache_entry);
+      fallback_ids.insert(fallback_ids.end(), batch.key_ids.begin(), batch.key_ids.end());
+    }
+  }
+
+  std::sort(fallback_ids.begin(), fallback_ids.end());
+  for (int key_id : fallback_ids) {
+    if (is_insert) insert(keys[key_id], values[key_id], sink);
+    else update(keys[key_id], values[key_id], sink);
+  }
+#else
+  for (int i = 0; i < (int)keys.size(); ++ i) {
+    if (is_insert) insert(keys[i], values[i], sink);
+    else update(keys[i], values[i], sink);
+  }
+#endif
+  return;
+}
+
+
+#ifdef HOPSCOTCH_LEAF_NODE
+bool Tree::leaf_node_multi_write(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const std::vector<Key> &keys, const std::vector<Value> &values,
+                                 const std::vector<int>& key_ids, bool is_insert, std::vector<int>& fallback_ids, CoroPull* sink) {
+  // lock node
+  auto lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
+  lock_node(node_addr, lock_buffer, true, sink);
+  // read the entire leaf
+  auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf = (LeafNode *) leaf_buffer;
+  dsm->read_sync(raw_leaf_buffer, node_addr, define::transLeafSize, sink);
+#ifdef METADATA_REPLICATION
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  assert((LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer)));
+  MetadataManager::decode_node_metadata(intermediate_leaf_buffer, leaf_buffer);
+#else
+  assert((VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer)));
+#endif
+
+  std::vector<int> target_ids;
+#ifdef SIBLING_BASED_VALIDATION
+  const auto& sibling_ptr = (leaf->metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)leaf->metadata.sibling_ptr);
+  // cache validation
+  if (!leaf->metadata.is_valid(node_addr) || sibling_addr != sibling_ptr) {  // invalid || cache is outdated
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    leaf_cache_invalid[dsm->getMyThreadID()] ++;
+    return false;
+  }
+  target_ids = key_ids;
+#else
+  UNUSED(sibling_addr);
+  // cache validation
+  const auto& fence_keys = leaf->metadata.fence_keys;
+  if (!leaf->metadata.is_valid(node_addr)) {  // invalid
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    leaf_cache_invalid[dsm->getMyThreadID()] ++;
+    return false;
+  }
+  for (int key_id : key_ids) {
+    if (keys[key_id] >= fence_keys.lowest && keys[key_id] < fence_keys.highest) target_ids.emplace_back(key_id);
+    else fallback_ids.emplace_back(key_id);  // cache is outdated || should turn right
+  }
 #endif
 
+  // apply the writes locally
+  auto& records = leaf->records;
+  auto origin_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf_copy_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  memcpy(origin_leaf_buffer, leaf_buffer, sizeof(LeafNode));
+  std::vector<int> applied_ids;
+  int overflow_id = -1;
+  bool is_rebuilt = false;  // the leaf metadata changes
+  for (int j = 0; j < (int)target_ids.size(); ++ j) {
+    int key_id = target_ids[j];
+    const auto& k = keys[key_id];
+    int i;
+    for (i = 0; i < (int)define::leafSpanSize; ++ i) if (records[i].key == k) break;
+    if (i != (int)define::leafSpanSize) {  // update
+      records[i].update(k, values[key_id]);
+      applied_ids.emplace_back(key_id);
+      continue;
+    }
+    if (!is_insert) {  // key is not found
+      fallback_ids.emplace_back(key_id);
+      continue;
+    }
+    // use a leaf copy to hop since it may fail
+    memcpy(leaf_copy_buffer, leaf_buffer, sizeof(LeafNode));
+    auto copy_leaf = (LeafNode *)leaf_copy_buffer;
+    auto copy_records = copy_leaf->records;
+    if (hopscotch_insert_locally(copy_records, k, values[key_id], get_leaf_neighbor_size(leaf)) < 0) {
+      // rehash the churned leaf in place, or widen its neighborhood
+      memcpy(leaf_copy_buffer, leaf_buffer, sizeof(LeafNode));
+      int live_cnt = std::count_if(copy_records, copy_records + define::leafSpanSize, [](const LeafEntry& e){ return e.key != define::kkeyNull; });
+      bool rebuilt = false;
+      if (live_cnt < (int)define::leafRehashCapacity && hopscotch_rehash_locally(copy_records) && hopscotch_insert_locally(copy_records, k, values[key_id]) >= 0) {
+        fit_leaf_neighbor_size(copy_leaf);
+        rehash_leaf[dsm->getMyThreadID()] ++;
+        rebuilt = true;
+      }
+      else rebuilt = hopscotch_widen_locally(leaf, copy_leaf, k, values[key_id]);
+      if (rebuilt) {
+        is_rebuilt = true;
+        memcpy(leaf_buffer, leaf_copy_buffer, sizeof(LeafNode));
+        applied_ids.emplace_back(key_id);
+        continue;
+      }
+      // need split
+      overflow_id = key_id;
+      fallback_ids.insert(fallback_ids.end(), target_ids.begin() + j + 1, target_ids.end());
+      break;
+    }
+    memcpy(leaf_buffer, leaf_copy_buffer, sizeof(LeafNode));
+    applied_ids.emplace_back(key_id);
+  }
+  Value overflow_v = (overflow_id >= 0 ? values[overflow_id] : define::kValueNull);
+
 #ifdef ENABLE_VAR_LEN_KV
-  {
-  // first write a new DataBlock out-of-place
-  auto block_buffer = (dsm->get_rbuf(sink)).get_block_buffer();
-  auto data_block = new (block_buffer) DataBlock(v);
-  auto block_addr = dsm->alloc(define::dataBlockLen, PACKED_ADDR_ALIGN_BIT);
-  dsm->write_sync(block_buffer, block_addr, define::dataBlockLen, sink);
-  // change value into the DataPointer value pointing to the DataBlock
-  v = (uint64_t)DataPointer(define::dataBlockLen, block_addr);
+  std::vector<Value> superseded_values;
+  if (indirect_value) {
+  // first write new DataBlocks out-of-place
+  std::map<Key, Value> new_values;
+  for (int key_id : applied_ids) new_values[keys[key_id]] = values[key_id];
+  if (overflow_id >= 0) new_values[keys[overflow_id]] = overflow_v;
+  std::map<Key, Value> old_values;  // the overwritten DataPointers
+  for (const auto& e : ((LeafNode *)origin_leaf_buffer)->records) {
+    if (e.key != define::kkeyNull && new_values.count(e.key)) old_values[e.key] = e.value;
+  }
+  auto block_buffer = (dsm->get_rbuf(sink)).get_range_buffer();
+  std::vector<RdmaOpRegion> rs;
+  int block_cnt = 0;
+  for (auto& [k, v] : new_values) {
+    auto data_block = new (block_buffer + block_cnt * define::dataBlockLen) DataBlock(k, DataBlock::next_version(old_values.count(k) ? old_values[k] : define::kValueNull));
+    data_block->append(nullptr, v);
+    auto block_addr = block_allocator->alloc(define::dataBlockLen);
+    RdmaOpRegion r;
+    r.source     = (uint64_t)data_block;
+    r.dest       = block_addr.to_uint64();
+    r.size       = define::dataBlockLen;
+    r.is_on_chip = false;
+    rs.push_back(r);
+    // change value into the DataPointer value pointing to the DataBlock
+    v = (uint64_t)DataPointer(define::dataBlockLen, block_addr, data_block->version);
+    ++ block_cnt;
   }
+  assert((dsm->get_rbuf(sink)).is_safe(block_buffer + block_cnt * define::dataBlockLen));
+  if (!rs.empty()) dsm->write_batches_sync(rs, sink);
+  for (auto& e : records) if (e.key != define::kkeyNull && new_values.count(e.key)) e.value = new_values[e.key];
+  if (overflow_id >= 0) overflow_v = new_values[keys[overflow_id]];
+  for (const auto& [_, old_v] : old_values) superseded_values.emplace_back(old_v);
+  }
+#else
+  UNUSED(applied_ids);
+#endif
+
+  auto origin_leaf = (LeafNode *)origin_leaf_buffer;
+  std::vector<int> dirty_idxes;
+  if (overflow_id >= 0) {
+    // split leaf node with the applied writes
+    hopscotch_split_and_unlock(leaf, keys[overflow_id], overflow_v, node_addr, lock_buffer, sink);
+  }
+  else if (is_rebuilt) {
+    leaf_write_and_unlock(leaf, node_addr, lock_buffer, sink);
+  }
+  else {
+    // write back the dirty entries
+    for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
+      if (memcmp(&records[i], &(origin_leaf->records[i]), sizeof(LeafEntry))) dirty_idxes.emplace_back(i);
+    }
+    if (dirty_idxes.empty()) unlock_node(node_addr, lock_buffer, true, sink, true);
+    else segments_write_and_unlock(leaf, dirty_idxes, node_addr, lock_buffer, sink);
+  }
+#ifdef ENABLE_VAR_LEN_KV
+  for (auto old_v : superseded_values) retire_data_chain(old_v, sink);
 #endif
-  entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, k, v, node_addr, lock_buffer, sink);
   return true;
 }
+#endif
 
 
-bool Tree::search(const Key &k, Value &v, CoroPull* sink) {
+void Tree::remove(const Key &k, CoroPull* sink) {
+  remove(k, nullptr, sink);
+}
+
+
+void Tree::remove(const Key &k, const std::string* full_key, CoroPull* sink) {
   assert(dsm->is_register());
   before_operation(sink);
 
   // handover
-  bool search_res = false;
+  bool write_handover = false;
   std::pair<bool, bool> lock_res = std::make_pair(false, false);
-  bool read_handover = false;
 
   // cache
   bool from_cache = false;
@@ -1649,21 +2204,23 @@ bool Tree::search(const Key &k, Value &v, CoroPull* sink) {
   uint16_t level;
   int retry_flag = FIRST_TRY;
 
-  try_read_op[dsm->getMyThreadID()] ++;
+  try_write_op[dsm->getMyThreadID()]++;
 
-#ifdef TREE_ENABLE_READ_DELEGATION
-  lock_res = local_lock_table->acquire_local_read_lock(k, &busy_waiting_queue, sink);
-  read_handover = (lock_res.first && !lock_res.second);
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  // a remove is combined as a write of kValueNull; the string keys sharing an inline key are not combined
+  if (full_key) lock_res = std::make_pair(false, true);
+  else lock_res = local_lock_table->acquire_local_write_lock(k, define::kValueNull, &busy_waiting_queue, sink, tree_id);
+  write_handover = (lock_res.first && !lock_res.second);
 #else
   UNUSED(lock_res);
 #endif
-  if (read_handover) {
-    read_handover_num[dsm->getMyThreadID()]++;
-    goto search_finish;
+  if (write_handover) {
+    write_handover_num[dsm->getMyThreadID()]++;
+    goto remove_finish;
   }
 
 #ifdef TREE_ENABLE_CACHE
-  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
   if (cache_entry) from_cache = true;
 #endif
   if (!from_cache) {
@@ -1672,18 +2229,17 @@ bool Tree::search(const Key &k, Value &v, CoroPull* sink) {
   }
   record_cache_hit_ratio(from_cache, level);
   assert(level != 0);
-  v = define::kValueNull;
 
 next:
   retry_cnt[dsm->getMyThreadID()][retry_flag] ++;
+  // record search path, from cache is ok
+  path_stack[sink ? sink->get() : 0][level - 1] = p;
   // read leaf node
   if (level == 1) {
-    if (!leaf_node_search(p, sibling_p, k, v, from_cache, sink)) {  // return false if cache validation fail
-      // cache invalidation
-      assert(from_cache);
-      tree_cache->invalidate(cache_entry);
+    if (!leaf_node_remove(p, sibling_p, k, from_cache, sink, full_key)) {  // return false if cache validation fail or the leaf is merged
+      if (cache_entry) tree_cache->invalidate(cache_entry);
 #ifdef CACHE_MORE_INTERNAL_NODE
-      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
       from_cache = cache_entry ? true : false;
 #else
       from_cache = false;
@@ -1695,18 +2251,7 @@ next:
       retry_flag = INVALID_LEAF;
       goto next;
     }
-    search_res = (v != define::kValueNull);  // search finish
-#ifdef ENABLE_VAR_LEN_KV
-    if (search_res) {
-      // read the DataBlock
-      auto block_len = ((DataPointer *)&v)->data_len;
-      auto block_addr = ((DataPointer *)&v)->ptr;
-      auto block_buffer = (dsm->get_rbuf(sink)).get_block_buffer();
-      dsm->read_sync(block_buffer, (GlobalAddress)block_addr, block_len, sink);
-      v = ((DataBlock*)block_buffer)->value;
-    }
-#endif
-    goto search_finish;
+    goto remove_finish;
   }
   // traverse internal nodes
   if (!internal_node_search(p, sibling_p, k, level, from_cache, sink)) {  // return false if cache validation fail
@@ -1714,7 +2259,7 @@ next:
     assert(from_cache);
     tree_cache->invalidate(cache_entry);
 #ifdef CACHE_MORE_INTERNAL_NODE
-    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
+    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
     from_cache = cache_entry ? true : false;
 #else
     from_cache = false;
@@ -1730,106 +2275,1103 @@ next:
   retry_flag = FIND_NEXT;
   goto next;  // search next level
 
-search_finish:
-#ifdef TREE_ENABLE_READ_DELEGATION
-  local_lock_table->release_local_read_lock(k, lock_res, search_res, v);  // handover the ret leaf addr
-#endif
-  return search_res;
-}
-
-
-void Tree::leaf_entry_read(const GlobalAddress& leaf_addr, const int idx, char *raw_leaf_buffer, char *leaf_buffer, CoroPull* sink, bool for_write) {
-  auto leaf = (LeafNode *)leaf_buffer;
-#ifdef METADATA_REPLICATION
-  auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(idx);
-  auto raw_entry_buffer = raw_leaf_buffer + raw_offset;
-re_read:
-  dsm->read_sync(raw_entry_buffer, leaf_addr + raw_offset, raw_len, sink);
-  uint8_t entry_node_version = 0;
-  auto intermediate_entry_buffer = (dsm->get_rbuf(sink)).get_segment_buffer();
-  auto [first_metadata_offset, new_len] = MetadataManager::get_offset_info(idx);
-  if (for_write) assert((LeafVersionManager::decode_segment_versions(raw_entry_buffer, intermediate_entry_buffer, first_offset, 1, first_metadata_offset, new_len, entry_node_version)));
-  else if (!LeafVersionManager::decode_segment_versions(raw_entry_buffer, intermediate_entry_buffer, first_offset, 1, first_metadata_offset, new_len, entry_node_version)) {
-    goto re_read;
-  }
-  MetadataManager::decode_segment_metadata(intermediate_entry_buffer, (char*)&(leaf->records[idx]), first_metadata_offset, 1, leaf->metadata);
-  return;
-#else
-  auto [raw_offset, raw_len, first_offset] = VersionManager<LeafNode, LeafEntry>::get_offset_info(idx);
-  auto raw_entry_buffer = raw_leaf_buffer + raw_offset;
-re_read:
-  // read metadata and the hop segment
-  std::vector<RdmaOpRegion> rs(2);
-  rs[0].source = (uint64_t)raw_leaf_buffer;
-  rs[0].dest = leaf_addr.to_uint64();
-  rs[0].size = define::bufferMetadataSize;  // header
-  rs[0].is_on_chip = false;
-
-  rs[1].source = (uint64_t)raw_entry_buffer;
-  rs[1].dest = (leaf_addr + raw_offset).to_uint64();
-  rs[1].size = raw_len;
-  rs[1].is_on_chip = false;
-  // note that the rs array will change by lower-level function
-  dsm->read_batch_sync(&rs[0], 2, sink);
-  uint8_t metadata_node_version = 0, entry_node_version = 0;
-  if (for_write) {  // for locked node, consistency check is not needed
-    assert((VersionManager<LeafNode, LeafEntry>::decode_header_versions(raw_leaf_buffer, leaf_buffer, metadata_node_version)));
-    assert((VersionManager<LeafNode, LeafEntry>::decode_segment_versions(raw_entry_buffer, (char*)&(leaf->records[idx]), first_offset, 1, entry_node_version)));
-    assert(metadata_node_version == entry_node_version);
-    return;
-  }
-  // consistency check; note that: (segment_size_l > 0) => there are two segments
-  if (!VersionManager<LeafNode, LeafEntry>::decode_header_versions(raw_leaf_buffer, leaf_buffer, metadata_node_version) ||
-      !VersionManager<LeafNode, LeafEntry>::decode_segment_versions(raw_entry_buffer, (char*)&(leaf->records[idx]), first_offset, 1, entry_node_version) ||
-      metadata_node_version != entry_node_version) {
-    goto re_read;
-  }
+remove_finish:
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  local_lock_table->release_local_write_lock(k, lock_res, tree_id);
 #endif
   return;
 }
 
 
-#ifdef SPECULATIVE_READ
-bool Tree::speculative_read(const GlobalAddress& leaf_addr, std::pair<int, int> range, char *raw_leaf_buffer, char *leaf_buffer, const Key &k, Value &v,
-                            int& speculative_idx, CoroPull* sink, bool for_write) {
-  auto leaf = (LeafNode *)leaf_buffer;
-  if (idx_cache->search_idx_from_cache(leaf_addr, range.first, range.second, k, speculative_idx)) {
-    // read entry
-    try_speculative_read[dsm->getMyThreadID()] ++;
-    leaf_entry_read(leaf_addr, speculative_idx, raw_leaf_buffer, leaf_buffer, sink, for_write);
-    const auto& entry = leaf->records[speculative_idx];
-    if (entry.key == k) {
-      correct_speculative_read[dsm->getMyThreadID()] ++;
-      v = entry.value;
-      idx_cache->add_to_cache(leaf_addr, speculative_idx, k);
-      return true;
-    }
-  }
-  return false;
-}
-#endif
-
-
-bool Tree::leaf_node_search(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value &v, bool from_cache, CoroPull* sink) {
+bool Tree::leaf_node_remove(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, bool from_cache, CoroPull* sink,
+                            const std::string* full_key) {
   try_read_leaf[dsm->getMyThreadID()] ++;
+  // lock node
+  auto lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
+  lock_node(node_addr, lock_buffer, true, sink);
+  // read leaf
   auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
   auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
-  auto leaf = (LeafNode *)leaf_buffer;
+  auto leaf = (LeafNode *) leaf_buffer;
+  auto& records = leaf->records;
+  GlobalAddress sibling_ptr;
+  FenceKeys fence_keys;
+  bool is_found = false;
+
+  // the whole neighborhood (including the home bucket) is needed to maintain hop_bitmap, so speculative read is skipped
 #ifdef HOPSCOTCH_LEAF_NODE
-  int hash_idx = get_hashed_leaf_entry_index(k);
-#ifdef SPECULATIVE_READ
-  int speculative_idx;
-  if (speculative_read(node_addr, std::make_pair(hash_idx, (hash_idx + define::neighborSize) % define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, v, speculative_idx, sink)) {
-    UNUSED(speculative_idx);
-    return true;
-  }
-#endif
-re_read:
-  hopscotch_search(node_addr, hash_idx, raw_leaf_buffer, leaf_buffer, sink);
+  int hash_idx = LeafHashScheme::get_home_index(k);
+  hopscotch_search(node_addr, hash_idx, raw_leaf_buffer, leaf_buffer, sink, neighbor_size, true);
 #else
-#ifdef SPECULATIVE_READ
+  dsm->read_sync(raw_leaf_buffer, node_addr, define::transLeafSize, sink);
+  // no need to consistency check since the node is locked
+  assert((VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer)));
+#endif
+
+#ifdef SIBLING_BASED_VALIDATION
+  UNUSED(fence_keys);
+  sibling_ptr = (leaf->metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)leaf->metadata.sibling_ptr);
+  // cache validation
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && sibling_addr != sibling_ptr)) {  // invalid || cache is outdated
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    leaf_cache_invalid[dsm->getMyThreadID()] ++;
+    return false;
+  }
+#else
+  UNUSED(sibling_ptr);
+  UNUSED(sibling_addr);
+  // cache validation
+  fence_keys = leaf->metadata.fence_keys;
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && (k < fence_keys.lowest || k >= fence_keys.highest))) {  // invalid || cache is outdated
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    leaf_cache_invalid[dsm->getMyThreadID()] ++;
+    return false;
+  }
+  // turn right check
+  if (k >= fence_keys.highest) {  // should turn right
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    assert(leaf->metadata.sibling_ptr != GlobalAddress::Null());
+    leaf_read_sibling[dsm->getMyThreadID()] ++;
+    leaf_node_remove(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, false, sink, full_key);
+    return true;
+  }
+  assert(k >= fence_keys.lowest);
+#endif
+
+  // search for existing key
+#ifdef HOPSCOTCH_LEAF_NODE
+  for (int j = 0; j < neighbor_size && !is_found; ++ j) is_found = (records[(hash_idx + j) % define::leafSpanSize].key == k);
+#else
+  for (int i = 0; i < (int)define::leafSpanSize && !is_found; ++ i) is_found = (records[i].key == k);
+#endif
+#ifdef SIBLING_BASED_VALIDATION
+  // turn right check
+  if (!is_found && sibling_addr != sibling_ptr && sibling_ptr != GlobalAddress::Null()) {  // search sibling node
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    leaf_read_sibling[dsm->getMyThreadID()] ++;
+    leaf_node_remove(sibling_ptr, sibling_addr, k, false, sink, full_key);
+    return true;
+  }
+#endif
+
+#ifdef TREE_ENABLE_WRITE_COMBINING
+  Value v = define::kValueNull;
+  if (!full_key) local_lock_table->get_combining_value(k, v, tree_id);
+  if (v != define::kValueNull) {  // combined with a later insert/update
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    return leaf_node_insert(node_addr, sibling_addr, k, v, from_cache, sink);
+  }
+#endif
+  if (leaf_entry_remove_and_unlock(leaf, k, node_addr, lock_buffer, sink, full_key)) {
+    leaf_node_merge(node_addr, k, sink);
+  }
+  return true;
+}
+
+
+/*
+  Remove k from a locked leaf whose neighborhood of k (the whole leaf without HOPSCOTCH_LEAF_NODE) has been read.
+  The entry, the hop_bitmap of its home bucket and the vacancy bitmap are written back along with unlocking.
+  Return true if the leaf may be under-filled.
+*/
+bool Tree::leaf_entry_remove_and_unlock(LeafNode* leaf, const Key& k, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink,
+                                        const std::string* full_key) {
+  auto& records = leaf->records;
+  int i = -1;
+#ifdef HOPSCOTCH_LEAF_NODE
+  int hash_idx = LeafHashScheme::get_home_index(k);
+  for (int j = 0; j < neighbor_size; ++ j) if (records[(hash_idx + j) % define::leafSpanSize].key == k) {
+    i = (hash_idx + j) % define::leafSpanSize;
+    break;
+  }
+#else
+  for (int j = 0; j < (int)define::leafSpanSize; ++ j) if (records[j].key == k) {
+    i = j;
+    break;
+  }
+#endif
+  if (i < 0) {  // key is not found
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    return false;
+  }
+#ifdef ENABLE_VAR_LEN_KV
+  auto old_v = records[i].value;
+  std::vector<Value> old_blocks;
+  if (indirect_value && full_key) {  // only remove the record of full_key, and keep the other keys sharing the inline key
+    auto v = write_data_records(k, full_key, define::kValueNull, old_v, old_blocks, sink);
+    if (v != define::kValueNull) {
+      if (v == old_v) unlock_node(node_addr, lock_buffer, true, sink, true);  // full_key is not found
+      else entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, k, v, node_addr, lock_buffer, sink);
+      for (auto old_block : old_blocks) retire_data_block(old_block);
+      return false;
+    }
+  }
+  auto retire_old_block = [&]() {
+    if (!indirect_value) return;
+    if (full_key) for (auto old_block : old_blocks) retire_data_block(old_block);
+    else retire_data_chain(old_v, sink);
+  };
+#else
+  UNUSED(full_key);
+  auto retire_old_block = [](){};
+#endif
+  // with sibling-based validation, the max key bounds the leaf and is kept as a null-valued entry
+#if (defined SIBLING_BASED_VALIDATION && defined HOPSCOTCH_LEAF_NODE && defined VACANCY_AWARE_LOCK)
+  bool keep_entry = (i == ((VALOCK *)lock_buffer)->get_max_key_idx());
+#elif (defined SIBLING_BASED_VALIDATION && defined HOPSCOTCH_LEAF_NODE)
+  // the max key is unknown without the vacancy-aware lock, so read the rest of the (locked) leaf
+  auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  hopscotch_search(node_addr, (hash_idx + neighbor_size) % define::leafSpanSize, raw_leaf_buffer, (char *)leaf, sink, define::leafSpanSize - neighbor_size, true);
+  bool keep_entry = std::none_of(records, records + define::leafSpanSize, [&k](const LeafEntry& e){ return e.key > k; });
+#elif defined SIBLING_BASED_VALIDATION
+  bool keep_entry = std::none_of(records, records + define::leafSpanSize, [&k](const LeafEntry& e){ return e.key > k; });
+#else
+  bool keep_entry = false;
+#endif
+  if (keep_entry) {
+    entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, k, define::kValueNull, node_addr, lock_buffer, sink);
+    retire_old_block();
+    return false;
+  }
+#ifdef HOPSCOTCH_LEAF_NODE
+  records[i].update(define::kkeyNull, define::kValueNull);
+  records[hash_idx].unset_hop_bit((i - hash_idx + define::leafSpanSize) % define::leafSpanSize);
+  // write [hash_idx, i] and unlock, which also marks the vacancy of i in the lock
+  segment_write_and_unlock(leaf, hash_idx, i, std::vector<int>{i}, node_addr, lock_buffer, sink);
+  retire_old_block();
+  // a sparse neighborhood hints an under-filled leaf, whose live entries are then counted by leaf_node_merge
+  int live_cnt = 0;
+  for (int j = 0; j < neighbor_size; ++ j) live_cnt += (records[(hash_idx + j) % define::leafSpanSize].key != define::kkeyNull);
+  return live_cnt * define::leafSpanSize < define::leafMergeThreshold * neighbor_size;
+#else
+  entry_write_and_unlock<LeafNode, LeafEntry, Value>(leaf, i, define::kkeyNull, define::kValueNull, node_addr, lock_buffer, sink);
+  retire_old_block();
+  return std::count_if(records, records + define::leafSpanSize, [](const LeafEntry& e){ return e.key != define::kkeyNull; }) < (int)define::leafMergeThreshold;
+#endif
+}
+
+
+/*
+  Merge an under-filled leaf into its left sibling under the same level-1 parent, i.e., [left, node] => [left],
+  and remove the separator of the leaf from the parent. The merged leaf is emptied, invalidated and then reclaimed.
+  It is best-effort: the merge is given up if the leaf is a leftmost child, the leaves are not mergeable, etc.
+*/
+void Tree::leaf_node_merge(const GlobalAddress& node_addr, const Key& k, CoroPull* sink) {
+  // count the live entries before locking anything
+  int live_cnt = count_live_entries(node_addr, sink);
+  if (live_cnt < 0 || live_cnt >= (int)define::leafMergeThreshold) return;
+
+  // find the level-1 parent
+  auto parent_addr = path_stack[sink ? sink->get() : 0][1];
+#ifdef TREE_ENABLE_CACHE
+  if (parent_addr == GlobalAddress::Null()) tree_cache->search_ptr_from_cache(k, parent_addr, 1, tree_id);
+#endif
+  if (parent_addr == GlobalAddress::Null()) {
+    auto e = get_root_ptr(sink);
+    auto p = (GlobalAddress)e.ptr;
+    auto sibling_p = GlobalAddress::Null();
+    auto level = e.level;
+    while (level > 2) internal_node_search(p, sibling_p, k, level, false, sink);
+    if (level < 2) return;  // root is a leaf
+    parent_addr = p;
+  }
+
+  // read the parent and find the left sibling
+  auto raw_internal_buffer = (dsm->get_rbuf(sink)).get_internal_buffer();
+  auto internal_buffer = (dsm->get_rbuf(sink)).get_internal_buffer();
+  auto parent = (InternalNode *)internal_buffer;
+  auto& p_records = parent->records;
+  auto read_parent = [&](GlobalAddress& left_addr) {
+re_read:
+    dsm->read_sync(raw_internal_buffer, parent_addr, define::transInternalSize, sink);
+    if (!VersionManager<InternalNode, InternalEntry>::decode_node_versions(raw_internal_buffer, internal_buffer)) {
+      goto re_read;
+    }
+    if (!parent->metadata.valid || parent->metadata.level != 1) return -1;
+#ifdef UNORDERED_INTERNAL_NODE
+    std::sort(p_records, p_records + define::internalSpanSize, [](const InternalEntry& a, const InternalEntry& b){
+      if (a.key == define::kkeyNull) return false;
+      if (b.key == define::kkeyNull) return true;
+      return a.key < b.key;
+    });
+#endif
+    // the parent should not be emptied
+    if (p_records[1].key == define::kkeyNull) return -1;
+    for (int i = 0; i < (int)define::internalSpanSize && p_records[i].key != define::kkeyNull; ++ i) if (p_records[i].ptr == node_addr) {
+      left_addr = (i ? (GlobalAddress)p_records[i - 1].ptr : (GlobalAddress)parent->metadata.leftmost_ptr);
+      return i;
+    }
+    return -1;  // leftmost child, or the leaf is moved
+  };
+  GlobalAddress left_addr, locked_left_addr;
+  if (read_parent(left_addr) < 0) return;
+
+  // lock from left to right, and then the parent
+  auto left_lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
+  auto lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
+  auto parent_lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
+  lock_node(left_addr, left_lock_buffer, true, sink);
+  lock_node(node_addr, lock_buffer, true, sink);
+  lock_node(parent_addr, parent_lock_buffer, false, sink);
+  auto give_up = [&]() {
+    unlock_node(parent_addr, parent_lock_buffer, false, sink, true);
+    unlock_node(node_addr, lock_buffer, true, sink, true);
+    unlock_node(left_addr, left_lock_buffer, true, sink, true);
+  };
+  int sep_idx = read_parent(locked_left_addr);
+  if (sep_idx < 0 || locked_left_addr != left_addr) {
+    give_up();
+    return;
+  }
+
+  // read both leaves
+  auto read_leaf = [&](const GlobalAddress& leaf_addr, char* leaf_buffer) {
+    auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+    dsm->read_sync(raw_leaf_buffer, leaf_addr, define::transLeafSize, sink);
+    // no need to consistency check since the node is locked
+#ifdef METADATA_REPLICATION
+    auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+    assert((LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer)));
+    MetadataManager::decode_node_metadata(intermediate_leaf_buffer, leaf_buffer);
+#else
+    assert((VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer)));
+#endif
+  };
+  auto left_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto left = (LeafNode *)left_buffer;
+  auto leaf = (LeafNode *)leaf_buffer;
+  read_leaf(left_addr, left_buffer);
+  read_leaf(node_addr, leaf_buffer);
+  if (!left->metadata.is_valid(left_addr) || !leaf->metadata.is_valid(node_addr) || (GlobalAddress)left->metadata.sibling_ptr != node_addr) {
+    give_up();
+    return;
+  }
+
+  // collect the live entries; the null-valued max key of the right leaf still bounds the merged leaf
+  auto is_live = [](const LeafEntry& e) { return e.key != define::kkeyNull && e.value != define::kValueNull; };
+  int leaf_cnt = std::count_if(leaf->records, leaf->records + define::leafSpanSize, is_live);
+  int left_cnt = std::count_if(left->records, left->records + define::leafSpanSize, is_live);
+  if (leaf_cnt >= (int)define::leafMergeThreshold || left_cnt + leaf_cnt > (int)define::leafMergeCapacity) {
+    give_up();
+    return;
+  }
+  std::vector<LeafEntry> kvs;  // with the whole value fields
+  for (const auto& e : left->records) if (is_live(e)) kvs.emplace_back(e);
+  for (const auto& e : leaf->records) if (is_live(e)) kvs.emplace_back(e);
+#ifdef SIBLING_BASED_VALIDATION
+  auto max_e = std::max_element(leaf->records, leaf->records + define::leafSpanSize, [](const LeafEntry& a, const LeafEntry& b){ return a.key < b.key; });
+  if (max_e->key == define::kkeyNull) {
+    give_up();
+    return;
+  }
+  if (max_e->value == define::kValueNull) kvs.emplace_back(max_e->key, define::kValueNull);
+#endif
+
+  // rebuild the left leaf locally, keeping the versions
+  auto merged_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  memcpy(merged_buffer, left_buffer, sizeof(LeafNode));
+  auto merged = (LeafNode *)merged_buffer;
+  for (auto& e : merged->records) {
+    e.update(define::kkeyNull, define::kValueNull);
+#ifdef HOPSCOTCH_LEAF_NODE
+    e.hop_bitmap = 0;
+#endif
+  }
+#ifdef HOPSCOTCH_LEAF_NODE
+  for (const auto& e : kvs) {
+    int insert_idx = hopscotch_insert_locally(merged->records, e.key, e.value);
+    if (insert_idx < 0) {
+      give_up();
+      return;
+    }
+    merged->records[insert_idx].update(e);
+  }
+  fit_leaf_neighbor_size(merged);
+#else
+  for (int i = 0; i < (int)kvs.size(); ++ i) merged->records[i].update(kvs[i]);
+#endif
+  merged->metadata.sibling_ptr = leaf->metadata.sibling_ptr;
+  merged->metadata.fence_keys.highest = leaf->metadata.fence_keys.highest;
+
+  // 1. the left leaf covers both leaves
+  leaf_write_and_unlock(merged, left_addr, left_lock_buffer, sink);
+  // 2. route the keys of the leaf to the left leaf
+  for (int i = sep_idx; i < (int)define::internalSpanSize - 1; ++ i) p_records[i] = p_records[i + 1];
+  p_records[define::internalSpanSize - 1] = InternalEntry::Null();
+  node_write_and_unlock<InternalNode, InternalEntry, define::transInternalSize>(parent, parent_addr, parent_lock_buffer, sink);
+  cache_node(parent);
+  // 3. empty and invalidate the leaf, so that the stale readers will retry
+  for (auto& e : leaf->records) {
+    e.update(define::kkeyNull, define::kValueNull);
+#ifdef HOPSCOTCH_LEAF_NODE
+    e.hop_bitmap = 0;
+#endif
+  }
+  leaf->metadata.valid = 0;
+  reclaim_leaf_and_unlock(leaf, node_addr, lock_buffer, sink);
+  merge_node[dsm->getMyThreadID()] ++;
+  return;
+}
+
+
+/* Read a whole leaf without locking it, and count its live entries; return -1 if the leaf is invalid */
+int Tree::count_live_entries(const GlobalAddress& node_addr, CoroPull* sink) {
+  auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf = (LeafNode *)leaf_buffer;
+re_read:
+  dsm->read_sync(raw_leaf_buffer, node_addr, define::transLeafSize, sink);
+#ifdef METADATA_REPLICATION
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  if (!LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer)) {
+    read_leaf_retry[dsm->getMyThreadID()] ++;
+    goto re_read;
+  }
+  MetadataManager::decode_node_metadata(intermediate_leaf_buffer, leaf_buffer);
+#else
+  if (!VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer)) {
+    read_leaf_retry[dsm->getMyThreadID()] ++;
+    goto re_read;
+  }
+#endif
+  if (!leaf->metadata.is_valid(node_addr)) return -1;
+  return std::count_if(leaf->records, leaf->records + define::leafSpanSize, [](const LeafEntry& e){
+    return e.key != define::kkeyNull && e.value != define::kValueNull;
+  });
+}
+
+
+/*
+  A merged leaf can still be reached by stale pointers (e.g., the cached ones of other compute nodes). It is pushed to the retired
+  leaves of the tree, which are shared by all compute nodes, and reused by a later split with its incarnation bumped, so the stale
+  pointers, which carry a former incarnation, fail the leaf validation. The incarnation never wraps: a leaf whose incarnations
+  are used up is not reused. The emptied leaf keeps the link in its (key-less, hence never parsed) first two entries, i.e.,
+  the next head and the retire time.
+*/
+void Tree::reclaim_leaf_and_unlock(LeafNode* leaf, const GlobalAddress& node_addr, uint64_t* lock_buffer, CoroPull* sink) {
+  assert(!leaf->metadata.valid);
+  if (leaf->metadata.incarnation >= define::kMaxLeafIncarnation) {
+    leaf_write_and_unlock(leaf, node_addr, lock_buffer, sink);
+    return;
+  }
+  auto head_ptr = get_retired_leaf_head_ptr();
+  auto cas_buffer = (dsm->get_rbuf(sink)).get_cas_buffer();
+  auto encoded_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+#ifdef METADATA_REPLICATION
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+#endif
+  dsm->read_sync((char *)cas_buffer, head_ptr, sizeof(uint64_t), sink);
+  uint64_t head = *cas_buffer;
+  while (true) {
+    // link the leaf to the current head; the leaf is still locked, so the link is written without unlocking
+    leaf->records[0].update(define::kkeyNull, head);
+    leaf->records[1].update(define::kkeyNull, Timer::get_time_ns());
+#ifdef METADATA_REPLICATION
+    MetadataManager::encode_node_metadata((char *)leaf, intermediate_leaf_buffer);
+    LeafVersionManager::encode_node_versions(intermediate_leaf_buffer, encoded_leaf_buffer);
+#else
+    VersionManager<LeafNode, LeafEntry>::encode_node_versions((char *)leaf, encoded_leaf_buffer);
+#endif
+    dsm->write_sync(encoded_leaf_buffer, node_addr, define::transLeafSize, sink);
+    auto new_head = RetiredLeafHead(RetiredLeafHead(head).tag + 1, node_addr);
+    if (dsm->cas_sync(head_ptr, head, new_head, cas_buffer, sink)) break;
+    head = *cas_buffer;
+  }
+  unlock_node(node_addr, lock_buffer, true, sink);
+}
+
+
+/* Pop a retired leaf that has been unreachable for long enough, or allocate a new one; any compute node's split reuses the leaves */
+GlobalAddress Tree::alloc_leaf(CoroPull* sink) {
+  auto head_ptr = get_retired_leaf_head_ptr();
+  auto cas_buffer = (dsm->get_rbuf(sink)).get_cas_buffer();
+  dsm->read_sync((char *)cas_buffer, head_ptr, sizeof(uint64_t), sink);
+  uint64_t head = *cas_buffer;
+  auto leaf_addr = RetiredLeafHead(head).ptr();
+  if (leaf_addr == GlobalAddress::Null()) return dsm->alloc(define::allocationLeafSize);
+
+  auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf = (LeafNode *)leaf_buffer;
+  dsm->read_sync(raw_leaf_buffer, leaf_addr, define::transLeafSize, sink);
+#ifdef METADATA_REPLICATION
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  bool consistent = LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer);
+  if (consistent) MetadataManager::decode_node_metadata(intermediate_leaf_buffer, leaf_buffer);
+#else
+  bool consistent = VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer);
+#endif
+  // best-effort: an inconsistent or a recently retired head, or a lost race, falls back to a new leaf
+  if (!consistent || leaf->metadata.valid || leaf->records[1].value + define::kNodeReclaimDelay > Timer::get_time_ns()) {
+    return dsm->alloc(define::allocationLeafSize);
+  }
+  uint64_t next = leaf->records[0].value;
+  auto new_head = RetiredLeafHead(RetiredLeafHead(head).tag + 1, RetiredLeafHead(next).ptr());
+  if (!dsm->cas_sync(head_ptr, head, new_head, cas_buffer, sink)) return dsm->alloc(define::allocationLeafSize);
+  leaf_addr.incarnation = leaf->metadata.incarnation + 1;
+  return leaf_addr;
+}
+
+
+bool Tree::search(const Key &k, Value &v, CoroPull* sink) {
+  return search(k, nullptr, v, sink);
+}
+
+
+bool Tree::search(const Key &k, const std::string* full_key, Value &v, CoroPull* sink, ValueBytes* val_bytes) {
+  assert(dsm->is_register());
+  before_operation(sink);
+
+  // handover
+  bool search_res = false;
+  std::pair<bool, bool> lock_res = std::make_pair(false, false);
+  bool read_handover = false;
+
+  // cache
+  bool from_cache = false;
+  const TreeCacheEntry *cache_entry = nullptr;
+
+  // traversal
+  GlobalAddress p;
+  GlobalAddress sibling_p;
+  uint16_t level;
+  int retry_flag = FIRST_TRY;
+
+  try_read_op[dsm->getMyThreadID()] ++;
+
+#ifdef TREE_ENABLE_READ_DELEGATION
+  // the string keys sharing an inline key and the value bytes are not delegated, as the delegated results only carry a Value
+  if (full_key || val_bytes) lock_res = std::make_pair(false, true);
+  else lock_res = local_lock_table->acquire_local_read_lock(k, &busy_waiting_queue, sink, tree_id);
+  read_handover = (lock_res.first && !lock_res.second);
+#else
+  UNUSED(lock_res);
+#endif
+  if (read_handover) {
+    read_handover_num[dsm->getMyThreadID()]++;
+    goto search_finish;
+  }
+
+#ifdef TREE_ENABLE_CACHE
+  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
+  if (cache_entry) from_cache = true;
+#endif
+  if (!from_cache) {
+    auto e = get_root_ptr(sink);
+    p = e.ptr, sibling_p = GlobalAddress::Null(), level = e.level;
+  }
+  record_cache_hit_ratio(from_cache, level);
+  assert(level != 0);
+  v = define::kValueNull;
+
+next:
+  retry_cnt[dsm->getMyThreadID()][retry_flag] ++;
+  // read leaf node
+  if (level == 1) {
+    if (!leaf_node_search(p, sibling_p, k, v, from_cache ? cache_entry : nullptr, sink, val_bytes)) {  // return false if cache validation fail or the leaf is merged
+      if (cache_entry) tree_cache->invalidate(cache_entry);
+#ifdef CACHE_MORE_INTERNAL_NODE
+      cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
+      from_cache = cache_entry ? true : false;
+#else
+      from_cache = false;
+#endif
+      if (!from_cache) {
+        auto e = get_root_ptr(sink);
+        p = e.ptr, sibling_p = GlobalAddress::Null(), level = e.level;
+      }
+      retry_flag = INVALID_LEAF;
+      goto next;
+    }
+    search_res = (v != define::kValueNull);  // search finish
+#ifdef ENABLE_VAR_LEN_KV
+    assert(indirect_value || !full_key || full_key->size() <= define::keyLen);
+    assert(!indirect_value || !val_bytes);
+    if (search_res && indirect_value) {  // read the DataBlocks for the record of full_key
+      if (!search_data_chain(v, k, full_key, v, sink)) {  // a DataBlock is reused since the leaf was read
+        read_leaf_retry[dsm->getMyThreadID()] ++;
+        v = define::kValueNull;
+        goto next;
+      }
+      search_res = (v != define::kValueNull);  // false if only sharing the inline key
+    }
+#else
+    UNUSED(full_key);
+#endif
+    goto search_finish;
+  }
+  // traverse internal nodes
+  if (!internal_node_search(p, sibling_p, k, level, from_cache, sink)) {  // return false if cache validation fail
+    // cache invalidation
+    assert(from_cache);
+    tree_cache->invalidate(cache_entry);
+#ifdef CACHE_MORE_INTERNAL_NODE
+    cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
+    from_cache = cache_entry ? true : false;
+#else
+    from_cache = false;
+#endif
+    if (!from_cache) {
+      auto e = get_root_ptr(sink);
+      p = e.ptr, sibling_p = GlobalAddress::Null(), level = e.level;
+    }
+    retry_flag = INVALID_NODE;
+    goto next;
+  }
+  from_cache = false;
+  retry_flag = FIND_NEXT;
+  goto next;  // search next level
+
+search_finish:
+#ifdef TREE_ENABLE_READ_DELEGATION
+  local_lock_table->release_local_read_lock(k, lock_res, search_res, v, tree_id);  // handover the ret leaf addr
+#endif
+  return search_res;
+}
+
+
+#ifdef ENABLE_VAR_LEN_KV
+void Tree::insert(const std::string &k, Value v, CoroPull* sink) {
+  insert(str2key(k), &k, v, sink);
+}
+
+
+void Tree::update(const std::string &k, Value v, CoroPull* sink) {
+  update(str2key(k), &k, v, sink);
+}
+
+
+bool Tree::search(const std::string &k, Value &v, CoroPull* sink) {
+  return search(str2key(k), &k, v, sink);
+}
+
+
+void Tree::remove(const std::string &k, CoroPull* sink) {
+  remove(str2key(k), &k, sink);
+}
+
+
+void Tree::insert(const Key &k, const ValueBytes &v, CoroPull* sink) {
+  insert(k, nullptr, define::kValueNull, sink, &v);
+}
+
+
+void Tree::update(const Key &k, const ValueBytes &v, CoroPull* sink) {
+  update(k, nullptr, define::kValueNull, sink, &v);
+}
+
+
+bool Tree::search(const Key &k, ValueBytes &v, CoroPull* sink) {
+  Value raw_v;
+  return search(k, nullptr, raw_v, sink, &v);
+}
+
+
+bool Tree::range_query(const Key &from, const Key &to, std::vector<std::pair<Key, ValueBytes> > &ret, CoroPull* sink) {  // [from, to)
+  RangeBytesFunc bytes_func = [&ret](const Key& k, const ValueBytes& v){ ret.emplace_back(k, v); };
+  return range_scan(from, to, nullptr, to, false, sink, &bytes_func);
+}
+
+
+/* Write a DataBlock (including the rest of its keys) out-of-place */
+Value Tree::write_data_block(const DataBlock* data_block, CoroPull* sink, bool chained) {
+  auto block_len = data_block->size();
+  auto block_addr = block_allocator->alloc(block_len);
+  dsm->write_sync((const char *)data_block, block_addr, block_len, sink);
+  return (uint64_t)DataPointer(block_len, block_addr, data_block->version, chained);
+}
+
+
+/* Pack the records into a chain of DataBlocks, written from the tail so that each block links to a written one */
+Value Tree::write_data_chain(const Key& k, uint32_t version, const DataRecords& records, CoroPull* sink) {
+  std::vector<int> block_starts;  // [the id of the first record in each block]
+  uint64_t block_len = define::dataBlockMaxLen;
+  for (int i = 0; i < (int)records.size(); ++ i) {
+    auto full_key = &records[i].first;
+    auto record_len = DataBlock::record_size(full_key);
+    if (block_len + record_len > define::dataBlockMaxLen) block_starts.emplace_back(i), block_len = sizeof(DataBlock);
+    block_len += record_len;
+  }
+  Value next = define::kValueNull;
+  for (int b = (int)block_starts.size() - 1; b >= 0; -- b) {
+    auto data_block = new ((dsm->get_rbuf(sink)).get_block_buffer()) DataBlock(k, version);
+    data_block->next = next;
+    int end = (b + 1 < (int)block_starts.size() ? block_starts[b + 1] : records.size());
+    for (int i = block_starts[b]; i < end; ++ i) {
+      bool is_appended = data_block->append(&records[i].first, records[i].second);
+      assert(is_appended);
+      UNUSED(is_appended);
+    }
+    next = write_data_block(data_block, sink, next != define::kValueNull);
+  }
+  return next;
+}
+
+
+/* Read the whole chain of DataBlocks; the chain is stable since the leaf is locked */
+void Tree::read_data_chain(Value v, const Key& k, DataRecords* records, std::vector<Value>& blocks, CoroPull* sink) {
+  auto block_buffer = (dsm->get_rbuf(sink)).get_block_buffer();
+  while (v != define::kValueNull) {
+    auto data_ptr = (DataPointer *)&v;
+    blocks.emplace_back(v);
+    dsm->read_sync(block_buffer, (GlobalAddress)data_ptr->ptr, data_ptr->data_len, sink);
+    auto data_block = (DataBlock *)block_buffer;
+    if (records) {
+      const DataRecord* r = data_block->first_record();
+      for (uint32_t i = 0; i < data_block->record_num; ++ i, r = DataBlock::next_record(r)) records->emplace_back(r->get_key(k), (Value)r->value);
+    }
+    v = data_block->next;
+  }
+}
+
+
+/*
+  Write the DataBlocks of k out-of-place with the record of full_key upserted, or erased if v is kValueNull.
+  A string key keeps the records of the other keys sharing its inline key, while the Key API (i.e., a null full_key) replaces them all.
+  Return the new DataPointer value (kValueNull if no record is left, or old_v if nothing changes), with the superseded blocks in old_blocks.
+*/
+Value Tree::write_data_records(const Key& k, const std::string* full_key, Value v, Value old_v, std::vector<Value>& old_blocks, CoroPull* sink) {
+  DataRecords records;
+  if (old_v != define::kValueNull) {
+    if (full_key) read_data_chain(old_v, k, &records, old_blocks, sink);
+    else if (((DataPointer *)&old_v)->chained) read_data_chain(old_v, define::kkeyNull, nullptr, old_blocks, sink);
+    else old_blocks.emplace_back(old_v);
+    if (!full_key) records.clear();
+  }
+  auto key = (full_key ? *full_key : std::string((const char *)k.data(), define::keyLen));
+  auto it = std::lower_bound(records.begin(), records.end(), key, [](const std::pair<std::string, Value>& r, const std::string& key){ return r.first < key; });
+  bool is_found = (it != records.end() && it->first == key);
+  if (v == define::kValueNull) {
+    if (!is_found) {
+      old_blocks.clear();
+      return old_v;
+    }
+    records.erase(it);
+  }
+  else if (is_found) it->second = v;
+  else records.insert(it, std::make_pair(key, v));
+  return write_data_chain(k, DataBlock::next_version(old_v), records, sink);
+}
+
+
+/*
+  Search the chain of DataBlocks of k for the record of full_key (the first record for the Key API), ret is kValueNull if not found.
+  Return false if a block is reused since the leaf was read, i.e., the leaf should be read again.
+*/
+bool Tree::search_data_chain(Value v, const Key& k, const std::string* full_key, Value& ret, CoroPull* sink) {
+  auto block_buffer = (dsm->get_rbuf(sink)).get_block_buffer();
+  ret = define::kValueNull;
+  while (v != define::kValueNull) {
+    auto data_ptr = (DataPointer *)&v;
+    dsm->read_sync(block_buffer, (GlobalAddress)data_ptr->ptr, data_ptr->data_len, sink);
+    auto data_block = (const DataBlock *)block_buffer;
+    if (!data_block->is_stamped(k, v)) return false;
+    auto r = (full_key ? data_block->find(full_key) : data_block->first_record());
+    if (r) {
+      ret = r->value;
+      return true;
+    }
+    v = data_block->next;
+  }
+  return true;
+}
+
+
+/* The DataBlock is unlinked from the leaf by a write, and is reused after the in-flight readers finish */
+void Tree::retire_data_block(Value v) {
+  if (v == define::kValueNull) return;  // e.g., the null-valued max key
+  auto [block_len, block_addr] = (std::pair<uint64_t, GlobalAddress>)*(DataPointer *)&v;
+  block_allocator->retire(block_addr, block_len);
+}
+
+
+void Tree::retire_data_chain(Value v, CoroPull* sink) {
+  if (v == define::kValueNull) return;
+  std::vector<Value> blocks{v};
+  if (((DataPointer *)&v)->chained) blocks.clear(), read_data_chain(v, define::kkeyNull, nullptr, blocks, sink);
+  for (auto block : blocks) retire_data_block(block);
+}
+#endif
+
+
+/*
+  Batched search: values[i] is set to kValueNull if keys[i] is not found
+  Keys are located through the cached level-1 nodes and grouped by leaves. The hop segments (or speculative entries) of
+  each leaf are merged and fetched via doorbell batching, i.e., one batch per memory node in each round.
+  Keys that miss the cache or fail the validation fall back to search().
+*/
+void Tree::multi_search(const std::vector<Key> &keys, std::vector<Value> &values, CoroPull* sink) {
+  assert(dsm->is_register());
+  values.assign(keys.size(), define::kValueNull);
+#if (defined TREE_ENABLE_CACHE && defined HOPSCOTCH_LEAF_NODE && defined METADATA_REPLICATION)
+  before_operation(sink);
+  auto tid = dsm->getMyThreadID();
+
+  struct Target {
+    int key_id;
+    GlobalAddress sibling_addr;
+    int speculative_idx;  // -1 if the hop segment should be read
+  };
+  std::map<GlobalAddress, std::vector<Target> > leaf_targets;
+  std::vector<int> fallback_ids;
+  std::vector<int> found_ids;
+
+  // locate leaves from cache
+  for (int i = 0; i < (int)keys.size(); ++ i) {
+    GlobalAddress p;
+    GlobalAddress sibling_p;
+    uint16_t level;
+    if (!tree_cache->search_from_cache(keys[i], p, sibling_p, level, tree_id) || level != 1) {
+      fallback_ids.emplace_back(i);
+      continue;
+    }
+    try_read_op[tid] ++;
+    record_cache_hit_ratio(true, level);
+    int speculative_idx = -1;
+#ifdef SPECULATIVE_READ
+    int hash_idx = LeafHashScheme::get_home_index(keys[i]);
+    if (idx_cache->search_idx_from_cache(p, hash_idx, (hash_idx + neighbor_size) % define::leafSpanSize, keys[i], speculative_idx)) {
+      try_speculative_read[tid] ++;
+    }
+    else speculative_idx = -1;
+#endif
+    leaf_targets[p].emplace_back(Target{i, sibling_p, speculative_idx});
+  }
+
+  // the leaves (and then the DataBlocks) are read one window at a time, so that the range buffer usage is bounded
+  auto range_buffer = (dsm->get_rbuf(sink)).get_range_buffer();
+  assert((dsm->get_rbuf(sink)).is_safe(range_buffer + define::rangeWindowSize));
+  const int window_leaf_num = define::rangeWindowSize / define::allocationLeafSize;
+  std::vector<RdmaOpRegion> rs;
+  std::vector<std::vector<std::pair<int, int> > > leaf_segments;  // [leaf_id, [l_idx, r_idx) * N]
+  while (!leaf_targets.empty()) {
+    std::map<GlobalAddress, std::vector<Target> > window_targets;
+    while (!leaf_targets.empty() && (int)window_targets.size() < window_leaf_num) window_targets.insert(leaf_targets.extract(leaf_targets.begin()));
+    // generate read segments
+    rs.clear();
+    leaf_segments.clear();
+    int leaf_cnt = 0;
+    for (const auto& [leaf_addr, targets] : window_targets) {
+      std::vector<std::pair<int, int> > segments;
+      for (const auto& t : targets) {
+        try_read_leaf[tid] ++;
+        // a speculative entry is read with a metadata replica as well, which validates the cached leaf as the hop segment does
+        int l_idx = (t.speculative_idx >= 0 ? t.speculative_idx : LeafHashScheme::get_home_index(keys[t.key_id]));
+        int entry_num = cover_scattered_metadata(l_idx, t.speculative_idx >= 0 ? 1 : neighbor_size);
+        if (l_idx + entry_num <= (int)define::leafSpanSize) segments.emplace_back(std::make_pair(l_idx, l_idx + entry_num));
+        else {
+          segments.emplace_back(std::make_pair(l_idx, (int)define::leafSpanSize));
+          segments.emplace_back(std::make_pair(0,  entry_num - ((int)define::leafSpanSize - l_idx)));
+        }
+      }
+      // merge the overlapped segments
+      std::sort(segments.begin(), segments.end());
+      std::vector<std::pair<int, int> > merged_segments;
+      for (const auto& seg : segments) {
+        if (!merged_segments.empty() && seg.first <= merged_segments.back().second) merged_segments.back().second = std::max(merged_segments.back().second, seg.second);
+        else merged_segments.emplace_back(seg);
+      }
+      for (const auto& [l_idx, r_idx] : merged_segments) {
+        auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx);
+        RdmaOpRegion r;
+        r.source     = (uint64_t)range_buffer + leaf_cnt * define::allocationLeafSize + raw_offset;
+        r.dest       = (leaf_addr + raw_offset).to_uint64();
+        r.size       = raw_len;
+        r.is_on_chip = false;
+        rs.push_back(r);
+      }
+      leaf_segments.emplace_back(merged_segments);
+      ++ leaf_cnt;
+    }
+    // batch read
+    dsm->read_batches_sync(rs, sink);
+
+    // parse read leaf segments
+    std::map<GlobalAddress, std::vector<Target> > next_targets;
+    int leaf_id = 0;
+    for (const auto& [leaf_addr, targets] : window_targets) {
+      auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+      auto leaf = (LeafNode *)leaf_buffer;
+      LeafMetadata metadata;
+      bool has_metadata = false;
+      bool is_consistent = true;
+      for (const auto& [l_idx, r_idx] : leaf_segments[leaf_id]) {
+        auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx);
+        auto raw_buffer = range_buffer + leaf_id * define::allocationLeafSize + raw_offset;
+        auto intermediate_buffer = (dsm->get_rbuf(sink)).get_segment_buffer();
+        auto [first_metadata_offset, new_len] = MetadataManager::get_offset_info(l_idx, r_idx - l_idx);
+        uint8_t segment_node_versions = 0;
+        if (!LeafVersionManager::decode_segment_versions(raw_buffer, intermediate_buffer, first_offset, r_idx - l_idx, first_metadata_offset, new_len, segment_node_versions)) {
+          is_consistent = false;
+          break;
+        }
+        LeafMetadata segment_metadata;
+        if (MetadataManager::decode_segment_metadata(intermediate_buffer, (char*)&(leaf->records[l_idx]), first_metadata_offset, r_idx - l_idx, segment_metadata)) {
+          metadata = segment_metadata;
+          has_metadata = true;
+        }
+      }
+      ++ leaf_id;
+      if (!is_consistent) {  // re-read the whole batch of this leaf
+        read_leaf_retry[tid] ++;
+        next_targets[leaf_addr] = targets;
+        continue;
+      }
+      for (const auto& t : targets) {
+        const auto& k = keys[t.key_id];
+        // cache validation
+#ifdef SIBLING_BASED_VALIDATION
+        auto sibling_ptr = (metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)metadata.sibling_ptr);
+        bool is_valid = has_metadata && metadata.is_valid(leaf_addr) && t.sibling_addr == sibling_ptr;
+#else
+        bool is_valid = has_metadata && metadata.is_valid(leaf_addr) && k >= metadata.fence_keys.lowest && k < metadata.fence_keys.highest;
+#endif
+        if (!is_valid) {  // cache is outdated
+          leaf_cache_invalid[tid] ++;
+          fallback_ids.emplace_back(t.key_id);
+          continue;
+        }
+        if (t.speculative_idx >= 0) {
+          if (leaf->records[t.speculative_idx].key == k) {
+            correct_speculative_read[tid] ++;
+            values[t.key_id] = leaf->records[t.speculative_idx].value;
+            if (values[t.key_id] != define::kValueNull) found_ids.emplace_back(t.key_id);
+#ifdef SPECULATIVE_READ
+            idx_cache->add_to_cache(leaf_addr, t.speculative_idx, k);
+#endif
+          }
+          else next_targets[leaf_addr].emplace_back(Target{t.key_id, t.sibling_addr, -1});
+          continue;
+        }
+        // check hopping consistency && search key from the segment
+        int hash_idx = LeafHashScheme::get_home_index(k);
+        uint16_t hop_bitmap = 0;
+        bool is_found = false;
+        for (int j = 0; j < neighbor_size && !is_found; ++ j) {
+          int idx = (hash_idx + j) % define::leafSpanSize;
+          const auto& e = leaf->records[idx];
+          if (e.key != define::kkeyNull && (int)LeafHashScheme::get_home_index(e.key) == hash_idx) {
+            hop_bitmap |= 1ULL << (define::neighborSize - j - 1);
+            if (e.key == k) {
+              is_found = true;
+              values[t.key_id] = e.value;
+              if (e.value != define::kValueNull) found_ids.emplace_back(t.key_id);
+#ifdef SPECULATIVE_READ
+              idx_cache->add_to_cache(leaf_addr, idx, k);
+#endif
+            }
+          }
+        }
+        if (!is_found && hop_bitmap != leaf->records[hash_idx].hop_bitmap) {
+          read_leaf_retry[tid] ++;
+          next_targets[leaf_addr].emplace_back(Target{t.key_id, t.sibling_addr, -1});
+        }
+      }
+    }
+    // the re-read leaves join a later window
+    for (auto& [leaf_addr, targets] : next_targets) {
+      auto& pending = leaf_targets[leaf_addr];
+      pending.insert(pending.end(), targets.begin(), targets.end());
+    }
+  }
+#ifdef ENABLE_VAR_LEN_KV
+  if (indirect_value) {  // read DataBlocks via doorbell batching
+    const int window_block_num = define::rangeWindowSize / define::dataBlockLen;
+    for (int l = 0; l < (int)found_ids.size(); l += window_block_num) {
+      int r = std::min(l + window_block_num, (int)found_ids.size());
+      rs.clear();
+      for (int j = l; j < r; ++ j) {
+        auto data_addr = ((DataPointer*)&values[found_ids[j]])->ptr;
+        RdmaOpRegion kv_r;
+        kv_r.source     = (uint64_t)range_buffer + (j - l) * define::dataBlockLen;
+        kv_r.dest       = ((GlobalAddress)data_addr).to_uint64();
+        kv_r.size       = define::dataBlockLen;  // the first record without the rest of its key
+        kv_r.is_on_chip = false;
+        rs.push_back(kv_r);
+      }
+      dsm->read_batches_sync(rs, sink);
+      for (int j = l; j < r; ++ j) {
+        int key_id = found_ids[j];
+        auto data_block = (DataBlock*)(range_buffer + (j - l) * define::dataBlockLen);
+        if (data_block->is_stamped(keys[key_id], values[key_id])) values[key_id] = data_block->first_record()->value;
+        else fallback_ids.emplace_back(key_id);  // the DataBlock is reused since the leaf was read
+      }
+    }
+  }
+#else
+  UNUSED(found_ids);
+#endif
+  for (int key_id : fallback_ids) search(keys[key_id], values[key_id], sink);
+#else
+  for (int i = 0; i < (int)keys.size(); ++ i) search(keys[i], values[i], sink);
+#endif
+  return;
+}
+
+
+void Tree::leaf_entry_read(const GlobalAddress& leaf_addr, const int idx, char *raw_leaf_buffer, char *leaf_buffer, CoroPull* sink, bool for_write) {
+  auto leaf = (LeafNode *)leaf_buffer;
+#ifdef METADATA_REPLICATION
+  auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(idx);
+  auto raw_entry_buffer = raw_leaf_buffer + raw_offset;
+re_read:
+  dsm->read_sync(raw_entry_buffer, leaf_addr + raw_offset, raw_len, sink);
+  uint8_t entry_node_version = 0;
+  auto intermediate_entry_buffer = (dsm->get_rbuf(sink)).get_segment_buffer();
+  auto [first_metadata_offset, new_len] = MetadataManager::get_offset_info(idx);
+  if (for_write) assert((LeafVersionManager::decode_segment_versions(raw_entry_buffer, intermediate_entry_buffer, first_offset, 1, first_metadata_offset, new_len, entry_node_version)));
+  else if (!LeafVersionManager::decode_segment_versions(raw_entry_buffer, intermediate_entry_buffer, first_offset, 1, first_metadata_offset, new_len, entry_node_version)) {
+    goto re_read;
+  }
+  MetadataManager::decode_segment_metadata(intermediate_entry_buffer, (char*)&(leaf->records[idx]), first_metadata_offset, 1, leaf->metadata);
+  return;
+#else
+  auto [raw_offset, raw_len, first_offset] = VersionManager<LeafNode, LeafEntry>::get_offset_info(idx);
+  auto raw_entry_buffer = raw_leaf_buffer + raw_offset;
+re_read:
+  // read metadata and the hop segment
+  std::vector<RdmaOpRegion> rs(2);
+  rs[0].source = (uint64_t)raw_leaf_buffer;
+  rs[0].dest = leaf_addr.to_uint64();
+  rs[0].size = define::bufferMetadataSize;  // header
+  rs[0].is_on_chip = false;
+
+  rs[1].source = (uint64_t)raw_entry_buffer;
+  rs[1].dest = (leaf_addr + raw_offset).to_uint64();
+  rs[1].size = raw_len;
+  rs[1].is_on_chip = false;
+  // note that the rs array will change by lower-level function
+  dsm->read_batch_sync(&rs[0], 2, sink);
+  uint8_t metadata_node_version = 0, entry_node_version = 0;
+  if (for_write) {  // for locked node, consistency check is not needed
+    assert((VersionManager<LeafNode, LeafEntry>::decode_header_versions(raw_leaf_buffer, leaf_buffer, metadata_node_version)));
+    assert((VersionManager<LeafNode, LeafEntry>::decode_segment_versions(raw_entry_buffer, (char*)&(leaf->records[idx]), first_offset, 1, entry_node_version)));
+    assert(metadata_node_version == entry_node_version);
+    return;
+  }
+  // consistency check; note that: (segment_size_l > 0) => there are two segments
+  if (!VersionManager<LeafNode, LeafEntry>::decode_header_versions(raw_leaf_buffer, leaf_buffer, metadata_node_version) ||
+      !VersionManager<LeafNode, LeafEntry>::decode_segment_versions(raw_entry_buffer, (char*)&(leaf->records[idx]), first_offset, 1, entry_node_version) ||
+      metadata_node_version != entry_node_version) {
+    goto re_read;
+  }
+#endif
+  return;
+}
+
+
+#ifdef SPECULATIVE_READ
+bool Tree::speculative_read(const GlobalAddress& leaf_addr, std::pair<int, int> range, char *raw_leaf_buffer, char *leaf_buffer, const Key &k, Value &v,
+                            int& speculative_idx, CoroPull* sink, bool for_write, ValueBytes* val_bytes) {
+  auto leaf = (LeafNode *)leaf_buffer;
+  if (idx_cache->search_idx_from_cache(leaf_addr, range.first, range.second, k, speculative_idx)) {
+    // read entry
+    try_speculative_read[dsm->getMyThreadID()] ++;
+    leaf_entry_read(leaf_addr, speculative_idx, raw_leaf_buffer, leaf_buffer, sink, for_write);
+    const auto& entry = leaf->records[speculative_idx];
+    if (entry.key == k) {
+      correct_speculative_read[dsm->getMyThreadID()] ++;
+      v = entry.value;
+      if (val_bytes) *val_bytes = entry.get_value_bytes();
+      idx_cache->add_to_cache(leaf_addr, speculative_idx, k);
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+
+/* Decode a leaf read into raw_leaf_buffer; return false if the read is torn by a concurrent write */
+bool Tree::leaf_node_decode(char *raw_leaf_buffer, LeafNode *leaf, CoroPull* sink) {
+  // check versions consistency
+#ifdef METADATA_REPLICATION
+  auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  bool is_ok = LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer);
+  if (is_ok) MetadataManager::decode_node_metadata(intermediate_leaf_buffer, (char *)leaf);
+#else
+  bool is_ok = VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, (char *)leaf);
+#endif
+#ifdef HOPSCOTCH_LEAF_NODE
+  // check hopping consistency
+  const auto& records = leaf->records;
+  for (int j = 0; j < (int)define::leafSpanSize && is_ok; ++ j) {
+    uint16_t hop_bitmap = 0;
+    for (int z = 0; z < neighbor_size; ++ z) {
+      const auto& e = records[(j + z) % define::leafSpanSize];
+      if (e.key != define::kkeyNull && (int)LeafHashScheme::get_home_index(e.key) == j) {
+        hop_bitmap |= 1ULL << (define::neighborSize - z - 1);
+      }
+    }
+    if (hop_bitmap != records[j].hop_bitmap) is_ok = false;
+  }
+#endif
+  return is_ok;
+}
+
+
+/* Get the address of the leaf surrounding k; a cached parent pointing to invalid_leaf (e.g., a merged leaf) is outdated */
+GlobalAddress Tree::locate_leaf(const Key &k, CoroPull* sink, const GlobalAddress& invalid_leaf) {
+  bool from_cache = false;
+  const TreeCacheEntry *cache_entry = nullptr;
+  GlobalAddress p;
+  GlobalAddress sibling_p;
+  uint16_t level;
+
+#ifdef TREE_ENABLE_CACHE
+  cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
+  if (cache_entry && level == 1 && p == invalid_leaf) {
+    tree_cache->invalidate(cache_entry);
+    cache_entry = nullptr;
+  }
+  if (cache_entry) from_cache = true;
+#endif
+  if (!from_cache) {
+    auto e = get_root_ptr(sink);
+    p = e.ptr, sibling_p = GlobalAddress::Null(), level = e.level;
+  }
+  record_cache_hit_ratio(from_cache, level);
+  assert(level != 0);
+
+  // traverse internal nodes
+  while (level != 1) {
+    if (!internal_node_search(p, sibling_p, k, level, from_cache, sink)) {  // return false if cache validation fail
+      assert(from_cache);
+      tree_cache->invalidate(cache_entry);
+      auto e = get_root_ptr(sink);
+      p = e.ptr, sibling_p = GlobalAddress::Null(), level = e.level;
+    }
+    from_cache = false;
+  }
+  return p;
+}
+
+
+bool Tree::leaf_node_search(const GlobalAddress& node_addr, const GlobalAddress& sibling_addr, const Key &k, Value &v, const TreeCacheEntry *cache_entry, CoroPull* sink,
+                            ValueBytes* val_bytes) {
+  try_read_leaf[dsm->getMyThreadID()] ++;
+  bool from_cache = (cache_entry != nullptr);
+  auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+  auto leaf = (LeafNode *)leaf_buffer;
+#ifdef HOPSCOTCH_LEAF_NODE
+  int hash_idx = LeafHashScheme::get_home_index(k);
+#ifdef SPECULATIVE_READ
+  int speculative_idx;
+  if (speculative_read(node_addr, std::make_pair(hash_idx, (hash_idx + neighbor_size) % define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, v, speculative_idx, sink, false, val_bytes)) {
+    UNUSED(speculative_idx);
+    return true;
+  }
+#endif
+  int read_entry_num = get_neighbor_hint(cache_entry, k, node_addr);
+re_read:
+  hopscotch_search(node_addr, hash_idx, raw_leaf_buffer, leaf_buffer, sink, read_entry_num);
+  set_neighbor_hint(cache_entry, k, node_addr, get_leaf_neighbor_size(leaf));
+#else
+#ifdef SPECULATIVE_READ
   int speculative_idx;
-  if (speculative_read(node_addr, std::make_pair(0, define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, v, speculative_idx, sink)) {
+  if (speculative_read(node_addr, std::make_pair(0, define::leafSpanSize), raw_leaf_buffer, leaf_buffer, k, v, speculative_idx, sink, false, val_bytes)) {
     UNUSED(speculative_idx);
     return true;
   }
@@ -1845,7 +3387,7 @@ re_read:
 #ifdef SIBLING_BASED_VALIDATION
   const auto& sibling_ptr = (leaf->metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)leaf->metadata.sibling_ptr);
   // cache validation
-  if (from_cache && (!leaf->metadata.valid || sibling_addr != sibling_ptr)) {  // cache is outdated
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && sibling_addr != sibling_ptr)) {  // invalid || cache is outdated
     leaf_cache_invalid[dsm->getMyThreadID()] ++;
     return false;
   }
@@ -1853,7 +3395,7 @@ re_read:
   UNUSED(sibling_addr);
   // cache validation
   const auto& fence_keys = leaf->metadata.fence_keys;
-  if (from_cache && (!leaf->metadata.valid || k < fence_keys.lowest || k >= fence_keys.highest)) {  // cache is outdated
+  if (!leaf->metadata.is_valid(node_addr) || (from_cache && (k < fence_keys.lowest || k >= fence_keys.highest))) {  // invalid || cache is outdated
     leaf_cache_invalid[dsm->getMyThreadID()] ++;
     return false;
   }
@@ -1861,7 +3403,7 @@ re_read:
   if (k >= fence_keys.highest) {  // should turn right
     assert(leaf->metadata.sibling_ptr != GlobalAddress::Null());
     leaf_read_sibling[dsm->getMyThreadID()] ++;
-    leaf_node_search(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, false, sink);
+    leaf_node_search(leaf->metadata.sibling_ptr, GlobalAddress::Null(), k, v, nullptr, sink, val_bytes);
     return true;
   }
   assert(k >= fence_keys.lowest);
@@ -1872,12 +3414,13 @@ re_read:
 #ifdef HOPSCOTCH_LEAF_NODE
   // check hopping consistency && search key from the segments
   uint16_t hop_bitmap = 0;
-  for (int i = 0; i < (int)define::neighborSize; ++ i) {
+  for (int i = 0; i < read_entry_num; ++ i) {
     const auto& e = records[(hash_idx + i) % define::leafSpanSize];
-    if (e.key != define::kkeyNull && (int)get_hashed_leaf_entry_index(e.key) == hash_idx) {
+    if (e.key != define::kkeyNull && (int)LeafHashScheme::get_home_index(e.key) == hash_idx) {
       hop_bitmap |= 1ULL << (define::neighborSize - i - 1);
       if (e.key == k) {  // optimization: if the target key is found, consistency check can be stopped
         v = e.value;
+        if (val_bytes) *val_bytes = e.get_value_bytes();
 #ifdef SPECULATIVE_READ
         idx_cache->add_to_cache(node_addr, (hash_idx + i) % define::leafSpanSize, k);
 #endif
@@ -1885,6 +3428,11 @@ re_read:
       }
     }
   }
+  if (read_entry_num < neighbor_size && (records[hash_idx].hop_bitmap & ((1ULL << (define::neighborSize - read_entry_num)) - 1))) {  // the keys hashed to hash_idx lie beyond the read range
+    read_wider_neighborhood[dsm->getMyThreadID()] ++;
+    read_entry_num = neighbor_size;
+    goto re_read;
+  }
   if (hop_bitmap != records[hash_idx].hop_bitmap) {
     read_leaf_retry[dsm->getMyThreadID()] ++;
     goto re_read;
@@ -1894,6 +3442,7 @@ re_read:
     const auto& e = records[i];
     if (e.key == k) {
       v = e.value;
+      if (val_bytes) *val_bytes = e.get_value_bytes();
 #ifdef SPECULATIVE_READ
       idx_cache->add_to_cache(node_addr, i, k);
 #endif
@@ -1903,10 +3452,9 @@ re_read:
 #endif
 #ifdef SIBLING_BASED_VALIDATION
   // turn right check
-  if (v == define::kValueNull && sibling_addr != sibling_ptr) {  // search sibling node
-    assert(sibling_ptr != GlobalAddress::Null());
+  if (v == define::kValueNull && sibling_addr != sibling_ptr && sibling_ptr != GlobalAddress::Null()) {  // search sibling node (the expected sibling may have been merged)
     leaf_read_sibling[dsm->getMyThreadID()] ++;
-    leaf_node_search(sibling_ptr, sibling_addr, k, v, false, sink);
+    leaf_node_search(sibling_ptr, sibling_addr, k, v, nullptr, sink, val_bytes);
     return true;
   }
 #endif
@@ -1917,72 +3465,184 @@ re_read:
 
 /*
   range query
-  DO NOT support coroutines currently
   SHOULD be called with other tree optimizations (e.g., HOPSCOTCH_LEAF_NODE, METADATA_REPLICATION) turned on
 */
-bool Tree::range_query(const Key &from, const Key &to, std::map<Key, Value> &ret) {  // [from, to)
+bool Tree::range_query(const Key &from, const Key &to, std::map<Key, Value> &ret, CoroPull* sink) {  // [from, to)
+  return range_query(from, to, [&ret](const Key& k, Value v){ ret[k] = v; }, sink);
+}
+
+
+bool Tree::range_query(const Key &from, const Key &to, std::vector<std::pair<Key, Value> > &ret, bool sorted, CoroPull* sink) {  // [from, to)
+  auto old_size = ret.size();
+  auto res = range_query(from, to, [&ret](const Key& k, Value v){ ret.emplace_back(k, v); }, sink);
+  if (sorted) {
+    std::sort(ret.begin() + old_size, ret.end(), [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){
+      return a.first < b.first;
+    });
+  }
+  return res;
+}
+
+
+bool Tree::range_query(const Key &from, const Key &to, const RangeFunc& func, CoroPull* sink) {  // [from, to)
+  return range_scan(from, to, func, to, false, sink);
+}
+
+
+void Tree::scan_aggregate(const Key &from, const Key &to, Aggregator &agg, CoroPull* sink) {  // [from, to)
+  range_scan(from, to, [&agg](const Key& k, Value v){ agg.add(k, v); }, to, false, sink);
+}
+
+
+void Tree::scan_filter(const Key &from, const Key &to, const ScanPredicate& pred, uint64_t limit,
+                       std::vector<std::pair<Key, Value> > &ret, CoroPull* sink) {  // [from, to)
+  if (limit == 0) return;
+  // keep the `limit` smallest matched keys; the largest one bounds the leaves that can still contribute
+  auto cmp = [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){ return a.first < b.first; };
+  std::priority_queue<std::pair<Key, Value>, std::vector<std::pair<Key, Value> >, decltype(cmp)> matched(cmp);
+  Key cutoff = to;
+  range_scan(from, to, [&](const Key& k, Value v){
+    if (!pred(k, v)) return;
+    matched.push(std::make_pair(k, v));
+    if (matched.size() > limit) matched.pop();
+    if (matched.size() == limit) cutoff = matched.top().first;
+  }, cutoff, false, sink);
+  auto old_size = ret.size();
+  for (; !matched.empty(); matched.pop()) ret.emplace_back(matched.top());
+  std::reverse(ret.begin() + old_size, ret.end());
+}
+
+
+void Tree::reverse_range_query(const Key &from, const Key &to, uint64_t limit,
+                               std::vector<std::pair<Key, Value> > &ret, CoroPull* sink) {  // [from, to)
+  if (limit == 0) return;
+  // keep the `limit` largest keys; the smallest one bounds the predecessor leaves that can still contribute
+  auto cmp = [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){ return a.first > b.first; };
+  std::priority_queue<std::pair<Key, Value>, std::vector<std::pair<Key, Value> >, decltype(cmp)> kept(cmp);
+  Key cutoff = from;
+  range_scan(from, to, [&](const Key& k, Value v){
+    kept.push(std::make_pair(k, v));
+    if (kept.size() > limit) kept.pop();
+    if (kept.size() == limit) cutoff = kept.top().first;
+  }, cutoff, true, sink);
+  auto old_size = ret.size();
+  for (; !kept.empty(); kept.pop()) ret.emplace_back(kept.top());
+  std::reverse(ret.begin() + old_size, ret.end());
+}
+
+
+/* records on the needed side of cutoff (i.e., below it, or not below it if reverse) are handed to func while the leaf segments are decoded,
+   without any intermediate container; leaves are visited in key order (descending if reverse), so moving cutoff skips the leaves not read yet */
+bool Tree::range_scan(const Key &from, const Key &to, const RangeFunc& func, const Key &cutoff, bool reverse, CoroPull* sink,
+                      const RangeBytesFunc* bytes_func) {  // [from, to)
   assert(dsm->is_register());
-  before_operation(nullptr);
+  before_operation(sink);
 
-  thread_local std::vector<InternalNode> cache_search_result;
-  thread_local std::set<GlobalAddress> leaf_addrs;
-  thread_local std::map<GlobalAddress, FenceKeys> leaf_fences;
-  thread_local std::vector<RdmaOpRegion> rs;
+  std::vector<InternalNode> cache_search_result;
+  std::set<GlobalAddress> leaf_addrs;  // the leaves discovered so far
+  std::vector<RdmaOpRegion> rs;
 #ifdef FINE_GRAINED_RANGE_QUERY
   using InfoMap = std::map<uint64_t, std::vector<std::tuple<int, int, GlobalAddress, uint64_t, uint64_t, uint64_t> > >;
-  thread_local InfoMap leaf_info;  // [leaf_id, (hash_idx, seg_size, leaf_addr, raw_offset, raw_len, first_offset) * N]
+  InfoMap leaf_info;  // [leaf_id, (hash_idx, seg_size, leaf_addr, raw_offset, raw_len, first_offset) * N]
 #ifdef SPECULATIVE_READ
-  thread_local std::vector<Key> speculative_keys;
-  speculative_keys.clear();
+  std::set<Key> speculative_keys;  // speculatively read keys that are not found yet
+  uint64_t speculative_num = 0;
+  bool speculative_checked = false;
+  int retry_leaf_start = std::numeric_limits<int>::max();  // leaf ids of the re-read neighborhoods of missed speculative keys
+  std::vector<LeafEntry> searched_records;
 #endif
 #else
   using InfoMap = std::map<uint64_t, GlobalAddress>;
-  thread_local InfoMap leaf_info;  // [leaf_id, leaf_addr]
+  InfoMap leaf_info;  // [leaf_id, leaf_addr]
 #endif
-  cache_search_result.clear();
-  leaf_addrs.clear();
-  leaf_fences.clear();
-  rs.clear();
-  leaf_info.clear();
-  tree_cache->search_range_from_cache(from, to, cache_search_result);
-
-  // FIXME: for simplicity, we assume all innernal nodes are cached in compute node like Sherman
-  if (cache_search_result.empty()) {
-    for(auto k = from; k < to; k = k + 1) {
-      cache_miss[dsm->getMyThreadID()] ++;
-      search(k, ret[k]);  // load into cache
-    }
-    return false;
-  }
-  // parse cached internal nodes
-  for (const auto& node : cache_search_result) {
-    const auto& metadata = node.metadata;
-    assert(metadata.level == 1);
-    const auto& records = node.records;
-    bool no_fetch = from >= records[0].key || to <= metadata.fence_keys.lowest;
-    if (!no_fetch) {
-      leaf_addrs.insert(metadata.leftmost_ptr);
-      leaf_fences[metadata.leftmost_ptr] = FenceKeys(metadata.fence_keys.lowest, records[0].key);
-    }
-    int i;
-    for (i = 1; i <= (int)define::internalSpanSize; ++ i) {
-      if (i == (int)define::internalSpanSize || records[i].key == define::kkeyNull) {
-        no_fetch = from >= metadata.fence_keys.highest || to <= records[i - 1].key;
-        if (!no_fetch) {
-          leaf_addrs.insert(records[i - 1].ptr);
-          leaf_fences[records[i - 1].ptr] = FenceKeys(records[i - 1].key, metadata.fence_keys.highest);
-        }
-        break;
+  auto is_needed = [&](const Key& k) { return reverse ? k >= cutoff : k < cutoff; };
+  std::vector<Key> leaf_nearest;  // [leaf_id, first key to read in the scan order]
+  auto range_buffer = (dsm->get_rbuf(sink)).get_range_buffer();
+  // the leaves are read into a window of two waves (i.e., the wave being parsed and the wave in flight), so that the range buffer usage is bounded;
+  // the level-1 nodes and DataBlocks fetched in between use the next window
+  assert((dsm->get_rbuf(sink)).is_safe(range_buffer + define::rangeWindowSize * 2));
+#ifdef ENABLE_VAR_LEN_KV
+  std::vector<std::pair<Key, Value> > indirect_records;  // values are resolved from DataBlocks once a wave is parsed
+  assert(!indirect_value || !bytes_func);
+  auto emit = [&](const LeafEntry& e) {
+    if (!is_needed(e.key)) return;
+    if (indirect_value) indirect_records.emplace_back(e.key, e.value);
+    else if (bytes_func) (*bytes_func)(e.key, e.get_value_bytes());
+    else func(e.key, e.value);
+  };
+  // read DataBlocks via doorbell batching, one window at a time, so that func (e.g., a predicate) may move cutoff before the next wave
+  auto resolve_indirect_records = [&]() {
+    const int window_block_num = define::rangeWindowSize / define::dataBlockLen;
+    auto block_buffer = range_buffer + define::rangeWindowSize;
+    std::vector<RdmaOpRegion> kv_rs;
+    for (int l = 0; l < (int)indirect_records.size(); l += window_block_num) {
+      int r = std::min(l + window_block_num, (int)indirect_records.size());
+      kv_rs.clear();
+      for (int j = l; j < r; ++ j) {
+        if (!is_needed(indirect_records[j].first)) continue;
+        const auto& data_ptr = indirect_records[j].second;
+        auto data_addr = ((DataPointer*)&data_ptr)->ptr;
+        RdmaOpRegion kv_r;
+        kv_r.source     = (uint64_t)block_buffer + (j - l) * define::dataBlockLen;
+        kv_r.dest       = ((GlobalAddress)data_addr).to_uint64();
+        kv_r.size       = define::dataBlockLen;  // the first record without the rest of its key
+        kv_r.is_on_chip = false;
+        kv_rs.push_back(kv_r);
       }
-      no_fetch = from >= records[i].key || to <= records[i - 1].key;
-      if (!no_fetch) {
-        leaf_addrs.insert(records[i - 1].ptr);
-        leaf_fences[records[i - 1].ptr] = FenceKeys(records[i - 1].key, records[i].key);
+      if (kv_rs.empty()) continue;
+      dsm->read_batches_sync(kv_rs, sink);
+      for (int j = l; j < r; ++ j) {
+        const auto& [k, data_ptr] = indirect_records[j];
+        if (!is_needed(k)) continue;
+        auto data_block = (DataBlock*)(block_buffer + (j - l) * define::dataBlockLen);
+        if (data_block->is_stamped(k, data_ptr)) func(k, data_block->first_record()->value);
+        else {  // the DataBlock is reused since the leaf was read
+          Value v;
+          read_leaf_retry[dsm->getMyThreadID()] ++;
+          if (search(k, v, sink)) func(k, v);
+        }
       }
     }
-  }
+    indirect_records.clear();
+  };
+#else
+  auto emit = [&](const LeafEntry& e) {
+    if (!is_needed(e.key)) return;
+    if (bytes_func) (*bytes_func)(e.key, e.get_value_bytes());
+    else func(e.key, e.value);
+  };
+#endif
 
-  auto merge_internals = [](std::vector<std::pair<int, int> >& intervals, std::vector<std::pair<int, int> >& res){  // intervals: [l, r)
+  // the level-1 nodes are discovered lazily in scan order (right-to-left if reverse): a cached one is used directly, and an
+  // uncached range is fetched a few nodes at a time, so that the nodes beyond cutoff are never fetched
+  tree_cache->search_range_from_cache(from, to, cache_search_result, tree_id);
+  std::sort(cache_search_result.begin(), cache_search_result.end(), [](const InternalNode& a, const InternalNode& b){
+    return a.metadata.fence_keys.lowest < b.metadata.fence_keys.lowest;
+  });
+  struct Level1Range {
+    FenceKeys range;
+    int cached_id;  // -1 if the range is not cached
+  };
+  std::vector<Level1Range> level1_ranges;  // in scan order
+  auto covered_to = from;
+  for (int i = 0; i < (int)cache_search_result.size(); ++ i) {
+    const auto& fence_keys = cache_search_result[i].metadata.fence_keys;
+    if (covered_to >= to) break;
+    if (fence_keys.lowest > covered_to) level1_ranges.emplace_back(Level1Range{FenceKeys(covered_to, std::min(fence_keys.lowest, to)), -1});
+    level1_ranges.emplace_back(Level1Range{fence_keys, i});
+    covered_to = std::max(covered_to, fence_keys.highest);
+  }
+  if (covered_to < to) level1_ranges.emplace_back(Level1Range{FenceKeys(covered_to, to), -1});
+  record_cache_hit_ratio(std::all_of(level1_ranges.begin(), level1_ranges.end(), [](const Level1Range& r){ return r.cached_id >= 0; }), 1);
+  if (reverse) std::reverse(level1_ranges.begin(), level1_ranges.end());
+  int next_range_id = 0;
+
+  auto get_segments_cost = [](const std::vector<std::pair<int, int> >& segments) {  // read bytes + per-IO cost
+    uint64_t cost = 0;
+    for (const auto& [l_idx, r_idx] : segments) cost += std::get<1>(LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx)) + define::rangeIOCost;
+    return cost;
+  };
+  auto merge_internals = [=](std::vector<std::pair<int, int> >& intervals, std::vector<std::pair<int, int> >& res){  // intervals: [l, r)
     std::sort(intervals.begin(), intervals.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b){
       return a.first < b.first;
     });
@@ -1997,92 +3657,108 @@ bool Tree::range_query(const Key &from, const Key &to, std::map<Key, Value> &ret
       i = j;
     }
 #ifdef GREEDY_RANGE_QUERY
+    std::vector<std::pair<int, int> > greedy_temp;
     n = temp.size();
     i = 0;
     while (i < n) {
       int j = i + 1;
       int end = temp[i].second;
       while (j < n && std::max(end, temp[j].second) <= (temp[i].first + (int)define::maxLeafEntryPerIO)) end = std::max(end, temp[j ++].second);
-      res.emplace_back(std::make_pair(temp[i].first, end));
+      greedy_temp.emplace_back(std::make_pair(temp[i].first, end));
       i = j;
     }
+    // greedy merging trades read bytes for fewer IOs
+    res = (get_segments_cost(greedy_temp) <= get_segments_cost(temp) ? greedy_temp : temp);
 #else
     res = temp;
 #endif
   };
 
   int leaf_cnt = 0;
-  auto range_buffer = (dsm->get_rbuf(nullptr)).get_range_buffer();
+  std::queue<int> read_queue;  // ids of the leaves waiting to be (re-)read
 #ifdef FINE_GRAINED_RANGE_QUERY
   // generate read segments
-  for (const auto& leaf_addr : leaf_addrs) {
-    Key l_k = std::max(leaf_fences[leaf_addr].lowest, from);
-    Key r_k = std::min(leaf_fences[leaf_addr].highest, to);
+  auto add_leaf = [&](const GlobalAddress& leaf_addr, const FenceKeys& leaf_fence) {
+    Key l_k = std::max(leaf_fence.lowest, from);
+    Key r_k = std::min(leaf_fence.highest, to);
     std::vector<std::pair<int, int> > segments;
-    if (l_k == leaf_fences[leaf_addr].lowest && r_k == leaf_fences[leaf_addr].highest) {
-      segments.emplace_back(std::make_pair(0, (int)define::leafSpanSize));
-    }
-    else for (auto k = l_k; k < r_k; k = k + 1) {
-      int hash_idx = get_hashed_leaf_entry_index(k);
+    std::vector<std::pair<int, int> > merged_segments;
 #ifdef SPECULATIVE_READ
-      try_read_leaf[dsm->getMyThreadID()] ++;
-      int speculative_idx;
-      if (idx_cache->search_idx_from_cache(leaf_addr, hash_idx, (hash_idx + define::neighborSize) % define::leafSpanSize, k, speculative_idx)) {
-          try_speculative_read[dsm->getMyThreadID()] ++;
-          speculative_keys.emplace_back(k);
-          segments.emplace_back(std::make_pair(speculative_idx, speculative_idx + 1));
-          continue;
-      }
+    std::vector<Key> leaf_speculative_keys;
+#endif
+    // cost model: only narrow ranges are enumerated key by key, so that the CPU cost is bounded by the leaf count
+    auto enum_end = l_k + (uint8_t)define::rangeMaxEnumKeyNum;
+    bool read_whole_leaf = (l_k == leaf_fence.lowest && r_k == leaf_fence.highest) ||
+                           (enum_end > l_k && enum_end < r_k);
+    if (!read_whole_leaf) {
+      for (auto k = l_k; k < r_k; k = k + 1) {
+        int hash_idx = LeafHashScheme::get_home_index(k);
+#ifdef SPECULATIVE_READ
+        try_read_leaf[dsm->getMyThreadID()] ++;
+        int speculative_idx;
+        if (idx_cache->search_idx_from_cache(leaf_addr, hash_idx, (hash_idx + neighbor_size) % define::leafSpanSize, k, speculative_idx)) {
+            leaf_speculative_keys.emplace_back(k);
+            segments.emplace_back(std::make_pair(speculative_idx, speculative_idx + 1));
+            continue;
+        }
 #endif
-      if (hash_idx + (int)define::neighborSize <= (int)define::leafSpanSize) segments.emplace_back(std::make_pair(hash_idx, hash_idx + (int)define::neighborSize));
-      else {
-        segments.emplace_back(std::make_pair(hash_idx, (int)define::leafSpanSize));
-        segments.emplace_back(std::make_pair(0,  (int)define::neighborSize - ((int)define::leafSpanSize - hash_idx)));
+        if (hash_idx + neighbor_size <= (int)define::leafSpanSize) segments.emplace_back(std::make_pair(hash_idx, hash_idx + neighbor_size));
+        else {
+          segments.emplace_back(std::make_pair(hash_idx, (int)define::leafSpanSize));
+          segments.emplace_back(std::make_pair(0,  neighbor_size - ((int)define::leafSpanSize - hash_idx)));
+        }
       }
+      // merge the intervals
+      merge_internals(segments, merged_segments);
+      // the hop segments are not worth it if they cost more than reading the entire leaf
+      read_whole_leaf = (get_segments_cost(merged_segments) >= define::transLeafSize + define::rangeIOCost);
     }
-    // merge the intervals
-    std::vector<std::pair<int, int> > merged_segments;
-    merge_internals(segments, merged_segments);
+    if (read_whole_leaf) {
+      merged_segments.clear();
+      merged_segments.emplace_back(std::make_pair(0, (int)define::leafSpanSize));
+    }
+#ifdef SPECULATIVE_READ
+    else {
+      try_speculative_read[dsm->getMyThreadID()] += leaf_speculative_keys.size();
+      speculative_keys.insert(leaf_speculative_keys.begin(), leaf_speculative_keys.end());
+      speculative_num += leaf_speculative_keys.size();
+    }
+#endif
     for (const auto& [l_idx, r_idx] : merged_segments) {
       // get info
       auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx);
+      leaf_info[leaf_cnt].emplace_back(std::make_tuple(l_idx, r_idx - l_idx, leaf_addr, raw_offset, raw_len, first_offset));
+    }
+    leaf_nearest.emplace_back(reverse ? r_k - 1 : l_k);
+    read_queue.push(leaf_cnt ++);
+  };
+  auto get_leaf_regions = [&](int i, int slot) {
+    for (const auto& [start_idx, segment_size, leaf_addr, raw_offset, raw_len, first_offset] : leaf_info[i]) {
       RdmaOpRegion r;
-      r.source     = (uint64_t)range_buffer + leaf_cnt * define::allocationLeafSize + raw_offset;
+      r.source     = (uint64_t)range_buffer + slot * define::allocationLeafSize + raw_offset;
       r.dest       = (leaf_addr + raw_offset).to_uint64();
       r.size       = raw_len;
       r.is_on_chip = false;
       rs.push_back(r);
-      leaf_info[leaf_cnt].emplace_back(std::make_tuple(l_idx, r_idx - l_idx, leaf_addr, raw_offset, raw_len, first_offset));
     }
-    ++ leaf_cnt;
-    assert((dsm->get_rbuf(nullptr)).is_safe(range_buffer + leaf_cnt * define::allocationLeafSize));
-  }
-  int next_leaf_cnt;
-  InfoMap next_info;
-  // batch read
-re_read:
-  dsm->read_batches_sync(rs);
-  rs.clear();
-  next_info.clear();
-  next_leaf_cnt = 0;
-  // parse read leaf segments
-  for (int i = 0; i < leaf_cnt; ++ i) {
-    auto leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
+  };
+  // parse the read segments of leaf i; the inconsistent ones are kept in leaf_info to be re-read
+  auto parse_leaf = [&](int i, int slot) {
+#ifdef SPECULATIVE_READ
+    bool is_retry = (i >= retry_leaf_start);
+#endif
+    auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
     auto leaf = (LeafNode *)leaf_buffer;
-    for (const auto& [start_idx, segment_size, leaf_addr, raw_offset, raw_len, first_offset] : leaf_info[i]) {
-      auto raw_buffer = range_buffer + i * define::allocationLeafSize + raw_offset;
+    InfoMap::mapped_type failed_segments;
+    for (const auto& segment : leaf_info[i]) {
+      const auto& [start_idx, segment_size, leaf_addr, raw_offset, raw_len, first_offset] = segment;
+      auto raw_buffer = range_buffer + slot * define::allocationLeafSize + raw_offset;
       uint8_t segment_node_versions = 0;
-      auto intermediate_buffer = (dsm->get_rbuf(nullptr)).get_segment_buffer();
+      auto intermediate_buffer = (dsm->get_rbuf(sink)).get_segment_buffer();
       auto [first_metadata_offset, new_len] = MetadataManager::get_offset_info(start_idx, segment_size);
       // check versions consistency
       if (!(LeafVersionManager::decode_segment_versions(raw_buffer, intermediate_buffer, first_offset, segment_size, first_metadata_offset, new_len, segment_node_versions))) {
-        RdmaOpRegion r;
-        r.source     = (uint64_t)range_buffer + next_leaf_cnt * define::allocationLeafSize + raw_offset;
-        r.dest       = (leaf_addr + raw_offset).to_uint64();
-        r.size       = raw_len;
-        r.is_on_chip = false;
-        rs.push_back(r);
-        next_info[next_leaf_cnt].emplace_back(std::make_tuple(start_idx, segment_size, leaf_addr, raw_offset, raw_len, first_offset));
+        failed_segments.emplace_back(segment);
         continue;
       }
       MetadataManager::decode_segment_metadata(intermediate_buffer, (char*)&(leaf->records[start_idx]), first_metadata_offset, segment_size, leaf->metadata);
@@ -2091,12 +3767,12 @@ re_read:
       for (int j = 0; j < segment_size; ++ j) {
         const auto& e = leaf->records[start_idx + j];
         if (e.key == define::kkeyNull) hash_idxes.emplace_back(-1);
-        else hash_idxes.emplace_back(get_hashed_leaf_entry_index(e.key));
+        else hash_idxes.emplace_back(LeafHashScheme::get_home_index(e.key));
       }
       bool is_ok = true;
       for (int j = 0; j < segment_size && is_ok; ++ j) {
         const auto& hop_bitmap = leaf->records[start_idx + j].hop_bitmap;
-        for (int k = 0; k < std::min((int)define::neighborSize, segment_size - j); ++ k) {
+        for (int k = 0; k < std::min(neighbor_size, segment_size - j); ++ k) {
           if ((hop_bitmap & (1ULL << (define::neighborSize - k - 1))) && hash_idxes[j + k] != start_idx + j) {
             is_ok = false;
             break;
@@ -2104,205 +3780,702 @@ re_read:
         }
       }
       if (!is_ok) {
-        RdmaOpRegion r;
-        r.source     = (uint64_t)range_buffer + next_leaf_cnt * define::allocationLeafSize + raw_offset;
-        r.dest       = (leaf_addr + raw_offset).to_uint64();
-        r.size       = raw_len;
-        r.is_on_chip = false;
-        rs.push_back(r);
-        next_info[next_leaf_cnt].emplace_back(std::make_tuple(start_idx, segment_size, leaf_addr, raw_offset, raw_len, first_offset));
+        failed_segments.emplace_back(segment);
         continue;
       }
       // search key from the segments
       for (int j = start_idx; j < start_idx + segment_size; ++ j) {
         const auto& e = leaf->records[j];
         if (e.key != define::kkeyNull && e.key >= from && e.key < to) {
-          ret[e.key] = e.value;
 #ifdef SPECULATIVE_READ
+          // a re-read neighborhood only reports the missed keys, the others have been reported already
+          bool is_new = speculative_keys.erase(e.key) || !is_retry;
+          if (e.value != define::kValueNull && is_new) emit(e);  // skip removed max key
           idx_cache->add_to_cache(leaf_addr, j, e.key);
+#else
+          if (e.value != define::kValueNull) emit(e);  // skip removed max key
 #endif
         }
       }
     }
-    if (next_info.find(next_leaf_cnt) != next_info.end()) next_leaf_cnt ++;
-  }
+    leaf_info[i].swap(failed_segments);
+    return leaf_info[i].empty();
+  };
 #else
   UNUSED(merge_internals);
-  // batch read
-  for (const auto& leaf_addr : leaf_addrs) {
+  auto add_leaf = [&](const GlobalAddress& leaf_addr, const FenceKeys& leaf_fence) {
+    leaf_info[leaf_cnt] = leaf_addr;
+    leaf_nearest.emplace_back(reverse ? std::min(leaf_fence.highest, to) - 1 : std::max(leaf_fence.lowest, from));
+    read_queue.push(leaf_cnt ++);
+  };
+  auto get_leaf_regions = [&](int i, int slot) {
     RdmaOpRegion r;
-    r.source     = (uint64_t)range_buffer + leaf_cnt * define::allocationLeafSize;
-    r.dest       = leaf_addr.to_uint64();
+    r.source     = (uint64_t)range_buffer + slot * define::allocationLeafSize;
+    r.dest       = leaf_info[i].to_uint64();
     r.size       = define::allocationLeafSize;
     r.is_on_chip = false;
     rs.push_back(r);
-    leaf_info[leaf_cnt ++] = leaf_addr;
-  }
-  assert((dsm->get_rbuf(nullptr)).is_safe(range_buffer + leaf_cnt * define::allocationLeafSize));
-  int next_leaf_cnt;
-  InfoMap next_info;
-  // batch read
-re_read:
-  dsm->read_batches_sync(rs);
-  rs.clear();
-  next_info.clear();
-  next_leaf_cnt = 0;
-  // parse read leaf nodes
-  for (int i = 0; i < leaf_cnt; ++ i) {
-    auto raw_leaf_buffer = range_buffer + i * define::allocationLeafSize;
-    auto leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
+  };
+  // parse read leaf i; return false if it should be re-read
+  auto parse_leaf = [&](int i, int slot) {
+    auto raw_leaf_buffer = range_buffer + slot * define::allocationLeafSize;
+    auto leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
     auto leaf = (LeafNode *)leaf_buffer;
 #ifdef METADATA_REPLICATION
     // check versions consistency
-    auto intermediate_leaf_buffer = (dsm->get_rbuf(nullptr)).get_leaf_buffer();
-    if (!LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer)) {
-      RdmaOpRegion r;
-      r.source     = (uint64_t)range_buffer + next_leaf_cnt * define::allocationLeafSize;
-      r.dest       = leaf_info[i].to_uint64();
-      r.size       = define::allocationLeafSize;
-      r.is_on_chip = false;
-      rs.push_back(r);
-      next_info[next_leaf_cnt ++] = leaf_info[i];
-      continue;
-    }
+    auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+    if (!LeafVersionManager::decode_node_versions(raw_leaf_buffer, intermediate_leaf_buffer)) return false;
     MetadataManager::decode_node_metadata(intermediate_leaf_buffer, leaf_buffer);
 #else
     // check versions consistency
-    if (!VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer)) {
-      RdmaOpRegion r;
-      r.source     = (uint64_t)range_buffer + next_leaf_cnt * define::allocationLeafSize;
-      r.dest       = leaf_info[i].to_uint64();
-      r.size       = define::allocationLeafSize;
-      r.is_on_chip = false;
-      rs.push_back(r);
-      next_info[next_leaf_cnt ++] = leaf_info[i];
-      continue;
-    }
+    if (!VersionManager<LeafNode, LeafEntry>::decode_node_versions(raw_leaf_buffer, leaf_buffer)) return false;
 #endif
 #ifdef HOPSCOTCH_LEAF_NODE
     // check hopping consistency
-    bool is_ok = true;
     auto& records = leaf->records;
     std::vector<int> hash_idxes;
     for (const auto& e : records) {
       if (e.key == define::kkeyNull) hash_idxes.emplace_back(-1);
-      else hash_idxes.emplace_back(get_hashed_leaf_entry_index(e.key));
+      else hash_idxes.emplace_back(LeafHashScheme::get_home_index(e.key));
     }
-    for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
+    for (int j = 0; j < (int)define::leafSpanSize; ++ j) {
       uint16_t hop_bitmap = 0;
-      for (int j = 0; j < (int)define::neighborSize; ++ j) {
-        if (hash_idxes[(i + j) % define::leafSpanSize] == i) {
-          hop_bitmap |= 1ULL << (define::neighborSize - j - 1);
+      for (int z = 0; z < neighbor_size; ++ z) {
+        if (hash_idxes[(j + z) % define::leafSpanSize] == j) {
+          hop_bitmap |= 1ULL << (define::neighborSize - z - 1);
         }
       }
-      if (hop_bitmap != records[i].hop_bitmap) {
-        is_ok = false;
-        break;
-      }
-    }
-    if (!is_ok) {
-      RdmaOpRegion r;
-      r.source     = (uint64_t)range_buffer + next_leaf_cnt * define::allocationLeafSize;
-      r.dest       = leaf_info[i].to_uint64();
-      r.size       = define::allocationLeafSize;
-      r.is_on_chip = false;
-      rs.push_back(r);
-      next_info[next_leaf_cnt ++] = leaf_info[i];
-      continue;
+      if (hop_bitmap != records[j].hop_bitmap) return false;
     }
 #endif
     // search key from the leaves
     for (const auto& e : leaf->records) {
-      if (e.key != define::kkeyNull && e.key >= from && e.key < to) {
-        ret[e.key] = e.value;
+      if (e.key != define::kkeyNull && e.value != define::kValueNull && e.key >= from && e.key < to) {
+        emit(e);
       }
     }
-  }
+    return true;
+  };
 #endif
-#if (defined FINE_GRAINED_RANGE_QUERY && defined SPECULATIVE_READ)
-  std::map<GlobalAddress, std::vector<Key> > retry_leaf_keys;
-  for (const auto& k : speculative_keys) {
-    if (ret.find(k) != ret.end()) correct_speculative_read[dsm->getMyThreadID()] ++;
-    else {
-      GlobalAddress p;
-      GlobalAddress sibling_p;
-      uint16_t level;
-      auto cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level);
-      if (!cache_entry || level != 1) {
-        search(k, ret[k]);  // load into cache
+
+  // add the leaves of a level-1 node overlapping [from, to), in scan order
+  auto add_level1_node = [&](const InternalNode& node) {
+    const auto& metadata = node.metadata;
+    assert(metadata.level == 1);
+    const auto& records = node.records;
+    std::vector<std::pair<GlobalAddress, FenceKeys> > children;
+    for (int i = 0; i <= (int)define::internalSpanSize; ++ i) {
+      if (i > 0 && records[i - 1].key == define::kkeyNull) break;
+      auto lowest = (i == 0 ? metadata.fence_keys.lowest : records[i - 1].key);
+      auto highest = ((i == (int)define::internalSpanSize || records[i].key == define::kkeyNull) ? metadata.fence_keys.highest : records[i].key);
+      if (lowest < to && highest > from) children.emplace_back(i == 0 ? metadata.leftmost_ptr : records[i - 1].ptr, FenceKeys(lowest, highest));
+    }
+    if (reverse) std::reverse(children.begin(), children.end());
+    for (const auto& [leaf_addr, leaf_fence] : children) if (leaf_addrs.insert(leaf_addr).second) add_leaf(leaf_addr, leaf_fence);
+  };
+  // discover the next level-1 node(s) in scan order; return false if there is nothing left to discover
+  auto discover_leaves = [&]() {
+    while (next_range_id < (int)level1_ranges.size()) {
+      auto& [range, cached_id] = level1_ranges[next_range_id];
+      if (range.lowest >= range.highest || !is_needed(reverse ? range.highest - 1 : range.lowest)) {  // cannot contribute anymore
+        ++ next_range_id;
         continue;
       }
-      retry_leaf_keys[p].emplace_back(k);
+      if (cached_id >= 0) {
+        add_level1_node(cache_search_result[cached_id]);
+        ++ next_range_id;
+        return true;
+      }
+      std::vector<InternalNode> fetched_nodes;
+      internal_nodes_fetch(range.lowest, range.highest, fetched_nodes, sink, define::rangeDiscoverNodeNum, reverse);
+      if (fetched_nodes.empty()) {  // the root is a leaf
+        auto e = get_root_ptr(sink);
+        if (leaf_addrs.insert(e.ptr).second) add_leaf(e.ptr, FenceKeys::Widest());
+        next_range_id = level1_ranges.size();
+        return true;
+      }
+      if (reverse) std::reverse(fetched_nodes.begin(), fetched_nodes.end());
+      for (const auto& node : fetched_nodes) {
+        add_level1_node(node);
+        if (reverse) range.highest = std::min(range.highest, node.metadata.fence_keys.lowest);
+        else range.lowest = std::max(range.lowest, node.metadata.fence_keys.highest);
+      }
+      return true;
+    }
+    return false;
+  };
+
+  // pipelined batch read: a wave of leaves is decoded while the next wave is in flight,
+  // and the inconsistent leaves are re-read by a later wave instead of a separate round.
+  // nothing is in flight when a wave is posted, so the synchronous reads (i.e., the discovery and the DataBlocks) are done here
+  auto post_wave = [&](std::vector<int>& wave, int first_slot) {
+#ifdef ENABLE_VAR_LEN_KV
+    resolve_indirect_records();
+#endif
+    wave.clear();
+    rs.clear();
+    while ((int)wave.size() < define::rangePipelineLeafNum) {
+      if (read_queue.empty() && !discover_leaves()) break;
+      if (read_queue.empty()) continue;
+      auto i = read_queue.front();
+      read_queue.pop();
+      if (!is_needed(leaf_nearest[i])) continue;  // cannot contribute anymore
+      wave.emplace_back(i);
+      get_leaf_regions(wave.back(), first_slot + (int)wave.size() - 1);
+    }
+    return rs.empty() ? 0 : dsm->read_batches_async(rs, sink);
+  };
+  std::vector<int> wave;
+  std::vector<int> next_wave;
+  int wave_slot = 0;
+  int next_wave_slot = define::rangePipelineLeafNum;
+  auto posted_cnt = post_wave(wave, wave_slot);
+  while (!wave.empty()) {
+    dsm->wait_batches(posted_cnt, sink);
+    posted_cnt = post_wave(next_wave, next_wave_slot);
+    for (int j = 0; j < (int)wave.size(); ++ j) if (!parse_leaf(wave[j], wave_slot + j)) read_queue.push(wave[j]);
+#if (defined FINE_GRAINED_RANGE_QUERY && defined SPECULATIVE_READ)
+    // all leaves are parsed and no read is in flight, so the missed speculative keys can be retried
+    if (next_wave.empty() && read_queue.empty() && next_range_id == (int)level1_ranges.size() && !speculative_checked) {
+      speculative_checked = true;
+      correct_speculative_read[dsm->getMyThreadID()] += speculative_num - speculative_keys.size();
+      std::map<GlobalAddress, std::vector<Key> > retry_leaf_keys;
+      for (const auto& k : speculative_keys) {
+        if (!is_needed(k)) continue;
+        GlobalAddress p;
+        GlobalAddress sibling_p;
+        uint16_t level;
+        auto cache_entry = tree_cache->search_from_cache(k, p, sibling_p, level, tree_id);
+        if (!cache_entry || level != 1) {
+          Value v;
+          ValueBytes val_bytes;
+          if (search(k, nullptr, v, sink, bytes_func ? &val_bytes : nullptr)) {  // load into cache
+            searched_records.emplace_back(k, v);
+            if (bytes_func) searched_records.back().set_value_bytes(val_bytes);
+          }
+          continue;
+        }
+        retry_leaf_keys[p].emplace_back(k);
+      }
+      retry_leaf_start = leaf_cnt;
+      for (const auto& [leaf_addr, keys] : retry_leaf_keys) {
+        std::vector<std::pair<int, int> > segments;
+        for (const auto& k : keys) {
+          int hash_idx = LeafHashScheme::get_home_index(k);
+          if (hash_idx + neighbor_size <= (int)define::leafSpanSize) segments.emplace_back(std::make_pair(hash_idx, hash_idx + neighbor_size));
+          else {
+            segments.emplace_back(std::make_pair(hash_idx, (int)define::leafSpanSize));
+            segments.emplace_back(std::make_pair(0,  neighbor_size - ((int)define::leafSpanSize - hash_idx)));
+          }
+        }
+        // merge the intervals
+        std::vector<std::pair<int, int> > merged_segments;
+        merge_internals(segments, merged_segments);
+        for (const auto& [l_idx, r_idx] : merged_segments) {
+          // get info
+          auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx);
+          leaf_info[leaf_cnt].emplace_back(std::make_tuple(l_idx, r_idx - l_idx, leaf_addr, raw_offset, raw_len, first_offset));
+        }
+        leaf_nearest.emplace_back(reverse ? keys.back() : keys.front());
+        read_queue.push(leaf_cnt ++);
+      }
     }
+#endif
+    if (next_wave.empty()) posted_cnt = post_wave(next_wave, next_wave_slot);
+    wave.swap(next_wave);
+    std::swap(wave_slot, next_wave_slot);
   }
-  speculative_keys.clear();
-  for (const auto& [leaf_addr, keys] : retry_leaf_keys) {
-    std::vector<std::pair<int, int> > segments;
-    for (const auto& k : keys) {
-      int hash_idx = get_hashed_leaf_entry_index(k);
-      if (hash_idx + (int)define::neighborSize <= (int)define::leafSpanSize) segments.emplace_back(std::make_pair(hash_idx, hash_idx + (int)define::neighborSize));
-      else {
-        segments.emplace_back(std::make_pair(hash_idx, (int)define::leafSpanSize));
-        segments.emplace_back(std::make_pair(0,  (int)define::neighborSize - ((int)define::leafSpanSize - hash_idx)));
+#if (defined FINE_GRAINED_RANGE_QUERY && defined SPECULATIVE_READ)
+  for (const auto& e : searched_records) if (speculative_keys.erase(e.key)) emit(e);
+#endif
+#ifdef ENABLE_VAR_LEN_KV
+  resolve_indirect_records();
+#endif
+  return true;
+}
+
+
+/*
+  Fetch the level-1 internal nodes covering [from, to) from remote memory via doorbell batching, and cache them.
+  If max_node_num > 0, only the first (the last if reverse) max_node_num nodes of one level-2 node are fetched, so that
+  a range query can discover its level-1 nodes incrementally; the caller continues from the fence keys of the fetched nodes.
+*/
+void Tree::internal_nodes_fetch(const Key &from_k, const Key &to_k, std::vector<InternalNode> &nodes, CoroPull* sink, int max_node_num, bool reverse) {
+  auto from = from_k;
+  auto to = to_k;
+  auto sort_records = [](InternalNode* node) {
+#ifdef UNORDERED_INTERNAL_NODE
+    std::sort(node->records, node->records + define::internalSpanSize, [](const InternalEntry& a, const InternalEntry& b){
+      if (a.key == define::kkeyNull) return false;
+      if (b.key == define::kkeyNull) return true;
+      return a.key < b.key;
+    });
+#else
+    UNUSED(node);
+#endif
+  };
+  auto read_internal_node = [=](const GlobalAddress& node_addr, InternalNode* node) {
+    auto raw_internal_buffer = (dsm->get_rbuf(sink)).get_internal_buffer();
+    do {
+      dsm->read_sync(raw_internal_buffer, node_addr, define::transInternalSize, sink);
+    } while (!VersionManager<InternalNode, InternalEntry>::decode_node_versions(raw_internal_buffer, (char *)node));
+    sort_records(node);
+  };
+
+  // locate the level-2 node surrounding from (to - 1 if reverse)
+  const auto locate_k = (reverse ? to - 1 : from);
+  GlobalAddress p;
+  GlobalAddress sibling_p;
+  uint16_t level = 3;
+#ifdef TREE_ENABLE_CACHE
+  if (!tree_cache->search_ptr_from_cache(locate_k, p, 2, tree_id))
+#endif
+  {
+    auto e = get_root_ptr(sink);
+    p = e.ptr, level = e.level;
+    if (level == 1) return;  // the root is a leaf
+    while (level > 3) internal_node_search(p, sibling_p, locate_k, level, false, sink);
+  }
+
+  // collect the level-1 nodes overlapping [from, to) from the level-2 nodes
+  std::vector<GlobalAddress> level1_addrs;
+  std::vector<FenceKeys> level1_fences;
+  if (level == 2) level1_addrs.emplace_back(p);  // the root is a level-1 node
+  else {
+    auto node = (InternalNode *)(dsm->get_rbuf(sink)).get_internal_buffer();
+    while (p != GlobalAddress::Null()) {
+      read_internal_node(p, node);
+      const auto& fence_keys = node->metadata.fence_keys;
+      const auto& records = node->records;
+      if (locate_k < fence_keys.highest) {  // otherwise turn right
+        cache_node(node);
+        for (int i = 0; i <= (int)define::internalSpanSize; ++ i) {
+          if (i > 0 && records[i - 1].key == define::kkeyNull) break;
+          auto lowest = (i == 0 ? fence_keys.lowest : records[i - 1].key);
+          auto highest = ((i == (int)define::internalSpanSize || records[i].key == define::kkeyNull) ? fence_keys.highest : records[i].key);
+          if (lowest < to && highest > from) {
+            level1_addrs.emplace_back(i == 0 ? node->metadata.leftmost_ptr : records[i - 1].ptr);
+            level1_fences.emplace_back(FenceKeys(lowest, highest));
+          }
+        }
+        if (to <= fence_keys.highest || max_node_num > 0) break;
       }
+      p = node->metadata.sibling_ptr;
     }
-    // merge the intervals
-    std::vector<std::pair<int, int> > merged_segments;
-    merge_internals(segments, merged_segments);
-    for (const auto& [l_idx, r_idx] : merged_segments) {
-      // get info
-      auto [raw_offset, raw_len, first_offset] = LeafVersionManager::get_offset_info(l_idx, r_idx - l_idx);
+  }
+  if (level1_addrs.empty()) return;
+  if (max_node_num > 0 && (int)level1_addrs.size() > max_node_num) {
+    if (reverse) {
+      level1_addrs.erase(level1_addrs.begin(), level1_addrs.end() - max_node_num);
+      level1_fences.erase(level1_fences.begin(), level1_fences.end() - max_node_num);
+      from = level1_fences.front().lowest;
+    }
+    else {
+      level1_addrs.resize(max_node_num);
+      level1_fences.resize(max_node_num);
+    }
+  }
+  if (max_node_num > 0 && !level1_fences.empty()) to = std::min(to, level1_fences.back().highest);
+
+  // batch read the level-1 nodes, beside the leaf window of an ongoing range query
+  std::map<GlobalAddress, InternalNode> fetched_nodes;
+  auto range_buffer = (dsm->get_rbuf(sink)).get_range_buffer() + define::rangeWindowSize;
+  assert((dsm->get_rbuf(sink)).is_safe(range_buffer + define::rangeWindowSize));
+  const int window_node_num = define::rangeWindowSize / define::allocationInternalSize;  // nodes read at a time
+  std::vector<RdmaOpRegion> rs;
+  for (int l = 0; l < (int)level1_addrs.size(); l += window_node_num) {
+    std::vector<int> read_ids;
+    for (int i = l; i < std::min(l + window_node_num, (int)level1_addrs.size()); ++ i) read_ids.emplace_back(i);
+    while (!read_ids.empty()) {
+      rs.clear();
+      for (int i : read_ids) {
+        RdmaOpRegion r;
+        r.source     = (uint64_t)range_buffer + (i - l) * define::allocationInternalSize;
+        r.dest       = level1_addrs[i].to_uint64();
+        r.size       = define::transInternalSize;
+        r.is_on_chip = false;
+        rs.push_back(r);
+      }
+      dsm->read_batches_sync(rs, sink);
+      std::vector<int> retry_ids;
+      for (int i : read_ids) {
+        auto& node = fetched_nodes[level1_addrs[i]];
+        if (!VersionManager<InternalNode, InternalEntry>::decode_node_versions(range_buffer + (i - l) * define::allocationInternalSize, (char *)&node)) {
+          retry_ids.emplace_back(i);
+          continue;
+        }
+        sort_records(&node);
+      }
+      read_ids.swap(retry_ids);
+    }
+  }
+
+  // follow the sibling pointers in case of the splits not yet reflected in the level-2 nodes
+  auto node_addr = level1_addrs.front();
+  while (node_addr != GlobalAddress::Null()) {
+    if (fetched_nodes.find(node_addr) == fetched_nodes.end()) read_internal_node(node_addr, &fetched_nodes[node_addr]);
+    auto& node = fetched_nodes[node_addr];
+    const auto& fence_keys = node.metadata.fence_keys;
+    cache_node(&node);
+    if (fence_keys.highest > from) nodes.emplace_back(node);
+    if (fence_keys.highest >= to) break;
+    node_addr = node.metadata.sibling_ptr;
+  }
+}
+
+
+Tree::Scanner::Scanner(Tree *tree, CoroPull* sink, int prefetch_num) : tree(tree), sink(sink), prefetch_num(prefetch_num),
+                                                                      limit(0), returned_cnt(0), fetch_from(define::kkeyNull), next_leaf_addr(),
+                                                                      prefetch_posted_cnt(0), cur(0), resolved_cnt(0) {
+  assert(prefetch_num > 0 && prefetch_num * define::allocationLeafSize <= define::rangeWindowSize);
+}
+
+
+Tree::Scanner::~Scanner() {
+  wait_prefetch();
+}
+
+
+void Tree::Scanner::seek(const Key &k, uint64_t limit) {
+  assert(tree->dsm->is_register());
+  wait_prefetch();
+  tree->before_operation(sink);
+  this->limit = limit;
+  returned_cnt = 0;
+  fetch_from = k;
+  prefetch_addrs.clear();
+  records.clear();
+  cur = resolved_cnt = 0;
+  next_leaf_addr = tree->locate_leaf(k, sink);
+}
+
+
+bool Tree::Scanner::next(Key &k, Value &v) {
+  while (returned_cnt < limit) {
+    while (cur == (int)records.size()) {
+      if (next_leaf_addr == GlobalAddress::Null()) return false;
+      fetch_leaves();
+    }
+    if (cur == resolved_cnt) resolve_values();
+    const auto& r = records[cur ++];
+    if (r.second == define::kValueNull) continue;  // the DataBlock is removed since the leaf was read
+    k = r.first;
+    v = r.second;
+    ++ returned_cnt;
+    return true;
+  }
+  return false;
+}
+
+
+/*
+  Post the read of the next leaf together with the following (prefetch_num - 1) leaves predicted by the cached level-1 nodes.
+  The reads land in the first window of the range buffer and are only waited for by the next fetch_leaves.
+*/
+void Tree::Scanner::post_prefetch() {
+  assert(prefetch_posted_cnt == 0);
+  prefetch_addrs = {next_leaf_addr};
+#ifdef TREE_ENABLE_CACHE
+  std::vector<GlobalAddress> cached_leaf_addrs;
+  tree->tree_cache->search_leaves_from_cache(fetch_from, prefetch_num + 1, cached_leaf_addrs, tree->tree_id);
+  auto it = std::find(cached_leaf_addrs.begin(), cached_leaf_addrs.end(), next_leaf_addr);
+  if (it != cached_leaf_addrs.end()) {
+    for (++ it; it != cached_leaf_addrs.end() && (int)prefetch_addrs.size() < prefetch_num; ++ it) prefetch_addrs.emplace_back(*it);
+  }
+#endif
+  auto range_buffer = (tree->dsm->get_rbuf(sink)).get_range_buffer();
+  std::vector<RdmaOpRegion> rs;
+  for (int i = 0; i < (int)prefetch_addrs.size(); ++ i) {
+    RdmaOpRegion r;
+    r.source     = (uint64_t)range_buffer + i * define::allocationLeafSize;
+    r.dest       = prefetch_addrs[i].to_uint64();
+    r.size       = define::transLeafSize;
+    r.is_on_chip = false;
+    rs.push_back(r);
+  }
+  prefetch_posted_cnt = tree->dsm->read_batches_async(rs, sink);
+}
+
+
+void Tree::Scanner::wait_prefetch() {
+  tree->dsm->wait_batches(prefetch_posted_cnt, sink);
+  prefetch_posted_cnt = 0;
+}
+
+
+/*
+  Consume the prefetched leaves that are exactly the ones chained by the sibling pointers, then prefetch the following leaves
+  so that their reads overlap with the consumption of the current records.
+*/
+void Tree::Scanner::fetch_leaves() {
+  records.clear();
+  cur = resolved_cnt = 0;
+  if (prefetch_addrs.empty()) post_prefetch();
+  wait_prefetch();
+  std::vector<GlobalAddress> leaf_addrs;
+  leaf_addrs.swap(prefetch_addrs);
+
+  auto range_buffer = (tree->dsm->get_rbuf(sink)).get_range_buffer();
+  auto leaf = (LeafNode *)(tree->dsm->get_rbuf(sink)).get_leaf_buffer();
+  for (int i = 0; i < (int)leaf_addrs.size(); ++ i) {
+    if (leaf_addrs[i] != next_leaf_addr) break;  // mispredicted
+    if (!tree->leaf_node_decode(range_buffer + i * define::allocationLeafSize, leaf, sink)) {  // torn read, re-read from this leaf
+      read_leaf_retry[tree->dsm->getMyThreadID()] ++;
+      break;
+    }
+    if (!leaf->metadata.is_valid(leaf_addrs[i])) {  // the leaf is merged (and maybe reused), relocate from the remaining keys
+      next_leaf_addr = tree->locate_leaf(fetch_from, sink, leaf_addrs[i]);
+      break;
+    }
+    auto max_key = define::kkeyNull;
+    for (const auto& e : leaf->records) {
+      if (e.key == define::kkeyNull || e.key < fetch_from) continue;
+      if (e.value != define::kValueNull) records.emplace_back(std::make_pair(e.key, e.value));  // skip removed max key
+      max_key = std::max(max_key, e.key);
+    }
+    if (max_key != define::kkeyNull) fetch_from = max_key + 1;
+    next_leaf_addr = (leaf->metadata.sibling_ptr == GlobalAddress::Widest() ? GlobalAddress::Null() : (GlobalAddress)leaf->metadata.sibling_ptr);
+  }
+  std::sort(records.begin(), records.end());
+  if (!records.empty()) resolve_values();  // before the prefetch is posted, as the DataBlocks are read synchronously
+  if (next_leaf_addr != GlobalAddress::Null() && returned_cnt + records.size() < limit) post_prefetch();
+}
+
+
+/*
+  Resolve the values of the next chunk of records, bounded by the remaining limit, so that only the DataBlocks of the
+  records actually returned are read. The DataBlocks land in the second window of the range buffer, after the prefetched leaves.
+*/
+void Tree::Scanner::resolve_values() {
+#ifdef ENABLE_VAR_LEN_KV
+  if (tree->indirect_value) {  // read DataBlocks via doorbell batching
+    wait_prefetch();  // the synchronous reads below would consume its completions
+    auto block_buffer = (tree->dsm->get_rbuf(sink)).get_range_buffer() + define::rangeWindowSize;
+    assert((tree->dsm->get_rbuf(sink)).is_safe(block_buffer + define::rangeWindowSize));
+    const uint64_t chunk_size = std::min<uint64_t>(define::rangeWindowSize / define::dataBlockLen, limit - returned_cnt);
+    const int end = (int)std::min<uint64_t>(records.size(), resolved_cnt + chunk_size);
+    std::vector<RdmaOpRegion> kv_rs;
+    for (int i = resolved_cnt; i < end; ++ i) {
+      auto data_addr = ((DataPointer*)&records[i].second)->ptr;
       RdmaOpRegion r;
-      r.source     = (uint64_t)range_buffer + next_leaf_cnt * define::allocationLeafSize + raw_offset;
-      r.dest       = (leaf_addr + raw_offset).to_uint64();
-      r.size       = raw_len;
+      r.source     = (uint64_t)block_buffer + (i - resolved_cnt) * define::dataBlockLen;
+      r.dest       = ((GlobalAddress)data_addr).to_uint64();
+      r.size       = define::dataBlockLen;  // the first record without the rest of its key
       r.is_on_chip = false;
-      rs.push_back(r);
-      next_info[next_leaf_cnt].emplace_back(std::make_tuple(l_idx, r_idx - l_idx, leaf_addr, raw_offset, raw_len, first_offset));
+      kv_rs.push_back(r);
     }
-    ++ next_leaf_cnt;
+    tree->dsm->read_batches_sync(kv_rs, sink);
+    for (int i = resolved_cnt; i < end; ++ i) {
+      auto& [k, v] = records[i];
+      auto data_block = (DataBlock*)(block_buffer + (i - resolved_cnt) * define::dataBlockLen);
+      if (data_block->is_stamped(k, v)) v = data_block->first_record()->value;
+      else if (!tree->search(k, v, sink)) v = define::kValueNull;  // the DataBlock is reused since the leaf was read
+    }
+    resolved_cnt = end;
+    return;
   }
 #endif
-  if (!rs.empty()) {
-    leaf_info = next_info;
-    leaf_cnt = next_leaf_cnt;
-    goto re_read;
+  resolved_cnt = records.size();
+}
+
+
+/*
+  Build the tree bottom-up from sorted unique kvs and install its root; only for an empty tree, i.e., whose root is a leaf
+  without live entries (the initial root leaf holds only the ghost key). Return false and leave the tree untouched otherwise.
+  The old root leaf is locked during the build, so that no insert lands in it, and retired afterwards.
+*/
+bool Tree::bulk_load(KVIter begin, KVIter end, double fill_factor, CoroPull* sink) {
+  assert(fill_factor > 0 && fill_factor <= 1);
+  auto old_root_entry = get_root_ptr(sink);
+  if (old_root_entry.level != 1) return false;
+  auto old_root_addr = (GlobalAddress)old_root_entry.ptr;
+  auto old_root_lock_buffer = (dsm->get_rbuf(sink)).get_lock_buffer();
+  lock_node(old_root_addr, old_root_lock_buffer, true, sink);
+  LeafNode old_root;
+  bool is_empty = ((uint64_t)get_root_ptr(sink) == (uint64_t)old_root_entry);  // not split before locked
+  if (is_empty) {
+    auto raw_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+    dsm->read_sync(raw_leaf_buffer, old_root_addr, define::transLeafSize, sink);
+    bool is_consistent = leaf_node_decode(raw_leaf_buffer, &old_root, sink);
+    assert(is_consistent);  // locked, hence never torn
+    UNUSED(is_consistent);
+    is_empty = std::none_of(old_root.records, old_root.records + define::leafSpanSize, [](const LeafEntry& e){
+      return e.key != define::kkeyNull && e.value != define::kValueNull;
+    });
   }
-#ifdef ENABLE_VAR_LEN_KV
-  // read DataBlocks via doorbell batching
-  std::map<Key, Value> indirect_values;
-  std::vector<RdmaOpRegion> kv_rs;
-  int kv_cnt = 0;
-  for (const auto& [_, data_ptr] : ret) {
-    auto data_addr = ((DataPointer*)&data_ptr)->ptr;
-    auto data_len  = ((DataPointer*)&data_ptr)->data_len;
+  if (!is_empty) {
+    unlock_node(old_root_addr, old_root_lock_buffer, true, sink);
+    return false;
+  }
+
+  // nodes are encoded into the range buffer and written via doorbell batching
+  auto range_buffer = (dsm->get_rbuf(sink)).get_range_buffer();
+  uint64_t buffer_offset = 0;
+  std::vector<RdmaOpRegion> rs;
+  auto flush_writes = [&](){
+    if (!rs.empty()) dsm->write_batches_sync(rs, sink);
+    rs.clear();
+    buffer_offset = 0;
+  };
+  auto get_write_buffer = [&](uint32_t size){
+    if ((int)rs.size() >= define::bulkLoadBatchNum || !(dsm->get_rbuf(sink)).is_safe(range_buffer + buffer_offset + size)) flush_writes();
+    auto buffer = range_buffer + buffer_offset;
+    buffer_offset += size;
+    return buffer;
+  };
+  auto add_write = [&](char* buffer, const GlobalAddress& addr, uint32_t size){
     RdmaOpRegion r;
-    r.source     = (uint64_t)range_buffer + kv_cnt * define::dataBlockLen;
-    r.dest       = ((GlobalAddress)data_addr).to_uint64();
-    r.size       = data_len;
+    r.source     = (uint64_t)buffer;
+    r.dest       = addr.to_uint64();
+    r.size       = size;
     r.is_on_chip = false;
-    kv_rs.push_back(r);
-    kv_cnt ++;
-  }
-  assert((dsm->get_rbuf(nullptr)).is_safe(range_buffer + kv_cnt * define::dataBlockLen));
-  dsm->read_batches_sync(kv_rs);
-  kv_cnt = 0;
-  for (auto& [_, v] : ret) {
-    auto data_block = (DataBlock*)(range_buffer + kv_cnt * define::dataBlockLen);
-    v = data_block->value;
-    kv_cnt ++;
-  }
+    rs.push_back(r);
+  };
+
+  Key ghost_key;
+  ghost_key.fill(0xff);
+  ghost_key = ghost_key - 1;
+  auto insert_locally = [=](LeafNode& leaf, const Key& k, Value v){
+#ifdef HOPSCOTCH_LEAF_NODE
+    return hopscotch_insert_locally(leaf.records, k, v) >= 0;
+#else
+    for (auto& e : leaf.records) if (e.key == define::kkeyNull) {
+      e.update(k, v);
+      return true;
+    }
+    return false;
 #endif
-  // FIXME: for simplicity, load uncached innernal nodes according to ret, leveraging the ordered YCSB E
-  for(auto k = from; k < to; k = k + 1) {
-    if (ret.find(k) != ret.end()) {
-      cache_hit[dsm->getMyThreadID()]++;
+  };
+  // insert [from, to) into an empty leaf, return the first kv that fails to insert
+  auto fill_leaf = [=](LeafNode& leaf, KVIter from, KVIter to){
+    new (&leaf) LeafNode;
+    for (auto it = from; it != to; ++ it) {
+      assert(it->first < ghost_key && (it == begin || std::prev(it)->first < it->first));
+      if (!insert_locally(leaf, it->first, it->second)) return it;
     }
-    else {
-      cache_miss[dsm->getMyThreadID()]++;
-      search(k, ret[k]);
+    return to;
+  };
+
+  // leaf level
+  std::vector<std::pair<Key, GlobalAddress> > nodes;  // (lowest key, address) of the nodes in the last built level
+  int leaf_cap = std::max(1, (int)(define::leafSpanSize * fill_factor));
+  auto leaf_addr = dsm->alloc(define::allocationLeafSize, PACKED_ADDR_ALIGN_BIT);  // it may be the root
+  auto lowest = FenceKeys::Widest().lowest;
+  auto it = begin;
+  LeafNode leaf;
+  while (true) {
+    auto leaf_end = fill_leaf(leaf, it, it + std::min<int64_t>(leaf_cap, end - it));
+    if (leaf_end != it + std::min<int64_t>(leaf_cap, end - it)) {  // hopping fails, rebuild the leaf with the kvs inserted so far
+      assert(leaf_end != it);
+      fill_leaf(leaf, it, leaf_end);
+    }
+    if (leaf_end == end && !insert_locally(leaf, ghost_key, define::kValueNull)) {  // the last leaf holds the ghost key
+      fill_leaf(leaf, it, -- leaf_end);
+    }
+    bool is_last = (leaf_end == end);
+    bool is_root = (is_last && nodes.empty());
+    // metadata
+    auto sibling_addr = (is_last ? GlobalAddress::Null() : dsm->alloc(define::allocationLeafSize));
+    auto highest = (is_last ? FenceKeys::Widest().highest : std::prev(leaf_end)->first + 1);
+    leaf.metadata.fence_keys = FenceKeys{lowest, highest};
+    leaf.metadata.sibling_ptr = sibling_addr;
+#ifdef SIBLING_BASED_VALIDATION
+    if (is_root) leaf.metadata.sibling_ptr = GlobalAddress::Widest();  // root tag
+#else
+    UNUSED(is_root);
+#endif
+#ifdef HOPSCOTCH_LEAF_NODE
+    fit_leaf_neighbor_size(&leaf);
+#endif
+#ifdef ENABLE_VAR_LEN_KV
+    // write DataBlocks out-of-place and change values into the DataPointers
+    if (indirect_value) for (auto& e : leaf.records) if (e.key != define::kkeyNull && e.key != ghost_key) {
+      auto block_buffer = get_write_buffer(define::dataBlockLen);
+      (new (block_buffer) DataBlock(e.key, 0))->append(nullptr, e.value);
+      auto block_addr = block_allocator->alloc(define::dataBlockLen);
+      add_write(block_buffer, block_addr, define::dataBlockLen);
+      e.value = (uint64_t)DataPointer(define::dataBlockLen, block_addr, 0);
+    }
+#endif
+    // encode
+    auto encoded_leaf_buffer = get_write_buffer(define::allocationLeafSize);
+#ifdef METADATA_REPLICATION
+    auto intermediate_leaf_buffer = (dsm->get_rbuf(sink)).get_leaf_buffer();
+    MetadataManager::encode_node_metadata((char *)&leaf, intermediate_leaf_buffer);
+    LeafVersionManager::encode_node_versions(intermediate_leaf_buffer, encoded_leaf_buffer);
+#else
+    VersionManager<LeafNode, LeafEntry>::encode_node_versions((char *)&leaf, encoded_leaf_buffer);
+#endif
+#ifdef VACANCY_AWARE_LOCK
+    int max_key_idx = 0;
+    std::vector<int> empty_idxes;
+    for (int i = 0; i < (int)define::leafSpanSize; ++ i) {
+      const auto& e = leaf.records[i];
+      if (e.key == define::kkeyNull) empty_idxes.emplace_back(i);
+      else if (e.key > leaf.records[max_key_idx].key) max_key_idx = i;
+    }
+    auto if_lock = new (encoded_leaf_buffer + get_lock_info(true)) VALOCK(0ULL, max_key_idx);  // unlock
+    if_lock->update_vacancy(0, define::leafSpanSize - 1, empty_idxes);
+#else
+    *(uint64_t *)(encoded_leaf_buffer + get_lock_info(true)) = 0;  // unlock
+#endif
+    add_write(encoded_leaf_buffer, leaf_addr, define::allocationLeafSize);
+    nodes.emplace_back(std::make_pair(lowest, leaf_addr));
+
+    if (is_last) break;
+    it = leaf_end;
+    lowest = highest;
+    leaf_addr = sibling_addr;
+  }
+
+  // internal levels
+  uint8_t level = 0;  // level of the nodes in the last built level
+  int internal_cap = std::max(2, (int)(define::internalSpanSize * fill_factor) + 1);  // including the leftmost child
+  while (nodes.size() > 1) {
+    std::vector<std::pair<Key, GlobalAddress> > parents;
+    int n = nodes.size();
+    bool is_root = (n <= internal_cap);
+    auto node_addr = dsm->alloc(define::allocationInternalSize, is_root ? PACKED_ADDR_ALIGN_BIT : CACHELINE_ALIGN_BIT);
+    for (int i = 0; i < n; i += internal_cap) {
+      int j = std::min(n, i + internal_cap);
+      InternalNode node;
+      node.metadata.level = level + 1;
+      node.metadata.leftmost_ptr = nodes[i].second;
+      for (int z = i + 1; z < j; ++ z) node.records[z - i - 1] = InternalEntry(nodes[z].first, nodes[z].second);
+      node.metadata.fence_keys = FenceKeys{nodes[i].first, j < n ? nodes[j].first : FenceKeys::Widest().highest};
+      auto sibling_addr = (j < n ? dsm->alloc(define::allocationInternalSize) : GlobalAddress::Null());
+      node.metadata.sibling_ptr = sibling_addr;
+      node.metadata.sibling_leftmost_ptr = (j < n ? nodes[j].second : GlobalAddress::Null());
+      // encode
+      auto encoded_node_buffer = get_write_buffer(define::allocationInternalSize);
+      VersionManager<InternalNode, InternalEntry>::encode_node_versions((char *)&node, encoded_node_buffer);
+      *(uint64_t *)(encoded_node_buffer + get_lock_info(false)) = 0;  // unlock
+      add_write(encoded_node_buffer, node_addr, define::allocationInternalSize);
+      parents.emplace_back(std::make_pair(nodes[i].first, node_addr));
+      node_addr = sibling_addr;
     }
+    nodes.swap(parents);
+    ++ level;
+  }
+  flush_writes();
+
+  // install root pointer; it cannot change while the old root leaf is locked
+  auto cas_buffer = (dsm->get_rbuf(sink)).get_cas_buffer();
+  auto root_entry = RootEntry(level + 1, nodes.front().second);
+  bool res = dsm->cas_sync(root_ptr_ptr, old_root_entry, root_entry, cas_buffer, sink);
+  assert(res);
+  UNUSED(res);
+  rough_height.store(root_entry.level);
+
+  // empty and invalidate the old root leaf, so that the stale readers will retry from the new root
+  for (auto& e : old_root.records) {
+    e.update(define::kkeyNull, define::kValueNull);
+#ifdef HOPSCOTCH_LEAF_NODE
+    e.hop_bitmap = 0;
+#endif
   }
+  old_root.metadata.valid = 0;
+  reclaim_leaf_and_unlock(&old_root, old_root_addr, old_root_lock_buffer, sink);
   return true;
 }
 
@@ -2380,10 +4553,15 @@ void Tree::clear_debug_info() {
   memset(try_read_leaf, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(read_two_segments, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(try_read_hopscotch, 0, sizeof(uint64_t) * MAX_APP_THREAD);
+  memset(read_hopscotch_entry, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(leaf_read_sibling, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(retry_cnt, 0, sizeof(uint64_t) * MAX_APP_THREAD * MAX_FLAG_NUM);
   memset(try_insert_op, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(split_node, 0, sizeof(uint64_t) * MAX_APP_THREAD);
+  memset(merge_node, 0, sizeof(uint64_t) * MAX_APP_THREAD);
+  memset(rehash_leaf, 0, sizeof(uint64_t) * MAX_APP_THREAD);
+  memset(widen_neighborhood, 0, sizeof(uint64_t) * MAX_APP_THREAD);
+  memset(read_wider_neighborhood, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(try_write_segment, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(write_two_segments, 0, sizeof(uint64_t) * MAX_APP_THREAD);
   memset(load_factor_sum, 0, sizeof(double) * MAX_APP_THREAD);
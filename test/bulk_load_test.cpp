@@ -0,0 +1,128 @@
+#include "Tree.h"
+#include "DSM.h"
+
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <map>
+#include <iostream>
+
+// bulk load into an empty tree, checked by searches, range queries and later inserts;
+// then bulk loads into the non-empty trees (the loaded one, and one holding a single key) must fail and keep their data,
+// while the latter is loaded once its key is removed
+
+#define LOAD_KEY_NUM 1000000
+#define INSERT_PER_THREAD 20000
+
+int kThreadCount;
+int kNodeCount;
+
+std::thread th[MAX_APP_THREAD];
+std::atomic<uint64_t> error_cnt{0};
+
+Tree *tree;
+Tree *small_tree;
+DSM *dsm;
+
+
+void check(bool ok, const char* what, uint64_t int_k) {
+  if (ok) return;
+  if (error_cnt.fetch_add(1) < 10) printf("[ERROR] %s, key=%lu\n", what, int_k);
+}
+
+
+// the loaded keys are the even ones, so that the odd ones are inserted later
+std::vector<std::pair<Key, Value> > make_kvs(uint64_t key_num) {
+  std::vector<std::pair<Key, Value> > kvs;
+  for (uint64_t i = 1; i <= key_num; ++ i) kvs.emplace_back(int2key(i * 2), i * 2 + 1);
+  return kvs;
+}
+
+
+void thread_run(int id) {
+  bindCore(id * 2 + 1);
+  dsm->registerThread();
+  uint64_t my_id = kThreadCount * dsm->getMyNodeID() + id;
+  uint64_t thread_num = kThreadCount * kNodeCount;
+
+  // 1. loaded keys, partitioned among all threads
+  for (uint64_t i = 1 + my_id; i <= LOAD_KEY_NUM; i += thread_num) {
+    Value v;
+    check(tree->search(int2key(i * 2), v) && v == i * 2 + 1, "loaded key is not found", i * 2);
+    check(!tree->search(int2key(i * 2 + 1), v), "absent key is found", i * 2 + 1);
+  }
+  uint64_t from = 1 + my_id * (LOAD_KEY_NUM / thread_num) * 2, to = from + 2000;
+  std::map<Key, Value> ret;
+  tree->range_query(int2key(from), int2key(to), ret);
+  uint64_t loaded_cnt = 0;
+  for (const auto& [k, v] : ret) {
+    auto int_k = key2int(k);
+    if (int_k % 2) continue;  // inserted by the other threads meanwhile
+    check(v == int_k + 1, "range query returns a wrong value", int_k);
+    ++ loaded_cnt;
+  }
+  check(loaded_cnt == 1000, "range query returns a wrong number of loaded keys", from);
+
+  // 2. inserts into the loaded leaves, which split the filled ones
+  for (uint64_t i = 0; i < INSERT_PER_THREAD; ++ i) {
+    uint64_t int_k = (my_id + i * thread_num) * 2 + 1;
+    tree->insert(int2key(int_k), int_k);
+  }
+  for (uint64_t i = 0; i < INSERT_PER_THREAD; ++ i) {
+    uint64_t int_k = (my_id + i * thread_num) * 2 + 1;
+    Value v;
+    check(tree->search(int2key(int_k), v) && v == int_k, "insert after bulk load is not found", int_k);
+    if (int_k - 1 <= LOAD_KEY_NUM * 2) check(tree->search(int2key(int_k - 1), v) && v == int_k, "loaded key is lost by an insert", int_k - 1);
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: ./bulk_load_test kNodeCount kThreadCount\n");
+    exit(-1);
+  }
+  kNodeCount = atoi(argv[1]);
+  kThreadCount = atoi(argv[2]);
+
+  DSMConfig config;
+  assert(kNodeCount >= MEMORY_NODE_NUM);
+  config.machineNR = kNodeCount;
+  config.threadNR = kThreadCount;
+  dsm = DSM::getInstance(config);
+  dsm->registerThread();
+  tree = new Tree(dsm, 0);
+  small_tree = new Tree(dsm, 1);
+  dsm->barrier("bulk_load_test");
+
+  auto kvs = make_kvs(LOAD_KEY_NUM);
+  if (dsm->getMyNodeID() == 0) {
+    check(tree->bulk_load(kvs.cbegin(), kvs.cend()), "bulk load into an empty tree fails", 0);
+  }
+  dsm->barrier("bulk_load_test_loaded");
+
+  for (int i = 0; i < kThreadCount; i ++) th[i] = std::thread(thread_run, i);
+  for (int i = 0; i < kThreadCount; i ++) th[i].join();
+  dsm->barrier("bulk_load_test_checked");
+
+  if (dsm->getMyNodeID() == 0) {
+    // 3. the non-empty trees are kept
+    Value v;
+    auto more_kvs = make_kvs(10);
+    check(!tree->bulk_load(more_kvs.cbegin(), more_kvs.cend()), "bulk load into a loaded tree succeeds", 0);
+    check(tree->search(int2key(LOAD_KEY_NUM * 2), v) && v == LOAD_KEY_NUM * 2 + 1, "loaded key is lost by a failed bulk load", LOAD_KEY_NUM * 2);
+    small_tree->insert(int2key(1), 1);
+    check(!small_tree->bulk_load(more_kvs.cbegin(), more_kvs.cend()), "bulk load into a tree with one key succeeds", 1);
+    check(small_tree->search(int2key(1), v) && v == 1, "key is lost by a failed bulk load", 1);
+    // 4. a tree whose keys are all removed is empty again
+    small_tree->remove(int2key(1));
+    check(small_tree->bulk_load(more_kvs.cbegin(), more_kvs.cend()), "bulk load into an emptied tree fails", 1);
+    for (const auto& [k, val] : more_kvs) check(small_tree->search(k, v) && v == val, "loaded key is not found", key2int(k));
+    check(!small_tree->search(int2key(1), v), "removed key is found after bulk load", 1);
+  }
+  dsm->barrier("bulk_load_test_finish");
+
+  printf("node %d: %s (%lu errors)\n", dsm->getMyNodeID(), error_cnt.load() ? "FAILED" : "PASSED", error_cnt.load());
+  return error_cnt.load() ? 1 : 0;
+}
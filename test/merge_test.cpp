@@ -0,0 +1,92 @@
+#include "Tree.h"
+#include "DSM.h"
+
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <map>
+#include <iostream>
+
+// insert => remove most keys (so the sparse leaves are merged into their siblings) => wait for the reclaim delay
+// => insert again (so the splits reuse the merged leaves), checked by searches and range queries in each round;
+// the stale cached pointers to the merged (and maybe reused) leaves must be detected
+
+#define KEY_PER_THREAD 50000
+#define KEEP_INTERVAL 16
+#define ROUND_NUM 5
+
+int kThreadCount;
+int kNodeCount;
+
+std::thread th[MAX_APP_THREAD];
+std::atomic<uint64_t> error_cnt{0};
+
+Tree *tree;
+DSM *dsm;
+
+
+void check(bool ok, const char* what, uint64_t int_k) {
+  if (ok) return;
+  if (error_cnt.fetch_add(1) < 10) printf("[ERROR] %s, key=%lu\n", what, int_k);
+}
+
+
+void check_keys(uint64_t base, int r, bool all_kept) {
+  for (uint64_t i = 0; i < KEY_PER_THREAD; ++ i) {
+    Value v;
+    bool found = tree->search(int2key(base + i), v);
+    if (all_kept || i % KEEP_INTERVAL == 0) check(found && v == base + i + r, "kept key is not found", base + i);
+    else check(!found, "removed key is found", base + i);
+  }
+  std::map<Key, Value> ret;
+  tree->range_query(int2key(base), int2key(base + KEY_PER_THREAD), ret);
+  check(ret.size() == (all_kept ? KEY_PER_THREAD : KEY_PER_THREAD / KEEP_INTERVAL), "range query returns a wrong number of keys", base);
+  for (const auto& [k, v] : ret) {
+    auto int_k = key2int(k);
+    check((all_kept || (int_k - base) % KEEP_INTERVAL == 0) && v == int_k + r, "range query returns a wrong key", int_k);
+  }
+}
+
+
+void thread_run(int id) {
+  bindCore(id * 2 + 1);
+  dsm->registerThread();
+  uint64_t my_id = kThreadCount * dsm->getMyNodeID() + id;
+  uint64_t base = 1 + my_id * KEY_PER_THREAD;
+
+  for (int r = 1; r <= ROUND_NUM; ++ r) {
+    for (uint64_t i = 0; i < KEY_PER_THREAD; ++ i) tree->insert(int2key(base + i), base + i + r);  // splits reuse the merged leaves
+    check_keys(base, r, true);
+    for (uint64_t i = 0; i < KEY_PER_THREAD; ++ i) if (i % KEEP_INTERVAL) tree->remove(int2key(base + i));  // merges the sparse leaves
+    check_keys(base, r, false);
+    std::this_thread::sleep_for(std::chrono::nanoseconds(define::kNodeReclaimDelay * 2));
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: ./merge_test kNodeCount kThreadCount\n");
+    exit(-1);
+  }
+  kNodeCount = atoi(argv[1]);
+  kThreadCount = atoi(argv[2]);
+
+  DSMConfig config;
+  assert(kNodeCount >= MEMORY_NODE_NUM);
+  config.machineNR = kNodeCount;
+  config.threadNR = kThreadCount;
+  dsm = DSM::getInstance(config);
+  dsm->registerThread();
+  tree = new Tree(dsm);
+  dsm->barrier("merge_test");
+
+  for (int i = 0; i < kThreadCount; i ++) th[i] = std::thread(thread_run, i);
+  for (int i = 0; i < kThreadCount; i ++) th[i].join();
+  dsm->barrier("merge_test_finish");
+
+  printf("node %d: %s (%lu errors)\n", dsm->getMyNodeID(), error_cnt.load() ? "FAILED" : "PASSED", error_cnt.load());
+  return error_cnt.load() ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include "Tree.h"
+#include "DSM.h"
+
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <iostream>
+
+// insert => remove => insert on the same keys (so on the same slots), checked by searches;
+// then all threads write the same keys, which combines removes (kValueNull) with inserts, and the results are checked again
+
+#define KEY_PER_THREAD 20000
+#define SHARED_KEY_NUM 1000
+#define ROUND_NUM 20
+
+int kThreadCount;
+int kNodeCount;
+
+std::thread th[MAX_APP_THREAD];
+std::atomic<int> finished_cnt{0};
+std::atomic<uint64_t> error_cnt{0};
+
+Tree *tree;
+DSM *dsm;
+
+
+void check(bool ok, const char* what, uint64_t int_k) {
+  if (ok) return;
+  if (error_cnt.fetch_add(1) < 10) printf("[ERROR] %s, key=%lu\n", what, int_k);
+}
+
+
+void check_insert_remove_insert(uint64_t int_k, Value v1, Value v2) {
+  auto k = int2key(int_k);
+  Value v;
+  tree->insert(k, v1);
+  check(tree->search(k, v) && v == v1, "insert is not found", int_k);
+  tree->remove(k);
+  check(!tree->search(k, v), "remove is still found", int_k);
+  tree->insert(k, v2);  // reuses the freed slot
+  check(tree->search(k, v) && v == v2, "re-insert is not found", int_k);
+}
+
+
+void thread_run(int id) {
+  bindCore(id * 2 + 1);
+  dsm->registerThread();
+  uint64_t my_id = kThreadCount * dsm->getMyNodeID() + id;
+
+  // 1. private keys
+  uint64_t base = SHARED_KEY_NUM + 1 + my_id * KEY_PER_THREAD;
+  for (uint64_t i = 0; i < KEY_PER_THREAD; ++ i) check_insert_remove_insert(base + i, i + 1, i + 2);
+  for (uint64_t i = 0; i < KEY_PER_THREAD; i += 2) tree->remove(int2key(base + i));
+  for (uint64_t i = 0; i < KEY_PER_THREAD; ++ i) {
+    Value v;
+    bool found = tree->search(int2key(base + i), v);
+    check(i % 2 ? (found && v == i + 2) : !found, "mismatch after removing half of the keys", base + i);
+  }
+
+  // 2. shared keys, with the removes combined into the inserts of other threads
+  for (int r = 0; r < ROUND_NUM; ++ r) {
+    for (uint64_t i = 1; i <= SHARED_KEY_NUM; ++ i) {
+      Value v;
+      if ((i + r + id) % 2) tree->insert(int2key(i), i);
+      else tree->remove(int2key(i));
+      if (tree->search(int2key(i), v)) check(v == i, "combined write returns a wrong value", i);
+    }
+  }
+  finished_cnt.fetch_add(1);
+  while (finished_cnt.load() != kThreadCount);
+  if (id == 0) {
+    dsm->barrier("shared_keys_written");
+    for (uint64_t i = 1 + dsm->getMyNodeID(); i <= SHARED_KEY_NUM; i += kNodeCount) {
+      check_insert_remove_insert(i, i, i + 1);
+    }
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: ./remove_test kNodeCount kThreadCount\n");
+    exit(-1);
+  }
+  kNodeCount = atoi(argv[1]);
+  kThreadCount = atoi(argv[2]);
+
+  DSMConfig config;
+  assert(kNodeCount >= MEMORY_NODE_NUM);
+  config.machineNR = kNodeCount;
+  config.threadNR = kThreadCount;
+  dsm = DSM::getInstance(config);
+  dsm->registerThread();
+  tree = new Tree(dsm);
+  dsm->barrier("remove_test");
+
+  for (int i = 0; i < kThreadCount; i ++) th[i] = std::thread(thread_run, i);
+  for (int i = 0; i < kThreadCount; i ++) th[i].join();
+  dsm->barrier("remove_test_finish");
+
+  printf("node %d: %s (%lu errors)\n", dsm->getMyNodeID(), error_cnt.load() ? "FAILED" : "PASSED", error_cnt.load());
+  return error_cnt.load() ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include "Tree.h"
+#include "DSM.h"
+
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <iostream>
+
+// all threads of all nodes fetch_add and compare_and_swap the same counters, whose final values must count every rmw;
+// the rmws on a missing key, a removed key or with a null result must change nothing
+
+#define COUNTER_NUM 100
+#define ROUND_NUM 1000
+
+int kThreadCount;
+int kNodeCount;
+
+std::thread th[MAX_APP_THREAD];
+std::atomic<uint64_t> error_cnt{0};
+
+Tree *tree;
+DSM *dsm;
+
+
+void check(bool ok, const char* what, uint64_t int_k) {
+  if (ok) return;
+  if (error_cnt.fetch_add(1) < 10) printf("[ERROR] %s, key=%lu\n", what, int_k);
+}
+
+
+// counters [1, COUNTER_NUM] for fetch_add and (COUNTER_NUM, 2 * COUNTER_NUM] for compare_and_swap, both from 1
+uint64_t add_key(uint64_t i) { return 1 + i; }
+uint64_t cas_key(uint64_t i) { return 1 + COUNTER_NUM + i; }
+
+
+void thread_run(int id) {
+  bindCore(id * 2 + 1);
+  dsm->registerThread();
+
+  std::vector<Value> last_old_v(COUNTER_NUM, define::kValueNull);
+  for (int r = 0; r < ROUND_NUM; ++ r) {
+    for (uint64_t i = 0; i < COUNTER_NUM; ++ i) {
+      auto old_v = tree->fetch_add(int2key(add_key(i)), 1);
+      check(old_v != define::kValueNull && (last_old_v[i] == define::kValueNull || old_v > last_old_v[i]), "fetch_add returns a stale value", add_key(i));
+      last_old_v[i] = old_v;
+      Value v;
+      do {
+        check(tree->search(int2key(cas_key(i)), v), "cas counter is not found", cas_key(i));
+      } while (!tree->compare_and_swap(int2key(cas_key(i)), v, v + 1));
+    }
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: ./rmw_test kNodeCount kThreadCount\n");
+    exit(-1);
+  }
+  kNodeCount = atoi(argv[1]);
+  kThreadCount = atoi(argv[2]);
+
+  DSMConfig config;
+  assert(kNodeCount >= MEMORY_NODE_NUM);
+  config.machineNR = kNodeCount;
+  config.threadNR = kThreadCount;
+  dsm = DSM::getInstance(config);
+  dsm->registerThread();
+  tree = new Tree(dsm);
+  if (dsm->getMyNodeID() == 0) {
+    for (uint64_t i = 0; i < COUNTER_NUM; ++ i) {
+      tree->insert(int2key(add_key(i)), 1);
+      tree->insert(int2key(cas_key(i)), 1);
+    }
+  }
+  dsm->barrier("rmw_test");
+
+  for (int i = 0; i < kThreadCount; i ++) th[i] = std::thread(thread_run, i);
+  for (int i = 0; i < kThreadCount; i ++) th[i].join();
+  dsm->barrier("rmw_test_counted");
+
+  if (dsm->getMyNodeID() == 0) {
+    // 1. every rmw is counted once
+    Value expected = 1 + (Value)ROUND_NUM * kThreadCount * kNodeCount, v;
+    for (uint64_t i = 0; i < COUNTER_NUM; ++ i) {
+      check(tree->search(int2key(add_key(i)), v) && v == expected, "fetch_add counter is wrong", add_key(i));
+      check(tree->search(int2key(cas_key(i)), v) && v == expected, "cas counter is wrong", cas_key(i));
+    }
+    // 2. a missing key is not created
+    auto missing_k = int2key(cas_key(COUNTER_NUM) + 1);
+    check(tree->fetch_add(missing_k, 1) == define::kValueNull, "fetch_add on a missing key returns a value", key2int(missing_k));
+    check(!tree->compare_and_swap(missing_k, 1, 2), "compare_and_swap on a missing key succeeds", key2int(missing_k));
+    check(!tree->search(missing_k, v), "rmw creates a missing key", key2int(missing_k));
+    // 3. a removed key is not revived
+    auto removed_k = int2key(add_key(0));
+    tree->remove(removed_k);
+    check(tree->fetch_add(removed_k, 1) == define::kValueNull, "fetch_add on a removed key returns a value", key2int(removed_k));
+    check(!tree->search(removed_k, v), "rmw revives a removed key", key2int(removed_k));
+    // 4. a null result is not written
+    auto k = int2key(add_key(1));
+    check(tree->fetch_add(k, -expected) == expected, "fetch_add to null returns a wrong value", add_key(1));
+    check(tree->search(k, v) && v == expected, "fetch_add writes a null value", add_key(1));
+    check(!tree->compare_and_swap(k, expected, define::kValueNull), "compare_and_swap to null succeeds", add_key(1));
+    check(tree->search(k, v) && v == expected, "compare_and_swap writes a null value", add_key(1));
+  }
+  dsm->barrier("rmw_test_finish");
+
+  printf("node %d: %s (%lu errors)\n", dsm->getMyNodeID(), error_cnt.load() ? "FAILED" : "PASSED", error_cnt.load());
+  return error_cnt.load() ? 1 : 0;
+}
@@ -1,5 +1,6 @@
 #include "Tree.h"
 #include "Timer.h"
+#include "LeafHashScheme.h"
 #include <city.h>
 
 #include <stdlib.h>
@@ -36,6 +37,7 @@
 // #define USE_CORO
 #define EPOCH_LAT_TEST
 #define LOADER_NUM 8 // [CONFIG] 8
+// #define BULK_LOAD  // node 0 builds the loaded tree bottom-up instead of inserting key by key
 
 extern double cache_miss[MAX_APP_THREAD];
 extern double cache_hit[MAX_APP_THREAD];
@@ -52,8 +54,13 @@ extern uint64_t correct_speculative_read[MAX_APP_THREAD];
 extern uint64_t try_read_leaf[MAX_APP_THREAD];
 extern uint64_t read_two_segments[MAX_APP_THREAD];
 extern uint64_t try_read_hopscotch[MAX_APP_THREAD];
+extern uint64_t read_hopscotch_entry[MAX_APP_THREAD];
 extern uint64_t try_insert_op[MAX_APP_THREAD];
 extern uint64_t split_node[MAX_APP_THREAD];
+extern uint64_t merge_node[MAX_APP_THREAD];
+extern uint64_t rehash_leaf[MAX_APP_THREAD];
+extern uint64_t widen_neighborhood[MAX_APP_THREAD];
+extern uint64_t read_wider_neighborhood[MAX_APP_THREAD];
 extern uint64_t try_write_segment[MAX_APP_THREAD];
 extern uint64_t write_two_segments[MAX_APP_THREAD];
 extern double load_factor_sum[MAX_APP_THREAD];
@@ -64,6 +71,7 @@ int kThreadCount;
 int kNodeCount;
 int kCoroCnt = 8;
 bool kIsScan;
+bool kIsStrKey;  // email workloads, whose keys go through the string-key API
 #ifdef USE_CORO
 bool kUseCoro = true;
 #else
@@ -117,7 +125,11 @@ public:
         flag = true;
       }
       if (flag) {
-        req[cur].k = int2key(extra_k);
+        if (kIsStrKey) {
+          req[cur].str_k = std::to_string(extra_k);
+          req[cur].k = str2key(req[cur].str_k);
+        }
+        else req[cur].k = int2key(extra_k);
         extra_k += kThreadCount * kCoroCnt * dsm->getClusterSize();
       }
     }
@@ -146,6 +158,18 @@ RequstGen *gen_func(DSM* dsm, Request* req, int req_num, int coro_id, int coro_c
 
 
 void work_func(Tree *tree, const Request& r, CoroPull *sink) {
+#ifdef ENABLE_VAR_LEN_KV
+  if (!r.str_k.empty() && r.req_type != SCAN) {
+    if (r.req_type == SEARCH) {
+      Value v;
+      tree->search(r.str_k, v, sink);
+    }
+    else if (r.req_type == INSERT) tree->insert(r.str_k, r.v, sink);
+    else if (r.req_type == UPDATE) tree->update(r.str_k, r.v, sink);
+    else tree->remove(r.str_k, sink);
+    return;
+  }
+#endif
   if (r.req_type == SEARCH) {
     Value v;
     tree->search(r.k, v, sink);
@@ -156,9 +180,15 @@ void work_func(Tree *tree, const Request& r, CoroPull *sink) {
   else if (r.req_type == UPDATE) {
     tree->update(r.k, r.v, sink);
   }
-  else {
-    std::map<Key, Value> ret;
-    tree->range_query(r.k, r.k + r.range_size, ret);
+  else if (r.req_type == DELETE) {
+    tree->remove(r.k, sink);
+  }
+  else {  // string keys are scanned by their inline keys
+    Tree::Scanner scanner(tree, sink);
+    scanner.seek(r.k, r.range_size);
+    Key k;
+    Value v;
+    while (scanner.next(k, v));
   }
 }
 
@@ -181,13 +211,15 @@ void thread_load(int id) {
     printf("Error opening load file\n");
     assert(false);
   }
-  Key k;
   int cnt = 0;
-  uint64_t int_k;
-  while (load_in >> op >> int_k) {
-    k = int2key(int_k);
+  std::string str_k;
+  while (load_in >> op >> str_k) {
     assert(op == "INSERT");
-    tree->insert(k, randval(e));
+#ifdef ENABLE_VAR_LEN_KV
+    if (kIsStrKey) tree->insert(str_k, randval(e));
+    else
+#endif
+    tree->insert(int2key(std::stoull(str_k)), randval(e));
     if (++ cnt % LOAD_HEARTBEAT == 0) {
       printf("thread %lu: %d load entries loaded.\n", loader_id, cnt);
     }
@@ -196,6 +228,34 @@ void thread_load(int id) {
 }
 
 
+void bulk_load() {
+  assert(!kIsStrKey);  // bulk_load takes inline keys only
+  // gather the ycsb_load of all loaders
+  std::vector<std::pair<Key, Value> > kvs;
+  uint64_t loader_num = std::min(kThreadCount, LOADER_NUM) * dsm->getClusterSize();
+  for (uint64_t loader_id = 0; loader_id < loader_num; ++ loader_id) {
+    std::string op;
+    std::ifstream load_in(ycsb_load_path + std::to_string(loader_id));
+    if (!load_in.is_open()) {
+      printf("Error opening load file\n");
+      assert(false);
+    }
+    uint64_t int_k;
+    while (load_in >> op >> int_k) {
+      assert(op == "INSERT");
+      kvs.emplace_back(std::make_pair(int2key(int_k), randval(e)));
+    }
+  }
+  std::sort(kvs.begin(), kvs.end(), [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){ return a.first < b.first; });
+  kvs.erase(std::unique(kvs.begin(), kvs.end(), [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b){ return a.first == b.first; }), kvs.end());
+  printf("bulk load %lu entries\n", kvs.size());
+  if (!tree->bulk_load(kvs.cbegin(), kvs.cend())) {
+    printf("Error bulk loading into a non-empty tree\n");
+    assert(false);
+  }
+}
+
+
 void thread_run(int id) {
   bindCore(id * 2 + 1);  // bind to CPUs in NUMA that close to mlx5_2
 
@@ -209,9 +269,15 @@ void thread_run(int id) {
   }
 
   // 1. insert ycsb_load
+#ifdef BULK_LOAD
+  if (id == 0 && dsm->getMyNodeID() == 0) {
+    bulk_load();
+  }
+#else
   if (id < std::min(kThreadCount, LOADER_NUM)) {
     thread_load(id);
   }
+#endif
 
   // 2. load ycsb_trans
   Request* req = new Request[MAX_THREAD_REQUEST];
@@ -224,19 +290,24 @@ void thread_run(int id) {
   std::string op;
   int cnt = 0;
   int range_size = 0;
-  uint64_t int_k;
-  while(trans_in >> op >> int_k) {
+  std::string str_k;
+  while(trans_in >> op >> str_k) {
     if (op == "SCAN") trans_in >> range_size;
     else range_size = 0;
     Request r;
     r.req_type = (op == "READ"  ? SEARCH : (
                   op == "INSERT"? INSERT : (
-                  op == "UPDATE"? UPDATE : SCAN
-    )));
+                  op == "UPDATE"? UPDATE : (
+                  op == "DELETE"? DELETE : SCAN
+    ))));
     r.range_size = fix_range_size >= 0 ? fix_range_size : range_size;
-    r.k = int2key(int_k);
+    if (kIsStrKey) {
+      r.k = str2key(str_k);
+      r.str_k = str_k;
+    }
+    else r.k = int2key(std::stoull(str_k));
     if (rm_write_conflict) {
-      if (r.req_type == UPDATE || r.req_type == INSERT) {
+      if (r.req_type == UPDATE || r.req_type == INSERT || r.req_type == DELETE) {
         uint64_t all_thread_num = kThreadCount * dsm->getClusterSize();
         r.k = dsm->getNoComflictKey(key_hash(r.k), my_id, all_thread_num);
       }
@@ -265,7 +336,7 @@ void thread_run(int id) {
     ;
 
   // 3. start ycsb test
-  if (!kIsScan && kUseCoro) {
+  if (kUseCoro) {
     tree->run_coroutine(gen_func, work_func, kCoroCnt, req, req_num);
   }
   else {
@@ -291,14 +362,21 @@ void thread_run(int id) {
 
 void parse_args(int argc, char *argv[]) {
   if (argc != 6 && argc != 7) {
-    printf("Usage: ./ycsb_test kNodeCount kThreadCount kCoroCnt workload_type[randint] workload_idx[a/b/c/d/e] [fix_range_size/rm_write_conflict]\n");
+    printf("Usage: ./ycsb_test kNodeCount kThreadCount kCoroCnt workload_type[randint/email] workload_idx[a/b/c/d/e] [fix_range_size/rm_write_conflict]\n");
     exit(-1);
   }
 
   kNodeCount = atoi(argv[1]);
   kThreadCount = atoi(argv[2]);
   kCoroCnt = atoi(argv[3]);
-  assert(std::string(argv[4]) == "randint");  // currently only int workloads is tested
+  kIsStrKey = (std::string(argv[4]) == "email");
+  assert(kIsStrKey || std::string(argv[4]) == "randint");
+#ifndef ENABLE_VAR_LEN_KV
+  if (kIsStrKey) {
+    printf("email workloads need ENABLE_VAR_LEN_KV\n");
+    exit(-1);
+  }
+#endif
   kIsScan = (std::string(argv[5]) == "e");
 
   std::string workload_dir;
@@ -314,8 +392,12 @@ void parse_args(int argc, char *argv[]) {
     if(kIsScan) fix_range_size = atoi(argv[6]);
     else rm_write_conflict = (atoi(argv[6]) != 0);
   }
+  assert(!kIsStrKey || !rm_write_conflict);  // the conflict-free keys are int keys
 
   printf("kNodeCount %d, kThreadCount %d, kCoroCnt %d\n", kNodeCount, kThreadCount, kCoroCnt);
+#ifdef HOPSCOTCH_LEAF_NODE
+  printf("leaf hash scheme: %s\n", LeafHashScheme::kName);
+#endif
   printf("ycsb_load: %s\n", ycsb_load_path.c_str());
   printf("ycsb_trans: %s\n", ycsb_trans_path.c_str());
   if (argc == 7) {
@@ -360,10 +442,10 @@ int main(int argc, char *argv[]) {
   dsm = DSM::getInstance(config);
   bindCore(kThreadCount * 2 + 1);
 #ifdef ENABLE_CACHE_EVICTION
-  dsm->loadKeySpace(ycsb_load_path, false);
+  dsm->loadKeySpace(ycsb_load_path, kIsStrKey);
 #else
   if (rm_write_conflict) {
-    dsm->loadKeySpace(ycsb_load_path, false);
+    dsm->loadKeySpace(ycsb_load_path, kIsStrKey);
   }
 #endif
   dsm->registerThread();
@@ -432,16 +514,21 @@ int main(int argc, char *argv[]) {
       correct_speculative_read_cnt += correct_speculative_read[i];
     }
 
-    uint64_t try_read_hopscotch_cnt = 0, read_two_segments_cnt = 0;
+    uint64_t try_read_hopscotch_cnt = 0, read_hopscotch_entry_cnt = 0, read_two_segments_cnt = 0, read_wider_neighborhood_cnt = 0;
     for (int i = 0; i < MAX_APP_THREAD; ++i) {
       try_read_hopscotch_cnt += try_read_hopscotch[i];
+      read_hopscotch_entry_cnt += read_hopscotch_entry[i];
       read_two_segments_cnt += read_two_segments[i];
+      read_wider_neighborhood_cnt += read_wider_neighborhood[i];
     }
 
-    uint64_t try_insert_op_cnt = 0, split_node_cnt = 0;
+    uint64_t try_insert_op_cnt = 0, split_node_cnt = 0, merge_node_cnt = 0, rehash_leaf_cnt = 0, widen_neighborhood_cnt = 0;
     for (int i = 0; i < MAX_APP_THREAD; ++i) {
       try_insert_op_cnt += try_insert_op[i];
       split_node_cnt += split_node[i];
+      merge_node_cnt += merge_node[i];
+      rehash_leaf_cnt += rehash_leaf[i];
+      widen_neighborhood_cnt += widen_neighborhood[i];
     }
 
     uint64_t try_write_segment_cnt = 0, write_two_segments_cnt = 0;
@@ -499,8 +586,13 @@ int main(int argc, char *argv[]) {
       printf("speculative read rate: %.4lf\n", try_speculative_read_cnt * 1.0 / try_read_leaf_cnt);
       printf("correct ratio of speculative read: %.4lf\n", correct_speculative_read_cnt * 1.0 / try_speculative_read_cnt);
       printf("read two hopscotch-segments rate: %.4lf\n", read_two_segments_cnt * 1.0 / try_read_hopscotch_cnt);
+      printf("avg. entries per hopscotch-segment read: %.4lf\n", read_hopscotch_entry_cnt * 1.0 / try_read_hopscotch_cnt);
       printf("write two hopscotch-segments rate: %.4lf\n", write_two_segments_cnt * 1.0 / try_write_segment_cnt);
       printf("node split rate: %.4lf\n", split_node_cnt * 1.0 / try_insert_op_cnt);
+      printf("node merge rate: %.4lf\n", merge_node_cnt * 1.0 / try_write_op_cnt);
+      printf("leaf rehash rate: %.4lf\n", rehash_leaf_cnt * 1.0 / try_insert_op_cnt);
+      printf("leaf neighborhood widen rate: %.4lf\n", widen_neighborhood_cnt * 1.0 / try_insert_op_cnt);
+      printf("read wider neighborhood rate: %.4lf\n", read_wider_neighborhood_cnt * 1.0 / try_read_hopscotch_cnt);
       printf("avg. leaf load factor: %.4lf\n", load_factor_sum_all * 1.0 / split_hopscotch_cnt);
       printf("\n");
     }